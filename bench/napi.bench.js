@@ -0,0 +1,69 @@
+// Measures the per-call cost of the N-API layer on top of the native
+// reader, so it can be compared with the numbers from mzip_bench.
+//
+//   node bench/napi.bench.js [archive] [password] > result.json
+
+const zip = require('../');
+
+const archive = process.argv[2] || './tests/test.zip';
+const password = process.argv[3] || '';
+const ITERATIONS = 20000;
+
+function hrtimeNs(start) {
+    const [s, ns] = process.hrtime(start);
+    return s * 1e9 + ns;
+}
+
+function syncBench(name, n, fn) {
+    const start = process.hrtime();
+    for (let i = 0; i < n; ++i) {
+        fn(i);
+    }
+    return { metric: name, value: hrtimeNs(start) / n, unit: 'ns/op' };
+}
+
+async function asyncBench(name, n, fn) {
+    const start = process.hrtime();
+    for (let i = 0; i < n; ++i) {
+        await fn(i);
+    }
+    return { metric: name, value: hrtimeNs(start) / n / 1000, unit: 'us/op' };
+}
+
+async function main() {
+    const results = [];
+
+    const openStart = process.hrtime();
+    const r = await zip.open(archive, password);
+    results.push({ metric: 'open_ms', value: hrtimeNs(openStart) / 1e6, unit: 'ms' });
+
+    const names = [];
+    for (let i = 0; i < r.count; ++i) {
+        const item = r.item(i);
+        if (!item.is_directory) {
+            names.push(item.name);
+        }
+    }
+
+    results.push(syncBench('count_ns', ITERATIONS, () => r.count));
+    results.push(syncBench('item_ns', ITERATIONS, (i) => r.item(i % r.count)));
+    results.push(syncBench('exists_ns', ITERATIONS, (i) => r.exists(names[i % names.length])));
+    results.push(await asyncBench('read_us', Math.min(ITERATIONS, names.length * 4),
+        (i) => r.read(names[i % names.length])));
+    results.push(await asyncBench('read_parallel_us', 1, () =>
+        Promise.all(names.map((n) => r.read(n)))));
+    results[results.length - 1].value /= names.length;
+
+    await r.close();
+
+    for (const res of results) {
+        res.scenario = archive;
+        res.value = Number(res.value.toFixed(3));
+    }
+    process.stdout.write(JSON.stringify(results, null, 2) + '\n');
+}
+
+main().catch((e) => {
+    console.error(e);
+    process.exit(1);
+});
@@ -1 +1,49 @@
-module.exports = require('bindings')({ bindings: 'mzip' });
+const { Writable, PassThrough } = require('stream');
+
+const mzip = require('bindings')({ bindings: 'mzip' });
+
+// Writable that parses a zip archive as it arrives (e.g. from a socket) and
+// emits ('entry', info, stream) for every entry, in archive order. Each entry
+// stream must be consumed; parsing waits while it is backed up.
+class ZipParseStream extends Writable {
+  constructor() {
+    super();
+    this._parser = new mzip.ZipStreamReader();
+    this._entry = null;
+  }
+
+  _write(chunk, encoding, callback) {
+    this._parser.write(chunk).then((events) => this._dispatch(events, callback), callback);
+  }
+
+  _final(callback) {
+    this._parser.end().then((events) => this._dispatch(events, callback), callback);
+  }
+
+  _dispatch(events, callback) {
+    // The entry stream that last refused data; an entry that has ended
+    // since emits no 'drain', and its consumer reads the rest on its own.
+    let blocked = null;
+    for (const ev of events) {
+      if (ev.type === 'entry') {
+        this._entry = new PassThrough();
+        this.emit('entry', ev.entry, this._entry);
+      } else if (ev.type === 'data') {
+        if (!this._entry.write(ev.data)) {
+          blocked = this._entry;
+        }
+      } else if (ev.type === 'entry_end') {
+        this._entry.end();
+      }
+    }
+    if (!blocked || blocked.writableEnded || blocked.writableNeedDrain === false) {
+      callback();
+    } else {
+      blocked.once('drain', () => callback());
+    }
+  }
+}
+
+mzip.parse = () => new ZipParseStream();
+
+module.exports = mzip;
@@ -1,8 +1,11 @@
 #include "addon.h"
 
 #include <napi.h>
+#include <zlib.h>
 
+#include "stats_api.h"
 #include "zip_reader_api.h"
+#include "zip_stream_reader_api.h"
 #include "zip_writer_api.h"
 
 // It creates and initializes an instance of the
@@ -24,6 +27,16 @@ static Napi::Object Init(Napi::Env env, Napi::Object exports) {
   AddonData* addon_data = CreateAddonData(env, exports);
   api::ZipReaderAPI::Init(env, exports, addon_data);
   api::ZipWriterAPI::Init(env, exports, addon_data);
+  api::ZipStreamReaderAPI::Init(env, exports, addon_data);
+  api::StatsAPI::Init(env, exports);
+  // "x.y.z.zlib-ng" when built with MZIP_ZLIB_NG and bound to that build
+  // rather than to the zlib Node exports.
+  exports.Set("zlib_version", Napi::String::New(env, zlibVersion()));
+#ifdef MZIP_HAVE_ZLIB_NG
+  exports.Set("zlib_ng", Napi::Boolean::New(env, true));
+#else
+  exports.Set("zlib_ng", Napi::Boolean::New(env, false));
+#endif
   return exports;
 }
 
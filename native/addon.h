@@ -7,6 +7,7 @@
 typedef struct {
   Napi::FunctionReference ctor_reader;
   Napi::FunctionReference ctor_writer;
+  Napi::FunctionReference ctor_stream_reader;
 } AddonData;
 
 #endif //ADDON_H
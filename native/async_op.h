@@ -1,22 +1,36 @@
 #pragma once
 
+#include <functional>
 #include <type_traits>
 #include <utility>
 
 #include <napi.h>
 
+#include "stats.h"
+
 template <typename Fn>
 class AsyncOp : public Napi::AsyncWorker {
  public:
   typedef typename std::result_of<Fn()>::type R;
 
-  AsyncOp(Napi::Env env, Fn f)
+  AsyncOp(Napi::Env env, stats::Op op, Fn f, std::function<void()> rejected = nullptr)
       : Napi::AsyncWorker(env),
         deferred(Napi::Promise::Deferred::New(env)),
-        fn_(std::forward<Fn>(f)) {}
+        trace_(op),
+        fn_(std::forward<Fn>(f)),
+        rejected_(std::move(rejected)) {}
   ~AsyncOp() {}
 
-  void Execute() override { result_ = std::move(fn_()); }
+  void Execute() override {
+    trace_.start();
+    try {
+      result_ = std::move(fn_());
+    } catch (...) {
+      trace_.finish(false);
+      throw;
+    }
+    trace_.finish(true);
+  }
 
   // Executed when the async work is complete
   // this function will be run inside the main event loop
@@ -27,19 +41,26 @@ class AsyncOp : public Napi::AsyncWorker {
   }
 
   void OnError(Napi::Error const& error) override {
+    if (rejected_) {
+      rejected_();
+    }
     deferred.Reject(error.Value());
   }
 
   Napi::Promise::Deferred deferred;
 
  private:
+  stats::OpTrace trace_;
   R result_;
   Fn fn_;
+  std::function<void()> rejected_;
 };
 
+// `rejected` runs on the JS thread just before the promise is rejected.
 template <typename Fn>
-inline Napi::Promise MakePromise(Napi::Env env, Fn f) {
-  AsyncOp<Fn>* wk = new AsyncOp<Fn>(env, std::forward<Fn>(f));
+inline Napi::Promise MakePromise(Napi::Env env, stats::Op op, Fn f,
+                                 std::function<void()> rejected = nullptr) {
+  AsyncOp<Fn>* wk = new AsyncOp<Fn>(env, op, std::forward<Fn>(f), std::move(rejected));
   wk->Queue();
   return wk->deferred.Promise();
 }
@@ -0,0 +1,191 @@
+// Writes and verifies an archive past the classic zip limits, for the zip64
+// paths no small fixture reaches:
+//
+//   mzip_large_test [--dir work_dir] [--entries n] [--huge-gib n]
+//                   [--zip64 auto|force] [--offsets]
+//
+// - more than 65535 entries (70000 by default)
+// - one entry of `huge-gib` GiB (5 by default) read from a sparse file, so
+//   its sizes need zip64 while the input costs no disk space
+// - with --offsets, 4.1 GiB of incompressible entries in front of a last
+//   small one, so that local header offsets pass 4 GiB as well (slow)
+//
+// Exits non-zero on the first mismatch.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "fs_util.h"
+#include "zip_reader.h"
+#include "zip_writer.h"
+
+using namespace ziputil;
+
+namespace {
+
+const int64_t GiB = 1024LL * 1024 * 1024;
+
+std::string small_content(int i) { return fmt::format("entry {} of a large archive\n", i); }
+
+// A file of `size` zero bytes that only allocates its last block.
+void make_sparse(const std::string& path, int64_t size) {
+  MzOsStream stream;
+  uint8_t zero = 0;
+  if (mz_stream_open(stream, path.c_str(), MZ_OPEN_MODE_WRITE | MZ_OPEN_MODE_CREATE) != MZ_OK ||
+      mz_stream_seek(stream, size - 1, MZ_SEEK_SET) != MZ_OK ||
+      mz_stream_write(stream, &zero, 1) != 1) {
+    throw ZipException(MZ_WRITE_ERROR, "creating sparse input failed");
+  }
+  mz_stream_close(stream);
+}
+
+#define CHECK(cond, ...)                                      \
+  do {                                                        \
+    if (!(cond)) {                                            \
+      fprintf(stderr, "FAILED %s: %s\n", #cond,               \
+              fmt::format(__VA_ARGS__).c_str());              \
+      return false;                                           \
+    }                                                         \
+  } while (0)
+
+bool verify(const std::string& zipfile, int entries, int64_t huge_size, int filler) {
+  ZipReader r;
+  ReaderOptions options;
+  options.max_read_size = 64 * 1024 * 1024;
+  r.open(zipfile, "", options);
+  size_t expected = (size_t)entries + 1 + filler + 1;
+  CHECK(r.count() == expected, "{} entries, expected {}", r.count(), expected);
+
+  for (int i : {0, entries / 2, entries - 1}) {
+    std::string name = fmt::format("small/{:06}.txt", i);
+    std::string data;
+    CHECK(r.readFile(name, data) && data == small_content(i), "{}", name);
+  }
+
+  const ZipEntry& huge = r.item(entries);
+  CHECK(huge.name == "huge.bin" && huge.uncompressed_size == huge_size, "huge entry is {} of {} bytes",
+        huge.name, huge.uncompressed_size);
+  bool refused = false;
+  try {
+    std::string data;
+    r.readFile("huge.bin", data);
+  } catch (const ZipException&) {
+    refused = true;
+  }
+  CHECK(refused, "readFile held {} bytes over the read limit", huge_size);
+
+  int64_t total = 0;
+  bool zeros = true;
+  r.readEntry("huge.bin", [&](const char* data, int32_t len) {
+    for (int32_t i = 0; i < len && zeros; ++i) {
+      zeros = data[i] == 0;
+    }
+    total += len;
+    return true;
+  });
+  CHECK(total == huge_size && zeros, "streamed {} bytes, zeros: {}", total, zeros);
+
+  const ZipEntry& last = r.item(expected - 1);
+  std::string data;
+  CHECK(r.readFile(last.name, data) && data == "last\n", "{}", last.name);
+  if (filler > 0) {
+    CHECK(last.disk_offset > 4 * GiB, "last entry at offset {}", last.disk_offset);
+  }
+  r.close();
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string work = "mzip-large";
+  int entries = 70000;
+  int64_t huge_gib = 5;
+  bool offsets = false;
+  WriterOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    std::string value = i + 1 < argc ? argv[i + 1] : "";
+    if (arg == "--offsets") {
+      offsets = true;
+      continue;
+    }
+    if (arg == "--dir" && !value.empty()) {
+      work = value;
+    } else if (arg == "--entries" && !value.empty()) {
+      entries = std::max(1, atoi(value.c_str()));
+    } else if (arg == "--huge-gib" && !value.empty()) {
+      huge_gib = std::max(1, atoi(value.c_str()));
+    } else if (arg == "--zip64" && (value == "auto" || value == "force")) {
+      options.zip64 = value == "force" ? Zip64Mode::kForce : Zip64Mode::kAuto;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--dir work_dir] [--entries n] [--huge-gib n] [--zip64 auto|force] "
+              "[--offsets]\n",
+              argv[0]);
+      return 1;
+    }
+    ++i;
+  }
+
+  fs_util::make_dirs(work);
+  std::string zipfile = fs_util::join(work, "large.zip");
+  std::string huge_input = fs_util::join(work, "huge.bin");
+  int64_t huge_size = huge_gib * GiB;
+  // 64 MiB blocks of random bytes; deflate can not shrink them.
+  const size_t kFillerSize = 64 * 1024 * 1024;
+  int filler = offsets ? (int)((4 * GiB + 100 * 1024 * 1024) / kFillerSize) : 0;
+
+  try {
+    make_sparse(huge_input, huge_size);
+
+    ZipWriter w;
+    if (!w.create(zipfile, "", options)) {
+      fprintf(stderr, "creating %s failed\n", zipfile.c_str());
+      return 1;
+    }
+    fprintf(stderr, "writing %d small entries\n", entries);
+    for (int i = 0; i < entries; ++i) {
+      std::string content = small_content(i);
+      FileInfo info{&content[0], content.size(), ""};
+      w.addBuffer(fmt::format("small/{:06}.txt", i), info);
+    }
+    fprintf(stderr, "writing a %lld GiB entry\n", (long long)huge_gib);
+    w.addFile(huge_input, "huge.bin");
+    if (filler > 0) {
+      fprintf(stderr, "writing %d incompressible entries\n", filler);
+      std::vector<uint32_t> random(kFillerSize / sizeof(uint32_t));
+      std::mt19937 rng(7);
+      for (auto& v : random) {
+        v = rng();
+      }
+      for (int i = 0; i < filler; ++i) {
+        FileInfo info{random.data(), kFillerSize, ""};
+        w.addBuffer(fmt::format("filler/{:03}.bin", i), info);
+      }
+    }
+    std::string last = "last\n";
+    w.addBuffer("last.txt", FileInfo{&last[0], last.size(), ""});
+    w.close();
+    remove(huge_input.c_str());
+
+    fprintf(stderr, "verifying\n");
+    if (!verify(zipfile, entries, huge_size, filler)) {
+      return 1;
+    }
+  } catch (const std::exception& e) {
+    fprintf(stderr, "failed: %s\n", e.what());
+    return 1;
+  }
+  remove(zipfile.c_str());
+  fprintf(stderr, "ok\n");
+  return 0;
+}
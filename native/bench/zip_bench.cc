@@ -0,0 +1,242 @@
+// Native benchmark for the reader and writer hot paths, independent of Node.
+//
+//   mzip_bench [--dir work_dir] [--out result.json] [--scale n] [--repeat n]
+//
+// Synthetic archives are generated under work_dir and every scenario prints
+// one JSON object per metric so runs can be diffed for regressions.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "fs_util.h"
+#include "zip_reader.h"
+#include "zip_writer.h"
+
+using namespace ziputil;
+
+namespace {
+
+struct Scenario {
+  std::string name;
+  int files;
+  size_t min_size;
+  size_t max_size;
+  bool text;
+  std::string password;
+};
+
+struct Result {
+  std::string scenario;
+  std::string metric;
+  double value;
+  std::string unit;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point t0) {
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// Median wall time of `repeat` runs of fn, in seconds.
+double measure(int repeat, const std::function<void()>& fn) {
+  std::vector<double> samples;
+  for (int i = 0; i < repeat; ++i) {
+    auto t0 = Clock::now();
+    fn();
+    samples.push_back(seconds_since(t0));
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+std::string make_content(std::mt19937& rng, size_t size, bool text) {
+  static const char* words[] = {"zip",   "entry",  "module", "require", "export",
+                                "const", "return", "value",  "buffer",  "locale",
+                                "{",     "}",      "\n",     "  ",      "function"};
+  std::string s;
+  s.reserve(size);
+  if (text) {
+    std::uniform_int_distribution<size_t> pick(0, sizeof(words) / sizeof(words[0]) - 1);
+    while (s.size() < size) {
+      s += words[pick(rng)];
+      s += ' ';
+    }
+    s.resize(size);
+  } else {
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (size_t i = 0; i < size; ++i) {
+      s.push_back((char)byte(rng));
+    }
+  }
+  return s;
+}
+
+// Writes the scenario's input tree and returns the relative file names.
+std::vector<std::string> generate_tree(const Scenario& sc, const std::string& dir) {
+  std::mt19937 rng(0x5eed);
+  std::uniform_int_distribution<size_t> size(sc.min_size, sc.max_size);
+  std::vector<std::string> names;
+  for (int i = 0; i < sc.files; ++i) {
+    std::string rel = fmt::format("d{}/f{}.{}", i % 32, i, sc.text ? "txt" : "bin");
+    std::string path = fs_util::join(dir, rel);
+    fs_util::make_dirs(fs_util::dirname(path));
+    std::ofstream out(path, std::ios::binary);
+    auto content = make_content(rng, size(rng), sc.text);
+    out.write(content.data(), content.size());
+    names.push_back(rel);
+  }
+  return names;
+}
+
+void run(const Scenario& sc, const std::string& work, int repeat, std::vector<Result>& results) {
+  std::string src = fs_util::join(work, "src", sc.name);
+  std::string zipfile = fs_util::join(work, sc.name + ".zip");
+  auto names = generate_tree(sc, src);
+
+  double input_bytes = 0;
+  for (auto& n : names) {
+    std::ifstream in(fs_util::join(src, n), std::ios::binary | std::ios::ate);
+    input_bytes += (double)in.tellg();
+  }
+  double mb = input_bytes / (1024.0 * 1024.0);
+  auto add = [&](const std::string& metric, double value, const std::string& unit) {
+    results.push_back(Result{sc.name, metric, value, unit});
+  };
+
+  double t = measure(repeat, [&]() {
+    ZipWriter w;
+    if (!w.create(zipfile, sc.password)) {
+      throw ZipException(MZ_OPEN_ERROR, "create failed");
+    }
+    w.addDir(src, src);
+    w.close();
+  });
+  add("add_dir_mbps", mb / t, "MB/s");
+
+  t = measure(repeat, [&]() {
+    ZipReader r;
+    r.open(zipfile, sc.password);
+  });
+  add("open_ms", t * 1000, "ms");
+
+  ZipReader reader;
+  reader.open(zipfile, sc.password);
+
+  t = measure(repeat, [&]() {
+    for (auto& n : names) {
+      reader.exists(n);
+    }
+  });
+  add("exists_ns", t * 1e9 / names.size(), "ns/op");
+
+  t = measure(repeat, [&]() {
+    std::string data;
+    for (auto& n : names) {
+      reader.readFile(n, data);
+    }
+  });
+  add("read_file_mbps", mb / t, "MB/s");
+  add("read_file_us", t * 1e6 / names.size(), "us/op");
+
+  if (!sc.password.empty()) {
+    // A fresh reader derives every entry key again (open included); the
+    // loop above reads with the keys its reader already cached.
+    t = measure(repeat, [&]() {
+      ZipReader cold;
+      cold.open(zipfile, sc.password);
+      std::string data;
+      for (auto& n : names) {
+        cold.readFile(n, data);
+      }
+    });
+    add("read_file_cold_us", t * 1e6 / names.size(), "us/op");
+  }
+
+  int run_id = 0;
+  t = measure(repeat, [&]() {
+    reader.extractAll(fs_util::join(work, "out", sc.name, std::to_string(run_id++)));
+  });
+  add("extract_all_mbps", mb / t, "MB/s");
+}
+
+std::string json_escape(const std::string& s) {
+  std::string r;
+  for (char c : s) {
+    if (c == '"' || c == '\\') r += '\\';
+    r += c;
+  }
+  return r;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string work = "mzip-bench";
+  std::string out;
+  int scale = 1;
+  int repeat = 3;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--dir") {
+      work = argv[i + 1];
+    } else if (arg == "--out") {
+      out = argv[i + 1];
+    } else if (arg == "--scale") {
+      scale = std::max(1, atoi(argv[i + 1]));
+    } else if (arg == "--repeat") {
+      repeat = std::max(1, atoi(argv[i + 1]));
+    } else {
+      fprintf(stderr, "usage: %s [--dir work_dir] [--out result.json] [--scale n] [--repeat n]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  const size_t MB = 1024 * 1024;
+  std::vector<Scenario> scenarios = {
+      {"tiny-text", 5000 * scale, 64, 4096, true, ""},
+      {"tiny-text-aes", 5000 * scale, 64, 4096, true, "bench"},
+      {"tiny-random", 5000 * scale, 64, 4096, false, ""},
+      {"huge-text", 4, 16 * MB * scale, 16 * MB * scale, true, ""},
+      {"huge-text-aes", 4, 16 * MB * scale, 16 * MB * scale, true, "bench"},
+      {"huge-random", 4, 16 * MB * scale, 16 * MB * scale, false, ""},
+  };
+
+  std::vector<Result> results;
+  for (auto& sc : scenarios) {
+    fprintf(stderr, "running %s\n", sc.name.c_str());
+    try {
+      run(sc, work, repeat, results);
+    } catch (const std::exception& e) {
+      fprintf(stderr, "%s failed: %s\n", sc.name.c_str(), e.what());
+      return 1;
+    }
+  }
+
+  std::string json = "[\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    auto& r = results[i];
+    json += fmt::format("  {{\"scenario\": \"{}\", \"metric\": \"{}\", \"value\": {:.3f}, \"unit\": \"{}\"}}{}\n",
+                        json_escape(r.scenario), r.metric, r.value, r.unit,
+                        i + 1 < results.size() ? "," : "");
+  }
+  json += "]\n";
+
+  if (out.empty()) {
+    fputs(json.c_str(), stdout);
+  } else {
+    std::ofstream(out) << json;
+  }
+  return 0;
+}
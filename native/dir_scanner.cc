@@ -0,0 +1,325 @@
+#include "dir_scanner.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "fs_util.h"
+#include "glob_matcher.h"
+#include "zip_common.h"
+
+namespace ziputil {
+
+namespace {
+
+// Directories kept open for their subdirectories to be opened relative to
+// them; past this, subdirectories are opened by path.
+const size_t kMaxHeldDirs = 256;
+// Without inode numbers to detect cycles, linked directories are followed
+// only this deep.
+const int kMaxLinkDepth = 64;
+
+#if !defined(_WIN32)
+class DirFd {
+ public:
+  DirFd(int fd, std::atomic<size_t>& open) : fd_(fd), open_(open) { ++open_; }
+  ~DirFd() {
+    ::close(fd_);
+    --open_;
+  }
+
+  DirFd(const DirFd&) = delete;
+  DirFd& operator=(const DirFd&) = delete;
+
+  int fd() const { return fd_; }
+
+ private:
+  int fd_;
+  std::atomic<size_t>& open_;
+};
+#endif
+
+struct Node;
+
+struct Child {
+  std::string name;
+  bool is_dir;
+  bool is_symlink;
+  bool listed;              /* passes the filters */
+  std::unique_ptr<Node> dir; /* for directories to descend into */
+};
+
+struct Node {
+  std::string path;
+  std::string rel;
+  std::string name;  /* in the parent, for openat */
+  const Node* parent = nullptr;
+  int depth = 0;
+  int link_depth = 0;  /* linked directories on the way here */
+  uint64_t dev = 0;
+  uint64_t ino = 0;
+#if !defined(_WIN32)
+  std::shared_ptr<DirFd> parent_fd;  /* null to open by path */
+#endif
+  std::vector<Child> children;
+};
+
+class Scanner {
+ public:
+  explicit Scanner(const ScanOptions& options)
+      : options_(options), matcher_(options.include, options.exclude) {}
+
+  void run(Node* root) {
+    stack_.push_back(root);
+    unsigned threads = std::max(1u, options_.threads);
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i) {
+      workers.emplace_back([this] { work(); });
+    }
+    work();
+    for (auto& t : workers) {
+      t.join();
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+ private:
+  void work() {
+    std::unique_lock<std::mutex> lock(mu_);
+    for (;;) {
+      cv_.wait(lock, [this] { return error_ || !stack_.empty() || active_ == 0; });
+      if (error_ || stack_.empty()) {
+        cv_.notify_all();
+        return;
+      }
+      Node* node = stack_.back();
+      stack_.pop_back();
+      ++active_;
+      lock.unlock();
+
+      std::exception_ptr error;
+      try {
+        scan(*node);
+      } catch (...) {
+        error = std::current_exception();
+      }
+
+      lock.lock();
+      --active_;
+      if (error && !error_) {
+        error_ = error;
+      }
+      // Last child on top: the walk stays close to depth first, which keeps
+      // few directories open.
+      for (auto it = node->children.rbegin(); it != node->children.rend(); ++it) {
+        if (it->dir) {
+          stack_.push_back(it->dir.get());
+        }
+      }
+      cv_.notify_all();
+    }
+  }
+
+  // Fills `node.children` and creates the nodes of the subdirectories.
+  void scan(Node& node);
+
+  // Adds a child, or leaves it out for the filters.
+  void addChild(Node& node, const char* name, bool is_dir, bool is_symlink) {
+    std::string rel = node.rel.empty() ? std::string(name) : node.rel + "/" + name;
+    std::string folded = GlobMatcher::fold(is_dir ? rel + "/" : rel);
+    if (is_dir && matcher_.excludesAll(folded)) {
+      return;
+    }
+    node.children.push_back(Child{name, is_dir, is_symlink, matcher_.matches(folded), nullptr});
+  }
+
+  bool skipName(const Node& node, const char* name) const {
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+      return true;
+    }
+    return node.depth == 0 && !options_.wildcard.empty() &&
+           mz_path_compare_wc(name, options_.wildcard.c_str(), 1) != MZ_OK;
+  }
+
+  // Sorts the children and creates a node for every subdirectory.
+  void finish(Node& node);
+
+  const ScanOptions& options_;
+  GlobMatcher matcher_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<Node*> stack_;
+  size_t active_ = 0;
+  std::exception_ptr error_;
+  std::atomic<size_t> open_dirs_{0};
+};
+
+#if !defined(_WIN32)
+void Scanner::scan(Node& node) {
+  int fd = node.parent_fd
+               ? ::openat(node.parent_fd->fd(), node.name.c_str(),
+                          O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+               : ::open(node.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  node.parent_fd.reset();
+  if (fd < 0) {
+    throw ZipException(MZ_EXIST_ERROR, "Error adding path to archive");
+  }
+  auto dir_fd = std::make_shared<DirFd>(fd, open_dirs_);
+  struct stat st;
+  if (fstat(fd, &st) == 0) {
+    node.dev = (uint64_t)st.st_dev;
+    node.ino = (uint64_t)st.st_ino;
+  }
+
+  // fdopendir owns the descriptor it is given; the original stays for
+  // the subdirectories.
+  int list_fd = dup(fd);
+  DIR* d = list_fd < 0 ? NULL : fdopendir(list_fd);
+  if (d == NULL) {
+    if (list_fd >= 0) {
+      ::close(list_fd);
+    }
+    throw ZipException(MZ_EXIST_ERROR, "Error adding path to archive");
+  }
+  struct dirent* entry = NULL;
+  while ((entry = readdir(d)) != NULL) {
+    const char* name = entry->d_name;
+    if (skipName(node, name)) {
+      continue;
+    }
+    bool is_dir = entry->d_type == DT_DIR;
+    bool is_symlink = entry->d_type == DT_LNK;
+    if (entry->d_type == DT_UNKNOWN) {
+      // Some filesystems (older XFS, some network ones) leave the type out.
+      if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        continue;  // gone since it was listed
+      }
+      is_dir = S_ISDIR(st.st_mode);
+      is_symlink = S_ISLNK(st.st_mode);
+    }
+    if (is_symlink) {
+      if (options_.symlinks == SymlinkPolicy::kSkip) {
+        continue;
+      }
+      if (options_.symlinks == SymlinkPolicy::kFollow) {
+        if (fstatat(fd, name, &st, 0) != 0) {
+          continue;  // dangling
+        }
+        is_dir = S_ISDIR(st.st_mode);
+        bool cycle = false;
+        for (const Node* n = &node; is_dir && n != nullptr && !cycle; n = n->parent) {
+          cycle = n->dev == (uint64_t)st.st_dev && n->ino == (uint64_t)st.st_ino;
+        }
+        if (cycle) {
+          continue;
+        }
+      }
+    }
+    if (is_dir && !options_.recursive) {
+      continue;
+    }
+    addChild(node, name, is_dir, is_symlink);
+  }
+  closedir(d);
+
+  finish(node);
+  if (open_dirs_ < kMaxHeldDirs) {
+    for (auto& c : node.children) {
+      if (c.dir) {
+        c.dir->parent_fd = dir_fd;
+      }
+    }
+  }
+}
+#else
+void Scanner::scan(Node& node) {
+  DIR* d = mz_os_open_dir(node.path.c_str());
+  if (d == NULL) {
+    throw ZipException(MZ_EXIST_ERROR, "Error adding path to archive");
+  }
+  struct dirent* entry = NULL;
+  while ((entry = mz_os_read_dir(d)) != NULL) {
+    const char* name = entry->d_name;
+    if (skipName(node, name)) {
+      continue;
+    }
+    std::string full_path = fs_util::join(node.path, name);
+    bool is_symlink = mz_os_is_symlink(full_path.c_str()) == MZ_OK;
+    bool is_dir = false;
+    if (is_symlink && options_.symlinks == SymlinkPolicy::kSkip) {
+      continue;
+    }
+    if (!is_symlink || options_.symlinks == SymlinkPolicy::kFollow) {
+      is_dir = mz_os_is_dir(full_path.c_str()) == MZ_OK;
+    }
+    if (is_dir && (!options_.recursive || (is_symlink && node.link_depth >= kMaxLinkDepth))) {
+      continue;
+    }
+    addChild(node, name, is_dir, is_symlink);
+  }
+  mz_os_close_dir(d);
+  finish(node);
+}
+#endif
+
+void Scanner::finish(Node& node) {
+  if (options_.order == ScanOrder::kName) {
+    std::sort(node.children.begin(), node.children.end(),
+              [](const Child& a, const Child& b) { return a.name < b.name; });
+  }
+  for (auto& c : node.children) {
+    if (!c.is_dir) {
+      continue;
+    }
+    c.dir.reset(new Node());
+    Node& sub = *c.dir;
+    sub.path = fs_util::join(node.path, c.name);
+    sub.rel = node.rel.empty() ? c.name : node.rel + "/" + c.name;
+    sub.name = c.name;
+    sub.parent = &node;
+    sub.depth = node.depth + 1;
+    sub.link_depth = node.link_depth + (c.is_symlink ? 1 : 0);
+  }
+}
+
+void flatten(const Node& node, std::vector<ScannedPath>& out) {
+  for (auto& c : node.children) {
+    if (c.listed) {
+      out.push_back(ScannedPath{fs_util::join(node.path, c.name),
+                                node.rel.empty() ? c.name : node.rel + "/" + c.name, c.is_dir,
+                                c.is_symlink});
+    }
+    if (c.dir) {
+      flatten(*c.dir, out);
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<ScannedPath> scan_dir(const std::string& dir, const ScanOptions& options) {
+  Node root;
+  root.path = dir;
+  Scanner scanner(options);
+  scanner.run(&root);
+  std::vector<ScannedPath> out;
+  flatten(root, out);
+  return out;
+}
+
+}  // namespace ziputil
@@ -0,0 +1,56 @@
+#ifndef DIR_SCANNER_H
+#define DIR_SCANNER_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace ziputil {
+
+enum class SymlinkPolicy {
+  kFollow,  /* add what links point to, descending into linked directories */
+  kSkip,    /* leave links out */
+  kStore,   /* add the links themselves, as link entries */
+};
+
+enum class ScanOrder {
+  kDirectory,  /* as the filesystem lists each directory */
+  kName,       /* by byte-wise name within each directory */
+};
+
+struct ScanOptions {
+  bool recursive = true;
+  SymlinkPolicy symlinks = SymlinkPolicy::kFollow;
+  ScanOrder order = ScanOrder::kDirectory;
+  // GlobMatcher patterns on paths relative to the scanned directory, with
+  // `/` separators and a trailing `/` for directories. An exclude ending
+  // in `*` that matches `dir/` prunes the directory without listing it.
+  std::vector<std::string> include;
+  std::vector<std::string> exclude;
+  // mz_path_compare_wc pattern for the names directly in the scanned
+  // directory, the `dir/*.md` form of addDir; empty for all.
+  std::string wildcard;
+  unsigned threads = 4;
+};
+
+struct ScannedPath {
+  std::string path;  /* the scanned directory joined with `rel` */
+  std::string rel;
+  bool is_dir;
+  bool is_symlink;
+};
+
+// Lists everything below `dir`, the directory itself left out, in a
+// depth-first order where a directory comes before its contents. The
+// listing runs on `threads` workers, each directory opened relative to
+// its parent and typed from readdir where the filesystem reports it; the
+// order does not depend on the threads. Under kFollow, links that lead
+// back into one of their ancestors and links to nothing are left out.
+// Throws ZipException when a directory can not be opened.
+std::vector<ScannedPath> scan_dir(const std::string& dir, const ScanOptions& options);
+
+}  // namespace ziputil
+#endif  // DIR_SCANNER_H
@@ -0,0 +1,32 @@
+#include "disposer.h"
+
+#include <limits>
+#include <thread>
+
+#include "blocking_queue.h"
+
+namespace api {
+
+void DisposeLater(std::function<void()> fn) {
+  // One detached thread for the lifetime of the process. The queue is never
+  // freed, so exit neither joins the thread nor pulls the queue from under it.
+  static auto* queue = [] {
+    auto* q = new ziputil::BlockingQueue<std::function<void()>>(
+        std::numeric_limits<size_t>::max());
+    std::thread([q]() {
+      std::function<void()> task;
+      while (q->pop(task)) {
+        try {
+          task();
+        } catch (...) {
+          // nobody is left to report to
+        }
+        task = nullptr;
+      }
+    }).detach();
+    return q;
+  }();
+  queue->push(std::move(fn));
+}
+
+}  // namespace api
@@ -0,0 +1,170 @@
+#ifndef DISPOSER_H
+#define DISPOSER_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include "stats.h"
+
+namespace api {
+
+// A native object shared by its JS wrapper and the operations the wrapper
+// queued, so it outlives a wrapper collected while work is in flight.
+// Every operation takes a ticket when it is queued and holds `mu` while it
+// runs; close and disposal first wait for the tickets handed out before
+// theirs, since the thread pool does not run work in queue order.
+template <typename T>
+struct Shared {
+  std::mutex mu;
+  std::unique_ptr<T> value;
+
+  // JS thread, when an operation is queued.
+  uint64_t enter() {
+    std::lock_guard<std::mutex> lock(tickets_mu_);
+    tickets_.insert(++last_);
+    return last_;
+  }
+
+  // Keeps the object alive for an operation that needs no `mu`, because it
+  // only reads what stays fixed after open; gives the ticket back at the end.
+  class Ticket {
+   public:
+    Ticket(Shared& shared, uint64_t ticket, bool after_earlier = false)
+        : shared_(shared), ticket_(after_earlier ? shared.waitEarlier(ticket) : ticket) {}
+    ~Ticket() { shared_.leave(ticket_); }
+
+    Ticket(const Ticket&) = delete;
+    Ticket& operator=(const Ticket&) = delete;
+
+    // Throws once the object was disposed.
+    T& get() {
+      if (!shared_.value) {
+        throw std::runtime_error("archive is closed");
+      }
+      return *shared_.value;
+    }
+
+   private:
+    Shared& shared_;
+    uint64_t ticket_;
+  };
+
+  // A ticket plus `mu`, held by an operation while it runs.
+  class Lock {
+   public:
+    Lock(Shared& shared, uint64_t ticket, stats::Op op, bool after_earlier = false)
+        : ticket_(shared, ticket, after_earlier), lock_(shared.mu, op) {}
+
+    T& get() { return ticket_.get(); }
+
+   private:
+    Ticket ticket_;
+    stats::TimedLock lock_;
+  };
+
+  // JS thread, when a flush or close is queued: the operations that fail
+  // before it hand their failure to it.
+  uint64_t enterFlush() {
+    uint64_t ticket = enter();
+    std::lock_guard<std::mutex> lock(tickets_mu_);
+    flush_ = ticket;
+    return ticket;
+  }
+  // JS thread, when a close is queued.
+  uint64_t enterClose() {
+    uint64_t ticket = enterFlush();
+    std::lock_guard<std::mutex> lock(tickets_mu_);
+    if (close_ == 0) {
+      close_ = ticket;
+    }
+    return ticket;
+  }
+  // Whether a close was queued before `ticket`. Work outside `mu` must not
+  // touch the object then, since the close may be running.
+  bool closedBefore(uint64_t ticket) {
+    std::lock_guard<std::mutex> lock(tickets_mu_);
+    return close_ != 0 && close_ < ticket;
+  }
+
+  // Failed operations report here, and flush or close hand the first one
+  // queued before them back to JS. A rejection JS received before any
+  // flush or close was called has been seen by whoever awaited it, and is
+  // dropped when it is delivered.
+  void fail(uint64_t ticket, const std::string& message) {
+    std::lock_guard<std::mutex> lock(tickets_mu_);
+    errors_.emplace(ticket, message);
+  }
+  // JS thread, when the rejection of operation `ticket` is delivered.
+  void delivered(uint64_t ticket) {
+    std::lock_guard<std::mutex> lock(tickets_mu_);
+    if (flush_ < ticket) {
+      errors_.erase(ticket);
+    }
+  }
+  std::string takeError(uint64_t ticket) {
+    std::lock_guard<std::mutex> lock(tickets_mu_);
+    std::string error;
+    auto end = errors_.lower_bound(ticket);
+    if (errors_.begin() != end) {
+      error = errors_.begin()->second;
+      errors_.erase(errors_.begin(), end);
+    }
+    return error;
+  }
+
+  // Frees the object once every queued operation is done.
+  void dispose() {
+    waitEarlier(std::numeric_limits<uint64_t>::max());
+    std::lock_guard<std::mutex> lock(mu);
+    value.reset();
+  }
+
+ private:
+  uint64_t waitEarlier(uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(tickets_mu_);
+    done_.wait(lock, [&] { return tickets_.empty() || *tickets_.begin() >= ticket; });
+    return ticket;
+  }
+
+  void leave(uint64_t ticket) {
+    std::lock_guard<std::mutex> lock(tickets_mu_);
+    tickets_.erase(ticket);
+    done_.notify_all();
+  }
+
+  std::mutex tickets_mu_;
+  std::condition_variable done_;
+  std::set<uint64_t> tickets_;
+  uint64_t last_ = 0;
+  uint64_t flush_ = 0;  /* ticket of the last flush or close queued */
+  uint64_t close_ = 0;  /* ticket of the first close queued */
+  std::map<uint64_t, std::string> errors_;
+};
+
+// Runs `fn` on a background thread, after everything handed over earlier.
+void DisposeLater(std::function<void()> fn);
+
+// Used by finalizers: closes and frees the object off the JS thread.
+// Destructors close what is still open.
+template <typename T>
+void DisposeLater(std::shared_ptr<Shared<T>> state) {
+  if (!state) {
+    return;
+  }
+  DisposeLater([state]() { state->dispose(); });
+}
+
+}  // namespace api
+
+#endif  // DISPOSER_H
@@ -0,0 +1,329 @@
+#include "extract_pipeline.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <zlib.h>
+
+#include "blocking_queue.h"
+#include "file_sink.h"
+#include "stats.h"
+
+namespace ziputil {
+
+namespace {
+
+// Distance the read-ahead hint runs in front of the reader.
+const int64_t kReadAheadWindow = 16 * 1024 * 1024;
+
+struct RawItem {
+  const ZipEntry* entry;
+  std::string path;
+  std::vector<uint8_t> payload;
+  size_t reserved;
+};
+
+struct OutItem {
+  const ZipEntry* entry;
+  std::string path;
+  std::vector<uint8_t> data;
+  size_t reserved;
+};
+
+std::vector<uint8_t> decode(const ZipEntry& entry, std::vector<uint8_t> payload) {
+  std::vector<uint8_t> data;
+  if (entry.compression_method == MZ_COMPRESS_METHOD_STORE) {
+    data = std::move(payload);
+  } else {
+    data.resize((size_t)entry.uncompressed_size);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+      throw ZipException(MZ_MEM_ERROR, "inflate init failed");
+    }
+    // An empty entry has no output buffer, which inflate refuses; it gets
+    // a spare byte that a valid empty stream leaves untouched.
+    uint8_t spare = 0;
+    zs.next_in = payload.data();
+    zs.avail_in = (uInt)payload.size();
+    zs.next_out = data.empty() ? &spare : data.data();
+    zs.avail_out = data.empty() ? 1 : (uInt)data.size();
+    int ret = inflate(&zs, Z_FINISH);
+    uLong total = zs.total_out;
+    inflateEnd(&zs);
+    if (ret != Z_STREAM_END || total != data.size()) {
+      throw ZipException(MZ_DATA_ERROR, "inflate failed: " + entry.name);
+    }
+  }
+
+  if (data.size() != (size_t)entry.uncompressed_size) {
+    throw ZipException(MZ_DATA_ERROR, "size mismatch: " + entry.name);
+  }
+  if ((uint32_t)crc32(0, data.data(), (uInt)data.size()) != entry.crc) {
+    throw ZipException(MZ_CRC_ERROR, "crc mismatch: " + entry.name);
+  }
+  return data;
+}
+
+}  // namespace
+
+// Positional reads on the archive, independent of the minizip reader handle.
+class ExtractPipeline::ArchiveFile {
+ public:
+  explicit ArchiveFile(const std::string& path) {
+#if defined(_WIN32)
+    if (mz_stream_open(stream_, path.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+      throw ZipException(MZ_OPEN_ERROR, "opening archive failed");
+    }
+#else
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+      throw ZipException(MZ_OPEN_ERROR, "opening archive failed");
+    }
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+  }
+
+  ~ArchiveFile() {
+#if !defined(_WIN32)
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+#endif
+  }
+
+  // Asks the kernel to start reading [offset, offset + len) in the background.
+  void willNeed(int64_t offset, int64_t len) {
+#if defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fd_, offset, len, POSIX_FADV_WILLNEED);
+#else
+    (void)offset;
+    (void)len;
+#endif
+  }
+
+  void read(int64_t offset, void* buf, size_t len) {
+    uint8_t* p = static_cast<uint8_t*>(buf);
+#if defined(_WIN32)
+    if (mz_stream_seek(stream_, offset, MZ_SEEK_SET) != MZ_OK) {
+      throw ZipException(MZ_SEEK_ERROR, "seek archive failed");
+    }
+    while (len > 0) {
+      int32_t n = mz_stream_read(stream_, p, (int32_t)std::min<size_t>(len, INT32_MAX));
+      if (n <= 0) {
+        throw ZipException(MZ_READ_ERROR, "read archive failed");
+      }
+      p += n;
+      len -= n;
+    }
+#else
+    while (len > 0) {
+      ssize_t n = ::pread(fd_, p, len, (off_t)offset);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        throw ZipException(MZ_READ_ERROR, "read archive failed");
+      }
+      p += n;
+      offset += n;
+      len -= n;
+    }
+#endif
+  }
+
+ private:
+#if defined(_WIN32)
+  MzOsStream stream_;
+#else
+  int fd_ = -1;
+#endif
+};
+
+ExtractPipeline::ExtractPipeline(const std::string& archive, const PipelineOptions& options)
+    : file_(new ArchiveFile(archive)), options_(options) {
+  options_.threads = std::max(1u, options_.threads);
+}
+
+ExtractPipeline::~ExtractPipeline() = default;
+
+bool ExtractPipeline::supports(const ZipEntry& entry) const {
+  return !entry.is_encrypted && !entry.is_directory && !entry.is_symlink &&
+         entry.disk_offset >= 0 && entry.uncompressed_size <= options_.max_entry_size &&
+         (entry.compression_method == MZ_COMPRESS_METHOD_STORE ||
+          entry.compression_method == MZ_COMPRESS_METHOD_DEFLATE);
+}
+
+bool ExtractPipeline::aligned(const ZipEntry& entry) {
+  uint8_t magic[4];
+  try {
+    file_->read(entry.disk_offset, magic, sizeof(magic));
+  } catch (const ZipException&) {
+    return false;
+  }
+  return read_u32(magic) == kLocalHeaderMagic;
+}
+
+size_t ExtractPipeline::run(std::vector<ExtractJob> jobs) {
+  std::sort(jobs.begin(), jobs.end(), [](const ExtractJob& a, const ExtractJob& b) {
+    return a.entry->disk_offset < b.entry->disk_offset;
+  });
+
+  BlockingQueue<RawItem> raw(options_.threads * 2);
+  BlockingQueue<OutItem> out(options_.threads * 2);
+  ByteBudget budget(options_.max_inflight);
+
+  std::mutex error_mu;
+  std::exception_ptr error;
+  std::atomic<bool> failed(false);
+  auto fail = [&](std::exception_ptr e) {
+    {
+      std::lock_guard<std::mutex> lock(error_mu);
+      if (!error) {
+        error = e;
+      }
+    }
+    failed = true;
+    raw.close();
+    out.close();
+    budget.abort();
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < options_.threads; ++i) {
+    workers.emplace_back([&] {
+      RawItem item;
+      while (raw.pop(item)) {
+        if (failed) {
+          continue;
+        }
+        try {
+          size_t payload_size = item.payload.size();
+          OutItem result{item.entry, std::move(item.path),
+                         decode(*item.entry, std::move(item.payload)), item.reserved};
+          // Stored payloads became the output buffer and stay reserved.
+          if (item.entry->compression_method != MZ_COMPRESS_METHOD_STORE) {
+            budget.release(payload_size);
+            result.reserved -= payload_size;
+          }
+          out.push(std::move(result));
+        } catch (...) {
+          fail(std::current_exception());
+        }
+      }
+    });
+  }
+
+  size_t written = 0;
+  std::unique_ptr<FileSink> sink = FileSink::create(options_.io_uring, options_.sparse);
+  std::thread writer([&] {
+    // Files handed to the sink but not yet flushed, and their reservations.
+    std::vector<const ZipEntry*> held;
+    size_t held_reserved = 0;
+    auto flush = [&] {
+      if (held.empty()) {
+        return;
+      }
+      sink->flush();
+      for (auto* entry : held) {
+        stats::add_bytes(stats::Op::kExtractAll, entry->compressed_size,
+                         entry->uncompressed_size);
+      }
+      written += held.size();
+      held.clear();
+      budget.release(held_reserved);
+      held_reserved = 0;
+    };
+
+    try {
+      OutItem item;
+      for (;;) {
+        // Flush a partial batch before waiting, so held buffers never stall
+        // the reader on the byte budget.
+        if (!out.try_pop(item)) {
+          flush();
+          if (!out.pop(item)) {
+            break;
+          }
+        }
+        if (failed) {
+          continue;
+        }
+        held.push_back(item.entry);
+        held_reserved += item.reserved;
+        sink->add(OutputFile{item.entry, std::move(item.path), std::move(item.data)});
+        if (sink->full()) {
+          flush();
+        }
+      }
+      if (!failed) {
+        flush();
+      }
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  });
+
+  try {
+    int64_t advised_to = 0;
+    for (auto& job : jobs) {
+      if (failed) {
+        break;
+      }
+      const ZipEntry& entry = *job.entry;
+      if (entry.disk_offset + kReadAheadWindow / 2 > advised_to) {
+        file_->willNeed(entry.disk_offset, kReadAheadWindow);
+        advised_to = entry.disk_offset + kReadAheadWindow;
+      }
+
+      uint8_t header[kLocalHeaderSize];
+      file_->read(entry.disk_offset, header, sizeof(header));
+      if (read_u32(header) != kLocalHeaderMagic) {
+        throw ZipException(MZ_FORMAT_ERROR, "invalid local header: " + entry.name);
+      }
+      int64_t data_offset = entry.disk_offset + kLocalHeaderSize + read_u16(header + 26) +
+                            read_u16(header + 28);
+
+      size_t reserved = (size_t)entry.compressed_size;
+      if (entry.compression_method != MZ_COMPRESS_METHOD_STORE) {
+        reserved += (size_t)entry.uncompressed_size;
+      }
+      budget.acquire(reserved);
+      RawItem item{&entry, job.path, std::vector<uint8_t>((size_t)entry.compressed_size),
+                   reserved};
+      file_->read(data_offset, item.payload.data(), item.payload.size());
+      if (!raw.push(std::move(item))) {
+        break;
+      }
+    }
+  } catch (...) {
+    fail(std::current_exception());
+  }
+
+  raw.close();
+  for (auto& t : workers) {
+    t.join();
+  }
+  out.close();
+  writer.join();
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return written;
+}
+
+}  // namespace ziputil
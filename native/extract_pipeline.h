@@ -0,0 +1,58 @@
+#ifndef EXTRACT_PIPELINE_H
+#define EXTRACT_PIPELINE_H
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zip_reader.h"
+
+namespace ziputil {
+
+struct ExtractJob {
+  const ZipEntry* entry;
+  std::string path;
+};
+
+struct PipelineOptions {
+  unsigned threads = 4;                       /* inflate workers */
+  size_t max_inflight = 256 * 1024 * 1024;    /* compressed + inflated bytes buffered */
+  int64_t max_entry_size = 64 * 1024 * 1024;  /* larger entries are not pipelined */
+  bool io_uring = true;                       /* batch output when built with MZIP_IO_URING */
+  bool sparse = false;                        /* leave zero blocks as holes */
+};
+
+// Three-stage extraction: the calling thread reads compressed payloads in
+// local header order with read-ahead hints, workers inflate and check the
+// CRC, and one writer thread saves files from a bounded queue through a
+// FileSink. Reads, CPU and writes overlap instead of alternating per entry.
+class ExtractPipeline {
+ public:
+  ExtractPipeline(const std::string& archive, const PipelineOptions& options);
+  ~ExtractPipeline();
+
+  ExtractPipeline(const ExtractPipeline&) = delete;
+  ExtractPipeline& operator=(const ExtractPipeline&) = delete;
+
+  // Entries the pipeline can decode itself: unencrypted regular files,
+  // stored or deflated, not larger than max_entry_size.
+  bool supports(const ZipEntry& entry) const;
+  // False when the entry's local header is not at its recorded offset, e.g.
+  // for self-extracting archives with a prepended stub.
+  bool aligned(const ZipEntry& entry);
+
+  // Extracts every job into its path; the parent directories must exist.
+  // Returns the number of files written, throws ZipException on failure.
+  size_t run(std::vector<ExtractJob> jobs);
+
+ private:
+  class ArchiveFile;
+
+  std::unique_ptr<ArchiveFile> file_;
+  PipelineOptions options_;
+};
+
+}  // namespace ziputil
+#endif  // EXTRACT_PIPELINE_H
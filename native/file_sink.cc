@@ -0,0 +1,292 @@
+#include "file_sink.h"
+
+#include <algorithm>
+
+#if defined(MZIP_HAVE_IO_URING)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <liburing.h>
+#endif
+
+#include "file_writer.h"
+
+namespace ziputil {
+
+namespace {
+
+uint32_t targetAttribs(const ZipEntry& entry, bool* ok) {
+  uint32_t target_attrib = 0;
+  *ok = mz_zip_attrib_convert(MZ_HOST_SYSTEM(entry.version_madeby), entry.external_fa,
+                              MZ_VERSION_MADEBY_HOST_SYSTEM, &target_attrib) == MZ_OK;
+  return target_attrib;
+}
+
+void setDates(const OutputFile& file) {
+  const ZipEntry& entry = *file.entry;
+  mz_os_set_file_date(file.path.c_str(), entry.modified_date, entry.accessed_date,
+                      entry.creation_date);
+}
+
+// One open/write/close per file, preallocated and optionally sparse.
+class WriterFileSink final : public FileSink {
+ public:
+  explicit WriterFileSink(bool sparse) : sparse_(sparse) {}
+
+  void add(OutputFile file) override {
+    FileWriter writer(file.path, (int64_t)file.data.size(), sparse_);
+    writer.write(file.data.data(), file.data.size());
+    writer.close();
+
+    setDates(file);
+    bool ok = false;
+    uint32_t target_attrib = targetAttribs(*file.entry, &ok);
+    if (ok) {
+      mz_os_set_file_attribs(file.path.c_str(), target_attrib);
+    }
+  }
+
+  void flush() override {}
+  bool full() const override { return true; }
+
+ private:
+  bool sparse_;
+};
+
+#if defined(MZIP_HAVE_IO_URING)
+
+const unsigned kQueueDepth = 256;
+const size_t kBatchFiles = 128;
+const size_t kBatchBytes = 16 * 1024 * 1024;
+const size_t kMaxWrite = 1u << 30;
+
+enum UringOp : uint64_t { kOpenOp = 0, kWriteOp = 1, kCloseOp = 2 };
+
+uint64_t tag(UringOp op, size_t index) { return ((uint64_t)index << 2) | op; }
+
+// Batches the open, write and close of many small files into a few
+// io_uring submissions: all opens of a batch first, then each file's writes
+// linked to its close. Dates and attributes are still set with one utimes
+// and one chmod per file; an existing file keeps its mode through O_TRUNC.
+class UringFileSink final : public FileSink {
+ public:
+  static std::unique_ptr<FileSink> create() {
+    std::unique_ptr<UringFileSink> sink(new UringFileSink());
+    // ENOSYS on old kernels, EPERM under seccomp or io_uring_disabled.
+    if (io_uring_queue_init(kQueueDepth, &sink->ring_, 0) < 0) {
+      return nullptr;
+    }
+    sink->ring_init_ = true;
+    return std::move(sink);
+  }
+
+  ~UringFileSink() override {
+    if (ring_init_) {
+      io_uring_queue_exit(&ring_);
+    }
+  }
+
+  void add(OutputFile file) override {
+    bytes_ += file.data.size();
+    files_.push_back(std::move(file));
+  }
+
+  bool full() const override { return files_.size() >= kBatchFiles || bytes_ >= kBatchBytes; }
+
+  void flush() override {
+    if (files_.empty()) {
+      return;
+    }
+    size_t n = files_.size();
+    fds_.assign(n, -1);
+    written_.assign(n, 0);
+    std::vector<mode_t> modes(n);
+    std::vector<bool> has_mode(n);
+    error_ = 0;
+    error_index_ = 0;
+
+    try {
+      for (size_t i = 0; i < n; ++i) {
+        bool ok = false;
+        uint32_t target_attrib = targetAttribs(*files_[i].entry, &ok);
+        modes[i] = ok ? (mode_t)(target_attrib & 07777) : 0666;
+        has_mode[i] = ok;
+        io_uring_sqe* sqe = reserve(1);
+        io_uring_prep_openat(sqe, AT_FDCWD, files_[i].path.c_str(),
+                             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, modes[i]);
+        sqe->user_data = tag(kOpenOp, i);
+      }
+      reap(0);
+
+      for (size_t i = 0; i < n; ++i) {
+        if (fds_[i] < 0) {
+          continue;
+        }
+        const auto& data = files_[i].data;
+        unsigned chunks = (unsigned)((data.size() + kMaxWrite - 1) / kMaxWrite);
+        io_uring_sqe* sqe = reserve(chunks + 1);
+        for (size_t off = 0; off < data.size(); off += kMaxWrite) {
+          io_uring_prep_write(sqe, fds_[i], data.data() + off,
+                              (unsigned)std::min(kMaxWrite, data.size() - off), off);
+          sqe->flags |= IOSQE_IO_LINK;
+          sqe->user_data = tag(kWriteOp, i);
+          sqe = io_uring_get_sqe(&ring_);
+          ++inflight_;
+        }
+        io_uring_prep_close(sqe, fds_[i]);
+        sqe->user_data = tag(kCloseOp, i);
+      }
+      reap(0);
+    } catch (...) {
+      closeAll();
+      files_.clear();
+      bytes_ = 0;
+      throw;
+    }
+    closeAll();
+
+    for (size_t i = 0; i < n && error_ == 0; ++i) {
+      if (written_[i] != files_[i].data.size()) {
+        error_ = EIO;
+        error_index_ = i;
+        break;
+      }
+      setDates(files_[i]);
+      if (has_mode[i]) {
+        mz_os_set_file_attribs(files_[i].path.c_str(), modes[i]);
+      }
+    }
+
+    std::string failed = error_ ? files_[error_index_].path : std::string();
+    files_.clear();
+    bytes_ = 0;
+    if (!failed.empty()) {
+      throw ZipException(MZ_WRITE_ERROR, "write output file failed: " + failed);
+    }
+  }
+
+ private:
+  UringFileSink() = default;
+
+  // Returns the first of `count` consecutive SQEs, submitting queued ones
+  // first when the ring is short, so a linked chain never spans submissions.
+  io_uring_sqe* reserve(unsigned count) {
+    if (io_uring_sq_space_left(&ring_) < count) {
+      submit();
+    }
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+    if (!sqe) {
+      throw ZipException(MZ_INTERNAL_ERROR, "io_uring queue full");
+    }
+    ++inflight_;
+    return sqe;
+  }
+
+  void submit() {
+    int ret = io_uring_submit(&ring_);
+    if (ret < 0) {
+      throw ZipException(MZ_WRITE_ERROR, "io_uring submit failed");
+    }
+    // Keep completions well below the CQ ring size.
+    if (inflight_ > kQueueDepth) {
+      wait(kQueueDepth / 2);
+    }
+  }
+
+  // Submits everything queued and waits until at most `target` remain.
+  void reap(size_t target) {
+    submit();
+    wait(target);
+  }
+
+  void wait(size_t target) {
+    while (inflight_ > target) {
+      io_uring_cqe* cqe = nullptr;
+      int ret = io_uring_wait_cqe(&ring_, &cqe);
+      if (ret == -EINTR) {
+        continue;
+      }
+      if (ret < 0) {
+        throw ZipException(MZ_WRITE_ERROR, "io_uring wait failed");
+      }
+      complete((UringOp)(cqe->user_data & 3), (size_t)(cqe->user_data >> 2), cqe->res);
+      io_uring_cqe_seen(&ring_, cqe);
+      --inflight_;
+    }
+  }
+
+  void complete(UringOp op, size_t i, int res) {
+    switch (op) {
+      case kOpenOp:
+        if (res >= 0) {
+          fds_[i] = res;
+        } else {
+          fail(i, -res);
+        }
+        break;
+      case kWriteOp:
+        if (res >= 0) {
+          written_[i] += res;
+        } else if (res != -ECANCELED) {
+          fail(i, -res);
+        }
+        break;
+      case kCloseOp:
+        // A short or failed write cancels the rest of the chain.
+        if (res == -ECANCELED) {
+          ::close(fds_[i]);
+        } else if (res < 0) {
+          fail(i, -res);
+        }
+        fds_[i] = -1;
+        break;
+    }
+  }
+
+  void fail(size_t i, int err) {
+    if (error_ == 0) {
+      error_ = err;
+      error_index_ = i;
+    }
+  }
+
+  void closeAll() {
+    for (auto& fd : fds_) {
+      if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+  }
+
+  io_uring ring_;
+  bool ring_init_ = false;
+  size_t inflight_ = 0;
+  std::vector<OutputFile> files_;
+  size_t bytes_ = 0;
+  std::vector<int> fds_;
+  std::vector<uint64_t> written_;
+  int error_ = 0;
+  size_t error_index_ = 0;
+};
+
+#endif  // MZIP_HAVE_IO_URING
+
+}  // namespace
+
+std::unique_ptr<FileSink> FileSink::create(bool use_io_uring, bool sparse) {
+#if defined(MZIP_HAVE_IO_URING)
+  if (use_io_uring && !sparse) {
+    auto sink = UringFileSink::create();
+    if (sink) {
+      return sink;
+    }
+  }
+#else
+  (void)use_io_uring;
+#endif
+  return std::unique_ptr<FileSink>(new WriterFileSink(sparse));
+}
+
+}  // namespace ziputil
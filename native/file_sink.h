@@ -0,0 +1,38 @@
+#ifndef FILE_SINK_H
+#define FILE_SINK_H
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zip_reader.h"
+
+namespace ziputil {
+
+struct OutputFile {
+  const ZipEntry* entry; /* dates and attributes to apply */
+  std::string path;
+  std::vector<uint8_t> data;
+};
+
+// Destination of extracted files. add() may hold the file until flush();
+// both throw ZipException when a write fails.
+class FileSink {
+ public:
+  virtual ~FileSink() = default;
+
+  virtual void add(OutputFile file) = 0;
+  virtual void flush() = 0;
+  // True once enough files are held that the caller should flush().
+  virtual bool full() const = 0;
+
+  // The io_uring sink when built with MZIP_IO_URING and the kernel allows
+  // it, else the sink writing each file through a FileWriter right away,
+  // which is also used for sparse output.
+  static std::unique_ptr<FileSink> create(bool use_io_uring, bool sparse);
+};
+
+}  // namespace ziputil
+#endif  // FILE_SINK_H
@@ -0,0 +1,182 @@
+#include "file_writer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ziputil {
+
+namespace {
+
+// Writes go out in blocks of this size, at offsets aligned to it.
+const size_t kWriteBlock = 1024 * 1024;
+// Granularity of hole detection; the common filesystem block size.
+const size_t kSparseBlock = 4096;
+// Smaller files fit in one write, so preallocating them saves nothing.
+const int64_t kMinPreallocate = kWriteBlock;
+
+bool allZero(const uint8_t* p, size_t len) {
+  return len == 0 || (p[0] == 0 && memcmp(p, p + 1, len - 1) == 0);
+}
+
+#if !defined(_WIN32)
+void preallocate(int fd, int64_t size) {
+  // Best effort: tmpfs, NFS and others may not support it.
+#if defined(__linux__)
+  int ret;
+  do {
+    ret = fallocate(fd, 0, 0, (off_t)size);
+  } while (ret != 0 && errno == EINTR);
+#elif defined(__APPLE__)
+  fstore_t store = {F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0};
+  if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+    store.fst_flags = F_ALLOCATEALL;
+    fcntl(fd, F_PREALLOCATE, &store);
+  }
+#else
+  (void)fd;
+  (void)size;
+#endif
+}
+
+bool pwriteAll(int fd, const uint8_t* p, size_t len, int64_t offset) {
+  while (len > 0) {
+    ssize_t n = ::pwrite(fd, p, len, (off_t)offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+    offset += n;
+  }
+  return true;
+}
+#endif
+
+}  // namespace
+
+FileWriter::FileWriter(const std::string& path, int64_t size, bool sparse)
+    : path_(path), sparse_(sparse), truncate_(sparse) {
+#if defined(_WIN32)
+  // Sequential writes through the os stream; sparse mode is not applied.
+  (void)size;
+  if (mz_stream_open(stream_, path.c_str(), MZ_OPEN_MODE_WRITE | MZ_OPEN_MODE_CREATE) !=
+      MZ_OK) {
+    throw ZipException(MZ_OPEN_ERROR, "open output file failed: " + path);
+  }
+  open_ = true;
+#else
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd_ < 0) {
+    throw ZipException(MZ_OPEN_ERROR, "open output file failed: " + path);
+  }
+  if (!sparse_ && size >= kMinPreallocate) {
+    preallocate(fd_, size);
+    truncate_ = true;
+  }
+#endif
+}
+
+FileWriter::~FileWriter() {
+#if !defined(_WIN32)
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+#endif
+}
+
+void FileWriter::write(const void* buf, size_t len) {
+  const uint8_t* p = static_cast<const uint8_t*>(buf);
+  while (len > 0) {
+    if (buffer_.empty() && len >= kWriteBlock) {
+      writeBlock(p, kWriteBlock);
+      p += kWriteBlock;
+      len -= kWriteBlock;
+      continue;
+    }
+    size_t n = std::min(len, kWriteBlock - buffer_.size());
+    buffer_.insert(buffer_.end(), p, p + n);
+    p += n;
+    len -= n;
+    if (buffer_.size() == kWriteBlock) {
+      writeBlock(buffer_.data(), buffer_.size());
+      buffer_.clear();
+    }
+  }
+}
+
+void FileWriter::writeBlock(const uint8_t* data, size_t len) {
+#if defined(_WIN32)
+  if (mz_stream_write(stream_, data, (int32_t)len) != (int32_t)len) {
+    throw ZipException(MZ_WRITE_ERROR, "write output file failed: " + path_);
+  }
+#else
+  if (!sparse_) {
+    if (!pwriteAll(fd_, data, len, offset_)) {
+      throw ZipException(MZ_WRITE_ERROR, "write output file failed: " + path_);
+    }
+  } else {
+    // Write each run of non-zero blocks, leave zero blocks as holes.
+    size_t run = 0;
+    for (size_t pos = 0; pos < len; pos += kSparseBlock) {
+      size_t n = std::min(kSparseBlock, len - pos);
+      if (!allZero(data + pos, n)) {
+        continue;
+      }
+      if (pos > run && !pwriteAll(fd_, data + run, pos - run, offset_ + run)) {
+        throw ZipException(MZ_WRITE_ERROR, "write output file failed: " + path_);
+      }
+      run = pos + n;
+    }
+    if (len > run && !pwriteAll(fd_, data + run, len - run, offset_ + run)) {
+      throw ZipException(MZ_WRITE_ERROR, "write output file failed: " + path_);
+    }
+  }
+#endif
+  offset_ += len;
+}
+
+void FileWriter::close() {
+  if (!buffer_.empty()) {
+    writeBlock(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+#if defined(_WIN32)
+  if (open_) {
+    mz_stream_close(stream_);
+    open_ = false;
+  }
+#else
+  if (fd_ < 0) {
+    return;
+  }
+  // Trailing holes and a preallocation past the actual data both need the
+  // size set explicitly.
+  bool ok = !truncate_ || ftruncate(fd_, (off_t)offset_) == 0;
+  ok = ::close(fd_) == 0 && ok;
+  fd_ = -1;
+  if (!ok) {
+    throw ZipException(MZ_WRITE_ERROR, "write output file failed: " + path_);
+  }
+#endif
+}
+
+int32_t FileWriter::writeCallback(void* writer, const void* buf, int32_t size) {
+  try {
+    static_cast<FileWriter*>(writer)->write(buf, (size_t)size);
+  } catch (const ZipException&) {
+    return MZ_WRITE_ERROR;
+  }
+  return size;
+}
+
+}  // namespace ziputil
@@ -0,0 +1,52 @@
+#ifndef FILE_WRITER_H
+#define FILE_WRITER_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "zip_common.h"
+
+namespace ziputil {
+
+// Output file for extraction. The final size is known from the central
+// directory, so the file is preallocated in one extent up front and filled
+// with large aligned writes. In sparse mode all-zero blocks are skipped and
+// left as holes instead (VM images, database snapshots).
+class FileWriter {
+ public:
+  // Throws ZipException when the file can not be created.
+  FileWriter(const std::string& path, int64_t size, bool sparse);
+  ~FileWriter();
+
+  FileWriter(const FileWriter&) = delete;
+  FileWriter& operator=(const FileWriter&) = delete;
+
+  void write(const void* buf, size_t len);
+  // Writes buffered data and sets the final size; throws on failure.
+  void close();
+
+  // mz_stream_write compatible callback for mz_zip_reader_entry_save.
+  static int32_t writeCallback(void* writer, const void* buf, int32_t size);
+
+ private:
+  void writeBlock(const uint8_t* data, size_t len);
+
+  std::string path_;
+  bool sparse_;
+  bool truncate_;  /* size must be set at close: sparse or preallocated */
+  int64_t offset_ = 0;
+  std::vector<uint8_t> buffer_;
+#if defined(_WIN32)
+  MzOsStream stream_;
+  bool open_ = false;
+#else
+  int fd_ = -1;
+#endif
+};
+
+}  // namespace ziputil
+#endif  // FILE_WRITER_H
@@ -22,6 +22,9 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
 #include <vector>
 
 #include "str_util.h"
@@ -36,7 +39,7 @@ int _mkdir(const char* p) {
     if (GetLastError() == ERROR_ALREADY_EXISTS) return 0;
   }
 #else
-  if (mkdir(p, S_IRWXU) == 0) {
+  if (mkdir(p, 0755) == 0) {  // like mz_os_make_dir; the umask applies
     return 0;
   } else {
     if (errno == EEXIST) {
@@ -108,6 +111,59 @@ bool make_dirs(const std::string& dir) {
 #endif
 }
 
+bool make_dir(const std::string& dir) {
+#ifdef _WIN32
+  if (CreateDirectoryW(Utf8ToUtf16(dir).c_str(), NULL)) {
+    return true;
+  }
+  return GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+  return _mkdir(dir.c_str()) == 0;
+#endif
+}
+
+bool make_dir_set(const std::string& root, const std::vector<std::string>& rel_dirs,
+                  unsigned threads) {
+  if (!make_dirs(root)) {
+    return false;
+  }
+
+  std::map<size_t, std::vector<std::string>> levels;
+  for (auto& d : rel_dirs) {
+    auto depth = std::count_if(d.begin(), d.end(), [](char c) { return c == '/' || c == '\\'; });
+    levels[depth].push_back(path_join(root, d));
+  }
+
+  const size_t kParallelLevel = 64;
+  std::atomic<bool> ok{true};
+  for (auto& level : levels) {
+    auto& dirs = level.second;
+    unsigned n = (unsigned)std::min<size_t>(threads, dirs.size() / kParallelLevel);
+    if (n <= 1) {
+      for (auto& d : dirs) {
+        if (!make_dir(d)) ok = false;
+      }
+      continue;
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+      for (size_t i = next++; i < dirs.size(); i = next++) {
+        if (!make_dir(dirs[i])) ok = false;
+      }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < n; ++i) {
+      pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool) {
+      t.join();
+    }
+  }
+  return ok;
+}
+
 bool file_exits(const std::string& filepath) {
 #ifdef _WIN32
   struct _stat st;
@@ -132,6 +188,33 @@ bool directory_exists(const std::string& filepath) {
 #endif
 }
 
+#ifdef _WIN32
+static bool file_id(const std::string& filepath, BY_HANDLE_FILE_INFORMATION* info) {
+  HANDLE h = CreateFileW(Utf8ToUtf16(filepath).c_str(), FILE_READ_ATTRIBUTES,
+                         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                         OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+  if (h == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  BOOL ok = GetFileInformationByHandle(h, info);
+  CloseHandle(h);
+  return ok != FALSE;
+}
+#endif
+
+bool same_file(const std::string& p1, const std::string& p2) {
+#ifdef _WIN32
+  BY_HANDLE_FILE_INFORMATION a, b;
+  return file_id(p1, &a) && file_id(p2, &b) &&
+         a.dwVolumeSerialNumber == b.dwVolumeSerialNumber &&
+         a.nFileIndexHigh == b.nFileIndexHigh && a.nFileIndexLow == b.nFileIndexLow;
+#else
+  struct stat a, b;
+  return stat(p1.c_str(), &a) == 0 && stat(p2.c_str(), &b) == 0 && a.st_dev == b.st_dev &&
+         a.st_ino == b.st_ino;
+#endif
+}
+
 std::string dirname(const std::string& p) {
   auto it = p.find_last_of("/\\");
   if (it == p.npos) {
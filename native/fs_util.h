@@ -2,12 +2,23 @@
 #define FS_UTIL_H
 
 #include <string>
+#include <vector>
 
 namespace fs_util {
 
 bool make_dirs(const std::string& dir);
+bool make_dir(const std::string& dir);
+// Creates `root` and every directory of `rel_dirs` (relative to root, '/' or
+// '\\' separated, ancestors included) with one mkdir each, shallowest level
+// first.
+// Levels with many directories are created by `threads` workers in parallel.
+bool make_dir_set(const std::string& root, const std::vector<std::string>& rel_dirs,
+                  unsigned threads);
 bool file_exits(const std::string& filepath);
 bool directory_exists(const std::string& filepath);
+// Whether both paths name one existing file, through links and different
+// spellings of the path alike.
+bool same_file(const std::string& p1, const std::string& p2);
 
 void copy_file(const std::string& from, const std::string& to);
 
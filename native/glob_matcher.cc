@@ -0,0 +1,143 @@
+#include "glob_matcher.h"
+
+#include <ctype.h>
+
+#include <algorithm>
+
+namespace ziputil {
+
+namespace {
+
+bool startsWith(const std::string& s, const std::string& prefix) {
+  return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
+}
+
+}  // namespace
+
+std::string GlobMatcher::fold(const std::string& path) {
+  std::string folded(path);
+  for (auto& c : folded) {
+    c = c == '\\' ? '/' : (char)tolower((unsigned char)c);
+  }
+  return folded;
+}
+
+GlobMatcher::Pattern::Pattern(const std::string& glob) {
+  std::string folded = fold(glob);
+  star_front = !folded.empty() && folded.front() == '*';
+  star_back = !folded.empty() && folded.back() == '*';
+  size_t start = 0;
+  while (start <= folded.size()) {
+    size_t star = folded.find('*', start);
+    if (star == std::string::npos) {
+      star = folded.size();
+    }
+    if (star > start) {
+      chunks.push_back(folded.substr(start, star - start));
+    }
+    start = star + 1;
+  }
+  if (chunks.empty() && !star_front) {
+    chunks.push_back(std::string());  // the empty pattern
+  }
+}
+
+bool GlobMatcher::Pattern::matches(const std::string& path) const {
+  if (chunks.empty()) {
+    return true;  // only stars
+  }
+  size_t pos = 0;
+  size_t end = path.size();
+  size_t first = 0;
+  size_t last = chunks.size();
+  if (!star_front) {
+    if (!startsWith(path, chunks.front())) {
+      return false;
+    }
+    if (chunks.size() == 1 && !star_back) {
+      return path.size() == chunks.front().size();
+    }
+    pos = chunks.front().size();
+    first = 1;
+  }
+  if (!star_back) {
+    const std::string& tail = chunks.back();
+    if (end - pos < tail.size() || path.compare(end - tail.size(), tail.size(), tail) != 0) {
+      return false;
+    }
+    end -= tail.size();
+    --last;
+  }
+  // Leftmost placement of each middle chunk is optimal when `*` is the only
+  // wildcard.
+  for (size_t i = first; i < last; ++i) {
+    size_t found = path.find(chunks[i], pos);
+    if (found == std::string::npos || found + chunks[i].size() > end) {
+      return false;
+    }
+    pos = found + chunks[i].size();
+  }
+  return true;
+}
+
+GlobMatcher::GlobMatcher(const std::vector<std::string>& include,
+                         const std::vector<std::string>& exclude) {
+  for (auto& glob : include) {
+    include_.emplace_back(glob);
+  }
+  for (auto& glob : exclude) {
+    exclude_.emplace_back(glob);
+    const Pattern& p = exclude_.back();
+    if (!p.star_front && p.star_back && p.chunks.size() == 1) {
+      excluded_prefixes_.push_back(p.chunks.front());
+    }
+  }
+}
+
+bool GlobMatcher::matches(const std::string& folded) const {
+  if (!include_.empty() &&
+      std::none_of(include_.begin(), include_.end(),
+                   [&](const Pattern& p) { return p.matches(folded); })) {
+    return false;
+  }
+  return std::none_of(exclude_.begin(), exclude_.end(),
+                      [&](const Pattern& p) { return p.matches(folded); });
+}
+
+std::vector<std::string> GlobMatcher::includePrefixes() const {
+  std::vector<std::string> prefixes;
+  for (auto& p : include_) {
+    if (p.prefix().empty()) {
+      return {std::string()};
+    }
+    prefixes.push_back(p.prefix());
+  }
+  if (prefixes.empty()) {
+    prefixes.push_back(std::string());
+  }
+  // Drop prefixes covered by a shorter one so the ranges do not overlap.
+  std::sort(prefixes.begin(), prefixes.end());
+  std::vector<std::string> result;
+  for (auto& prefix : prefixes) {
+    if (result.empty() || !startsWith(prefix, result.back())) {
+      result.push_back(prefix);
+    }
+  }
+  return result;
+}
+
+size_t GlobMatcher::excludedPrefix(const std::string& folded) const {
+  for (auto& prefix : excluded_prefixes_) {
+    if (startsWith(folded, prefix)) {
+      return prefix.size();
+    }
+  }
+  return 0;
+}
+
+bool GlobMatcher::excludesAll(const std::string& prefix) const {
+  return std::any_of(exclude_.begin(), exclude_.end(),
+                     [&](const Pattern& p) { return p.star_back && p.matches(prefix); });
+}
+
+}  // namespace ziputil
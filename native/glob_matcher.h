@@ -0,0 +1,57 @@
+#ifndef GLOB_MATCHER_H
+#define GLOB_MATCHER_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace ziputil {
+
+// Include/exclude globs compiled once, with mz_path_compare_wc semantics:
+// `*` matches any run of characters including separators, `/` and `\`
+// are interchangeable and matching ignores ASCII case.
+class GlobMatcher {
+ public:
+  GlobMatcher(const std::vector<std::string>& include,
+              const std::vector<std::string>& exclude);
+
+  // Lowercase with `/` separators: the form patterns are compiled to and
+  // paths must be passed in.
+  static std::string fold(const std::string& path);
+
+  // True when a folded path matches any include (or there are none) and
+  // no exclude.
+  bool matches(const std::string& folded) const;
+
+  // Literal prefixes every included path starts with; a single empty
+  // prefix when some include starts with `*` or there are none.
+  std::vector<std::string> includePrefixes() const;
+
+  // Length of an exclude prefix P, from a pattern `P*`, that the folded path
+  // starts with: every path sharing those P characters is excluded. 0 if none.
+  size_t excludedPrefix(const std::string& folded) const;
+
+  // True when every path starting with the folded `prefix` is excluded:
+  // an exclude ending in `*` matches the prefix itself. Lets a directory
+  // walk skip `prefix` = `dir/` without listing it.
+  bool excludesAll(const std::string& prefix) const;
+
+ private:
+  struct Pattern {
+    std::vector<std::string> chunks; /* literal text between stars */
+    bool star_front;
+    bool star_back;
+
+    explicit Pattern(const std::string& glob);
+    bool matches(const std::string& path) const;
+    std::string prefix() const { return star_front ? std::string() : chunks.front(); }
+  };
+
+  std::vector<Pattern> include_;
+  std::vector<Pattern> exclude_;
+  std::vector<std::string> excluded_prefixes_;
+};
+
+}  // namespace ziputil
+#endif  // GLOB_MATCHER_H
@@ -0,0 +1,204 @@
+#include "input_prefetch.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <exception>
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "zip_common.h"
+
+namespace ziputil {
+
+namespace {
+
+// Distance the read-ahead hint runs in front of the writer.
+const int64_t kReadAheadWindow = 16 * 1024 * 1024;
+// Larger files are streamed rather than held in memory.
+const int64_t kMaxReadSize = 4 * 1024 * 1024;
+// Opens overlap on network filesystems; more threads mostly add seeks.
+const size_t kMaxThreads = 4;
+
+}  // namespace
+
+std::unique_ptr<InputFile> InputFile::open(const std::string& path, int64_t max_read) {
+  if (mz_os_is_dir(path.c_str()) == MZ_OK || mz_os_is_symlink(path.c_str()) == MZ_OK) {
+    return nullptr;
+  }
+  int64_t size = mz_os_get_file_size(path.c_str());
+  if (size < 0) {
+    return nullptr;
+  }
+
+  std::unique_ptr<InputFile> file(new InputFile());
+  if (size <= max_read) {
+    MzOsStream stream;
+    if (mz_stream_open(stream, path.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+      return nullptr;
+    }
+    // One byte more than expected tells a file that grew from one that did not.
+    file->content_.resize((size_t)size + 1);
+    int64_t total = 0;
+    int32_t n = 0;
+    while (total < (int64_t)file->content_.size() &&
+           (n = mz_stream_read(stream, file->content_.data() + total,
+                               (int32_t)(file->content_.size() - total))) > 0) {
+      total += n;
+    }
+    if (n < 0 || total != size) {
+      return nullptr;  // changed while reading; addFile reports what it finds
+    }
+    file->content_.resize((size_t)size);
+    file->in_memory_ = true;
+    file->size_ = size;
+    return file;
+  }
+
+#if defined(_WIN32)
+  return nullptr;
+#else
+  file->fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (file->fd_ < 0 || fstat(file->fd_, &st) != 0) {
+    return nullptr;
+  }
+  file->size_ = (int64_t)st.st_size;
+#if defined(POSIX_FADV_SEQUENTIAL)
+  posix_fadvise(file->fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  file->advised_ = std::min(file->size_, kReadAheadWindow);
+#if defined(POSIX_FADV_WILLNEED)
+  posix_fadvise(file->fd_, 0, (off_t)file->advised_, POSIX_FADV_WILLNEED);
+#endif
+  return file;
+#endif
+}
+
+InputFile::~InputFile() {
+#if !defined(_WIN32)
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+#endif
+}
+
+int32_t InputFile::read(void* file, void* buf, int32_t size) {
+  return static_cast<InputFile*>(file)->read(static_cast<uint8_t*>(buf), size);
+}
+
+int32_t InputFile::read(uint8_t* buf, int32_t size) {
+  if (in_memory_) {
+    int32_t n = (int32_t)std::min<int64_t>(size, size_ - pos_);
+    memcpy(buf, content_.data() + pos_, (size_t)n);
+    pos_ += n;
+    return n;
+  }
+#if defined(_WIN32)
+  (void)buf;
+  (void)size;
+  return MZ_READ_ERROR;
+#else
+  // Keep a window of requested pages in front, so that the disk or the
+  // network works while the writer compresses what it has.
+  if (advised_ < size_ && pos_ + kReadAheadWindow / 2 >= advised_) {
+    int64_t len = std::min(size_ - advised_, kReadAheadWindow);
+#if defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(fd_, (off_t)advised_, (off_t)len, POSIX_FADV_WILLNEED);
+#endif
+    advised_ += len;
+  }
+  ssize_t n;
+  do {
+    n = ::read(fd_, buf, (size_t)size);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return MZ_READ_ERROR;
+  }
+  pos_ += n;
+  return (int32_t)n;
+#endif
+}
+
+InputPrefetcher::InputPrefetcher(std::vector<std::string> paths, size_t ahead, int64_t max_bytes)
+    : paths_(std::move(paths)),
+      files_(paths_.size()),
+      ready_(paths_.size(), 0),
+      ahead_(std::max<size_t>(1, ahead)),
+      max_bytes_(max_bytes) {
+  size_t threads = std::min(std::min(ahead_, kMaxThreads), std::max<size_t>(1, paths_.size()));
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this] { run(); });
+  }
+}
+
+InputPrefetcher::~InputPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  fetch_cv_.notify_all();
+  for (auto& t : workers_) {
+    t.join();
+  }
+}
+
+void InputPrefetcher::run() {
+  for (;;) {
+    size_t i;
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      // The file the consumer waits for is always opened, whatever the limits.
+      fetch_cv_.wait(lock, [this] {
+        return stop_ || fetched_ >= paths_.size() || fetched_ == taken_ ||
+               (fetched_ - taken_ < ahead_ && bytes_ < max_bytes_);
+      });
+      if (stop_ || fetched_ >= paths_.size()) {
+        return;
+      }
+      i = fetched_++;
+    }
+
+    std::unique_ptr<InputFile> file;
+    try {
+      file = InputFile::open(paths_[i], std::min(kMaxReadSize, max_bytes_));
+    } catch (const std::exception&) {
+      // Out of memory for this one; the writer reads it itself.
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      if (file) {
+        bytes_ += file->memory();
+      }
+      files_[i] = std::move(file);
+      ready_[i] = 1;
+    }
+    ready_cv_.notify_all();
+  }
+}
+
+std::unique_ptr<InputFile> InputPrefetcher::next() {
+  std::unique_ptr<InputFile> file;
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    if (taken_ >= paths_.size()) {
+      return nullptr;
+    }
+    ready_cv_.wait(lock, [this] { return ready_[taken_] != 0; });
+    file = std::move(files_[taken_]);
+    if (file) {
+      bytes_ -= file->memory();
+    }
+    ++taken_;
+  }
+  fetch_cv_.notify_all();
+  return file;
+}
+
+}  // namespace ziputil
@@ -0,0 +1,85 @@
+#ifndef INPUT_PREFETCH_H
+#define INPUT_PREFETCH_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ziputil {
+
+// An input file opened ahead of its turn to be written. Small files are
+// read into memory; larger ones stay open with the kernel asked to read
+// ahead of the position the writer consumes.
+class InputFile {
+ public:
+  // nullptr for directories, symlinks, files that can not be opened and,
+  // where there is no read-ahead hint (Windows), files over `max_read`;
+  // those take the regular path through minizip.
+  static std::unique_ptr<InputFile> open(const std::string& path, int64_t max_read);
+  ~InputFile();
+
+  InputFile(const InputFile&) = delete;
+  InputFile& operator=(const InputFile&) = delete;
+
+  int64_t size() const { return size_; }
+  // The whole content, or nullptr when the file is streamed.
+  const uint8_t* data() const { return in_memory_ ? content_.data() : nullptr; }
+  // Bytes held in memory.
+  int64_t memory() const { return in_memory_ ? size_ : 0; }
+
+  // mz_stream_read_cb for mz_zip_writer_add_info, `file` an InputFile.
+  static int32_t read(void* file, void* buf, int32_t size);
+
+ private:
+  InputFile() = default;
+  int32_t read(uint8_t* buf, int32_t size);
+
+  bool in_memory_ = false;
+  std::vector<uint8_t> content_;
+  int64_t size_ = 0;
+  int64_t pos_ = 0;
+  int64_t advised_ = 0;  /* end of the range handed to the kernel so far */
+  int fd_ = -1;
+};
+
+// Opens the files of `paths` in order on a few threads, up to `ahead`
+// files and `max_bytes` of content in front of the consumer, which takes
+// them with next() while it compresses the ones before.
+class InputPrefetcher {
+ public:
+  InputPrefetcher(std::vector<std::string> paths, size_t ahead, int64_t max_bytes);
+  ~InputPrefetcher();
+
+  InputPrefetcher(const InputPrefetcher&) = delete;
+  InputPrefetcher& operator=(const InputPrefetcher&) = delete;
+
+  // The input for the next path, as InputFile::open gives it.
+  std::unique_ptr<InputFile> next();
+
+ private:
+  void run();
+
+  std::vector<std::string> paths_;
+  std::vector<std::unique_ptr<InputFile>> files_;
+  std::vector<char> ready_;
+  size_t ahead_;
+  int64_t max_bytes_;
+  size_t fetched_ = 0;  /* next path a worker opens */
+  size_t taken_ = 0;    /* next path next() returns */
+  int64_t bytes_ = 0;   /* in memory, opened and not yet taken */
+  bool stop_ = false;
+  std::mutex mu_;
+  std::condition_variable fetch_cv_;
+  std::condition_variable ready_cv_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace ziputil
+#endif  // INPUT_PREFETCH_H
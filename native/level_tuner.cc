@@ -0,0 +1,142 @@
+#include "level_tuner.h"
+
+#include <ctype.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace ziputil {
+
+namespace {
+
+// Input per class between two decisions; small entries time too noisily
+// to judge one by one.
+const int64_t kWindowBytes = 4 * 1024 * 1024;
+const int kWindowEntries = 256;
+// Speed above target * kSpareSpeed is spent on a higher level.
+const double kSpareSpeed = 1.3;
+// Ratios below target * kSpareRatio give a level back for speed.
+const double kSpareRatio = 0.95;
+
+const std::unordered_map<std::string, EntryClass>& extensions() {
+  static const std::unordered_map<std::string, EntryClass> map = [] {
+    std::unordered_map<std::string, EntryClass> m;
+    for (const char* ext :
+         {"txt", "md",   "rst",  "csv", "tsv",  "log", "json", "xml",  "yml",  "yaml", "toml",
+          "ini", "cfg",  "html", "htm", "css",  "js",  "mjs",  "cjs",  "ts",   "tsx",  "jsx",
+          "map", "svg",  "c",    "cc",  "cpp",  "h",   "hpp",  "py",   "rb",   "go",   "rs",
+          "java", "kt",  "cs",   "sh",  "bat",  "ps1", "sql",  "tex",  "pem",  "lock", "mdx"}) {
+      m.emplace(ext, EntryClass::kText);
+    }
+    for (const char* ext :
+         {"zip", "gz",  "tgz", "bz2", "xz",   "zst", "lz4",  "7z",  "rar",  "br",   "jpg",
+          "jpeg", "png", "gif", "webp", "avif", "heic", "mp3", "aac", "ogg", "opus", "flac",
+          "mp4", "m4a", "mkv", "webm", "mov",  "avi", "woff", "woff2", "jar", "apk", "docx",
+          "xlsx", "pptx", "odt", "epub", "nupkg", "whl", "crx"}) {
+      m.emplace(ext, EntryClass::kCompressed);
+    }
+    return m;
+  }();
+  return map;
+}
+
+}  // namespace
+
+EntryClass classify(const std::string& name) {
+  size_t dot = name.rfind('.');
+  size_t sep = name.find_last_of("/\\");
+  if (dot == std::string::npos || (sep != std::string::npos && dot < sep)) {
+    return EntryClass::kBinary;
+  }
+  std::string ext = name.substr(dot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return tolower(c); });
+  auto it = extensions().find(ext);
+  return it == extensions().end() ? EntryClass::kBinary : it->second;
+}
+
+const char* class_name(EntryClass c) {
+  switch (c) {
+    case EntryClass::kText: return "text";
+    case EntryClass::kCompressed: return "compressed";
+    default: return "binary";
+  }
+}
+
+LevelTuner::LevelTuner(int min_level, int max_level, int start_level, const TuneTarget& target)
+    : min_level_(min_level), max_level_(max_level), target_(target) {
+  for (auto& state : states_) {
+    state.level = std::max(min_level_, std::min(max_level_, start_level));
+  }
+  states_[(int)EntryClass::kCompressed].level = 0;
+}
+
+int LevelTuner::level(EntryClass c) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return states_[(int)c].level;
+}
+
+void LevelTuner::record(EntryClass c, int level, int64_t bytes, int64_t compressed_bytes,
+                        double seconds) {
+  std::lock_guard<std::mutex> lock(mu_);
+  State& state = states_[(int)c];
+  state.total.bytes += bytes;
+  state.total.compressed_bytes += compressed_bytes;
+  state.total.seconds += seconds;
+  ++state.total.entries;
+  // Entries prepared before the last change say nothing about the new level.
+  if (c == EntryClass::kCompressed || level != state.level) {
+    return;
+  }
+  state.window.bytes += bytes;
+  state.window.compressed_bytes += compressed_bytes;
+  state.window.seconds += seconds;
+  ++state.window.entries;
+  if (state.window.bytes >= kWindowBytes || state.window.entries >= kWindowEntries) {
+    adjust(state);
+    state.window = Window();
+  }
+}
+
+void LevelTuner::adjust(State& state) {
+  const Window& w = state.window;
+  if (w.bytes == 0) {
+    return;
+  }
+  double mb_per_s = w.seconds > 0 ? w.bytes / 1e6 / w.seconds : 1e9;
+  double ratio = (double)w.compressed_bytes / (double)w.bytes;
+  int step = 0;
+  if (target_.mb_per_s > 0 && mb_per_s < target_.mb_per_s) {
+    step = -1;
+  } else if (target_.ratio > 0) {
+    if (ratio > target_.ratio) {
+      step = 1;
+    } else if (ratio < target_.ratio * kSpareRatio) {
+      step = -1;
+    }
+  } else if (target_.mb_per_s > 0 && mb_per_s > target_.mb_per_s * kSpareSpeed) {
+    step = 1;
+  }
+  // A missed ratio target does not buy levels the speed target can not pay.
+  if (step > 0 && target_.mb_per_s > 0 && mb_per_s < target_.mb_per_s * kSpareSpeed) {
+    step = 0;
+  }
+  state.level = std::max(min_level_, std::min(max_level_, state.level + step));
+}
+
+std::vector<LevelTuner::Report> LevelTuner::report() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  std::vector<Report> out;
+  for (int i = 0; i < (int)EntryClass::kCount; ++i) {
+    const State& state = states_[i];
+    if (state.total.entries == 0) {
+      continue;
+    }
+    double mb_per_s = state.total.seconds > 0 ? state.total.bytes / 1e6 / state.total.seconds : 0;
+    out.push_back(Report{(EntryClass)i, state.level, (uint64_t)state.total.entries,
+                         (uint64_t)state.total.bytes, (uint64_t)state.total.compressed_bytes,
+                         mb_per_s});
+  }
+  return out;
+}
+
+}  // namespace ziputil
@@ -0,0 +1,75 @@
+#ifndef LEVEL_TUNER_H
+#define LEVEL_TUNER_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ziputil {
+
+// Entries are tuned per class, since text, other binaries and already
+// compressed media answer very differently to the same level.
+enum class EntryClass { kText, kBinary, kCompressed, kCount };
+
+// By file extension; names without a known one are kBinary.
+EntryClass classify(const std::string& name);
+const char* class_name(EntryClass c);
+
+struct TuneTarget {
+  double mb_per_s = 0;  /* compression speed per thread to keep, 0 for none */
+  double ratio = 0;     /* compressed / uncompressed size to reach, 0 for none */
+};
+
+// Adjusts the level of each entry class toward a target from what the
+// entries compressed at the current level achieved. Decisions are taken
+// every few MiB of input per class, one level at a time; a speed target
+// that is missed wins over the ratio target. Already compressed entries
+// are stored. Safe to use from several threads.
+class LevelTuner {
+ public:
+  struct Report {
+    EntryClass entry_class;
+    int level;           /* level in use at the end */
+    uint64_t entries;
+    uint64_t bytes;
+    uint64_t compressed_bytes;
+    double mb_per_s;     /* compression speed over all entries of the class */
+  };
+
+  LevelTuner(int min_level, int max_level, int start_level, const TuneTarget& target);
+
+  int level(EntryClass c) const;
+  // One entry compressed at `level` from `bytes` into `compressed_bytes`
+  // in `seconds` of compression time.
+  void record(EntryClass c, int level, int64_t bytes, int64_t compressed_bytes, double seconds);
+  // Classes that saw entries.
+  std::vector<Report> report() const;
+
+ private:
+  struct Window {
+    int64_t bytes = 0;
+    int64_t compressed_bytes = 0;
+    double seconds = 0;
+    int entries = 0;
+  };
+  struct State {
+    int level;
+    Window window;  /* entries at `level` since it was set */
+    Window total;
+  };
+
+  void adjust(State& state);
+
+  int min_level_;
+  int max_level_;
+  TuneTarget target_;
+  mutable std::mutex mu_;
+  State states_[(int)EntryClass::kCount];
+};
+
+}  // namespace ziputil
+#endif  // LEVEL_TUNER_H
@@ -0,0 +1,247 @@
+#include "range_reader.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <zlib.h>
+
+#include "zip_reader.h"
+
+namespace ziputil {
+
+namespace {
+
+const uInt kWindowSize = 32768;
+const int32_t kInputChunk = 64 * 1024;
+
+// Feeds the compressed payload of one entry to a z_stream.
+class PayloadInput {
+ public:
+  PayloadInput(int64_t begin, int64_t end) : pos_(begin), end_(end), buf_(kInputChunk) {}
+
+  // Refills `zs` when it ran dry; false at the end of the payload.
+  template <typename Fetch>
+  bool fill(z_stream& zs, Fetch fetch) {
+    if (zs.avail_in > 0) {
+      return true;
+    }
+    if (pos_ >= end_) {
+      return false;
+    }
+    int32_t n = (int32_t)std::min<int64_t>(end_ - pos_, (int64_t)buf_.size());
+    fetch(pos_, buf_.data(), n);
+    pos_ += n;
+    zs.next_in = buf_.data();
+    zs.avail_in = (uInt)n;
+    return true;
+  }
+
+ private:
+  int64_t pos_;
+  int64_t end_;
+  std::vector<uint8_t> buf_;
+};
+
+ZipException corrupt(const ZipEntry& entry) {
+  return ZipException(MZ_DATA_ERROR, "corrupt deflate stream: " + entry.name);
+}
+
+}  // namespace
+
+RangeReader::RangeReader(const std::string& archive, int64_t span, size_t cache_limit)
+    : archive_(archive), span_(std::max<int64_t>(span, kWindowSize)), cache_limit_(cache_limit) {}
+
+bool RangeReader::read(const ZipEntry& entry, int64_t offset, int64_t length, std::string& out) {
+  if (entry.is_encrypted || (entry.compression_method != MZ_COMPRESS_METHOD_STORE &&
+                             entry.compression_method != MZ_COMPRESS_METHOD_DEFLATE)) {
+    return false;
+  }
+  if (offset >= entry.uncompressed_size || length <= 0) {
+    return true;
+  }
+  length = std::min(length, entry.uncompressed_size - offset);
+  int64_t payload = local_data_offset(stream(), entry.disk_offset);
+  if (payload < 0) {
+    return false;
+  }
+
+  if (entry.compression_method == MZ_COMPRESS_METHOD_STORE) {
+    size_t start = out.size();
+    out.resize(start + (size_t)length);
+    for (int64_t done = 0; done < length;) {
+      int32_t n = (int32_t)std::min<int64_t>(length - done, kInputChunk * 16);
+      readAt(payload + offset + done, &out[start + (size_t)done], n);
+      done += n;
+    }
+    return true;
+  }
+  auto checkpoints = index(entry, payload);
+  inflateRange(*checkpoints, entry, payload, offset, length, out);
+  return true;
+}
+
+std::shared_ptr<const RangeReader::Index> RangeReader::index(const ZipEntry& entry,
+                                                             int64_t payload) {
+  auto it = cache_.find(entry.disk_offset);
+  if (it != cache_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+  }
+
+  auto built = build(entry, payload);
+  lru_.emplace_front(entry.disk_offset, built);
+  cache_[entry.disk_offset] = lru_.begin();
+  cached_ += built->size() * kWindowSize;
+  while (cached_ > cache_limit_ && lru_.size() > 1) {
+    cached_ -= lru_.back().second->size() * kWindowSize;
+    cache_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+  return built;
+}
+
+// One pass over the whole entry, stopping at deflate block boundaries
+// (Z_BLOCK) to snapshot the window where `span_` more bytes came out. An
+// entry too large for the cache at that spacing gets sparser checkpoints.
+std::shared_ptr<const RangeReader::Index> RangeReader::build(const ZipEntry& entry,
+                                                             int64_t payload) {
+  auto index = std::make_shared<Index>();
+  index->push_back(Checkpoint{0, 0, 0, {}});
+  int64_t points = std::max<int64_t>((int64_t)(cache_limit_ / kWindowSize), 2) - 1;
+  int64_t span = std::max(span_, (entry.uncompressed_size + points - 1) / points);
+
+  z_stream zs = {};
+  if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+    throw ZipException(MZ_MEM_ERROR, "inflate init failed");
+  }
+  PayloadInput input(payload, payload + entry.compressed_size);
+  auto fetch = [this](int64_t offset, void* buf, int32_t len) { readAt(offset, buf, len); };
+  std::vector<uint8_t> window(kWindowSize);
+  int64_t total_in = 0;
+  int64_t total_out = 0;
+  int64_t last = 0;
+  uLong crc = crc32(0, Z_NULL, 0);
+  int ret = Z_OK;
+  try {
+    while (ret != Z_STREAM_END) {
+      // Pending output may still come after the last input byte went in.
+      bool more = input.fill(zs, fetch);
+      if (zs.avail_out == 0) {
+        zs.next_out = window.data();
+        zs.avail_out = kWindowSize;
+      }
+      uInt avail_in = zs.avail_in;
+      uInt avail_out = zs.avail_out;
+      Bytef* produced = zs.next_out;
+      ret = inflate(&zs, Z_BLOCK);
+      total_in += avail_in - zs.avail_in;
+      total_out += avail_out - zs.avail_out;
+      crc = crc32(crc, produced, avail_out - zs.avail_out);
+      if (ret != Z_OK && ret != Z_STREAM_END && (ret != Z_BUF_ERROR || !more)) {
+        throw corrupt(entry);
+      }
+      bool boundary = (zs.data_type & 128) && !(zs.data_type & 64);
+      if (ret == Z_OK && boundary && total_out - last >= span) {
+        // The window is circular with its write position at
+        // kWindowSize - avail_out; store it oldest byte first.
+        Checkpoint point{total_out, total_in, zs.data_type & 7,
+                         std::vector<uint8_t>(kWindowSize)};
+        uInt left = zs.avail_out;
+        memcpy(point.window.data(), window.data() + kWindowSize - left, left);
+        memcpy(point.window.data() + left, window.data(), kWindowSize - left);
+        index->push_back(std::move(point));
+        last = total_out;
+      }
+    }
+  } catch (...) {
+    inflateEnd(&zs);
+    throw;
+  }
+  inflateEnd(&zs);
+  if (total_out != entry.uncompressed_size || (uint32_t)crc != entry.crc) {
+    throw ZipException(MZ_CRC_ERROR, "CRC mismatch: " + entry.name);
+  }
+  return index;
+}
+
+void RangeReader::inflateRange(const Index& index, const ZipEntry& entry, int64_t payload,
+                               int64_t offset, int64_t length, std::string& out) {
+  auto it = std::upper_bound(index.begin(), index.end(), offset,
+                             [](int64_t value, const Checkpoint& p) { return value < p.out; });
+  const Checkpoint& here = *(it - 1);
+
+  z_stream zs = {};
+  if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+    throw ZipException(MZ_MEM_ERROR, "inflate init failed");
+  }
+  int64_t in = payload + here.in;
+  try {
+    if (here.bits) {
+      // The checkpoint sits inside this byte; its high bits are still due.
+      uint8_t byte = 0;
+      readAt(in - 1, &byte, 1);
+      inflatePrime(&zs, here.bits, byte >> (8 - here.bits));
+    }
+    if (!here.window.empty()) {
+      inflateSetDictionary(&zs, here.window.data(), kWindowSize);
+    }
+  } catch (...) {
+    inflateEnd(&zs);
+    throw;
+  }
+
+  PayloadInput input(in, payload + entry.compressed_size);
+  auto fetch = [this](int64_t pos, void* buf, int32_t len) { readAt(pos, buf, len); };
+  std::vector<uint8_t> discard(kWindowSize);
+  int64_t skip = offset - here.out;
+  size_t start = out.size();
+  out.resize(start + (size_t)length);
+  int64_t done = 0;
+  int ret = Z_OK;
+  try {
+    while (done < length) {
+      if (ret == Z_STREAM_END) {
+        throw corrupt(entry);
+      }
+      bool more = input.fill(zs, fetch);
+      if (skip > 0) {
+        zs.next_out = discard.data();
+        zs.avail_out = (uInt)std::min<int64_t>(skip, kWindowSize);
+      } else {
+        zs.next_out = reinterpret_cast<Bytef*>(&out[start + (size_t)done]);
+        zs.avail_out = (uInt)std::min<int64_t>(length - done, INT32_MAX);
+      }
+      uInt avail_out = zs.avail_out;
+      ret = inflate(&zs, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END && (ret != Z_BUF_ERROR || !more)) {
+        throw corrupt(entry);
+      }
+      int64_t produced = avail_out - zs.avail_out;
+      if (skip > 0) {
+        skip -= produced;
+      } else {
+        done += produced;
+      }
+    }
+  } catch (...) {
+    inflateEnd(&zs);
+    out.resize(start);
+    throw;
+  }
+  inflateEnd(&zs);
+}
+
+void* RangeReader::stream() {
+  if (mz_stream_is_open(file_) != MZ_OK &&
+      mz_stream_open(file_, archive_.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    throw ZipException(MZ_OPEN_ERROR, "opening archive failed");
+  }
+  return file_;
+}
+
+void RangeReader::readAt(int64_t offset, void* buf, int32_t len) {
+  read_at(stream(), offset, buf, len);
+}
+
+}  // namespace ziputil
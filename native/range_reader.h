@@ -0,0 +1,66 @@
+#ifndef RANGE_READER_H
+#define RANGE_READER_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "zip_common.h"
+
+namespace ziputil {
+
+struct ZipEntry;
+
+// Byte ranges of entries without inflating them from the start. Stored
+// entries are read at their file offset. For deflated ones the first range
+// read inflates the whole entry once and keeps a checkpoint (input bit
+// position plus the 32 KiB window) every `span` output bytes, the zran
+// technique; later reads start inflating at the nearest checkpoint.
+class RangeReader {
+ public:
+  // `cache_limit` bounds the bytes of checkpoint windows kept, least
+  // recently used entries are dropped first. A single entry stays within
+  // it by spacing its checkpoints wider than `span` where needed.
+  RangeReader(const std::string& archive, int64_t span, size_t cache_limit);
+
+  // Appends up to `length` bytes of `entry` from `offset` to `out`. False
+  // when the entry has to be decoded by minizip from the start: encrypted,
+  // other compression methods, or no local header at its recorded offset.
+  // Throws ZipException on read errors and corrupt data.
+  bool read(const ZipEntry& entry, int64_t offset, int64_t length, std::string& out);
+
+ private:
+  struct Checkpoint {
+    int64_t out;  /* uncompressed offset */
+    int64_t in;   /* compressed offset of the first full byte */
+    int bits;     /* bits of the previous byte still unused, 0..7 */
+    std::vector<uint8_t> window;
+  };
+  typedef std::vector<Checkpoint> Index;
+
+  std::shared_ptr<const Index> index(const ZipEntry& entry, int64_t payload);
+  std::shared_ptr<const Index> build(const ZipEntry& entry, int64_t payload);
+  void inflateRange(const Index& index, const ZipEntry& entry, int64_t payload,
+                    int64_t offset, int64_t length, std::string& out);
+  // The archive, opened on first use.
+  void* stream();
+  void readAt(int64_t offset, void* buf, int32_t len);
+
+  std::string archive_;
+  int64_t span_;
+  size_t cache_limit_;
+  size_t cached_ = 0;
+  MzOsStream file_;
+  // By local header offset, most recently used first.
+  std::list<std::pair<int64_t, std::shared_ptr<const Index>>> lru_;
+  std::unordered_map<int64_t, decltype(lru_)::iterator> cache_;
+};
+
+}  // namespace ziputil
+#endif  // RANGE_READER_H
@@ -0,0 +1,139 @@
+#include "solid_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <fmt/core.h>
+
+#include "glob_matcher.h"
+#include "zip_common.h"
+
+namespace ziputil {
+
+const char kSolidIndexEntry[] = ".mzip/solid.idx";
+const char kSolidBlockPrefix[] = ".mzip/solid/";
+
+namespace {
+
+const char kSolidMagic[8] = {'M', 'Z', 'S', 'O', 'L', 'I', 'D', '1'};
+// Fixed part of a record after the name length and name.
+const size_t kRecordSize = 4 + 4 + 4 + 4 + 8 + 4;
+
+void put_u16(std::string& out, uint16_t v) {
+  out.push_back((char)(v & 0xFF));
+  out.push_back((char)(v >> 8));
+}
+
+void put_u32(std::string& out, uint32_t v) {
+  put_u16(out, (uint16_t)(v & 0xFFFF));
+  put_u16(out, (uint16_t)(v >> 16));
+}
+
+void put_u64(std::string& out, uint64_t v) {
+  put_u32(out, (uint32_t)(v & 0xFFFFFFFF));
+  put_u32(out, (uint32_t)(v >> 32));
+}
+
+}  // namespace
+
+std::string solid_block_name(uint32_t block) {
+  return fmt::format("{}{:08}", kSolidBlockPrefix, block);
+}
+
+std::string encode_solid_index(const std::vector<SolidFile>& files) {
+  std::string out(kSolidMagic, sizeof(kSolidMagic));
+  put_u32(out, (uint32_t)files.size());
+  for (auto& f : files) {
+    put_u16(out, (uint16_t)f.name.size());
+    out.append(f.name);
+    put_u32(out, f.block);
+    put_u32(out, f.offset);
+    put_u32(out, f.length);
+    put_u32(out, f.crc);
+    put_u64(out, (uint64_t)(int64_t)f.modified_date);
+    put_u32(out, f.external_fa);
+  }
+  return out;
+}
+
+std::vector<SolidFile> decode_solid_index(const std::string& data) {
+  auto corrupt = [] { return ZipException(MZ_FORMAT_ERROR, "corrupt solid index"); };
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data.data());
+  const uint8_t* end = p + data.size();
+  if (data.size() < sizeof(kSolidMagic) + 4 || memcmp(p, kSolidMagic, sizeof(kSolidMagic)) != 0) {
+    throw corrupt();
+  }
+  p += sizeof(kSolidMagic);
+  uint32_t count = read_u32(p);
+  p += 4;
+
+  std::vector<SolidFile> files;
+  files.reserve(std::min<size_t>(count, data.size() / (2 + kRecordSize)));
+  for (uint32_t i = 0; i < count; ++i) {
+    if (end - p < 2 || (size_t)(end - p) < 2 + read_u16(p) + kRecordSize) {
+      throw corrupt();
+    }
+    SolidFile f;
+    uint16_t name_size = read_u16(p);
+    f.name.assign(reinterpret_cast<const char*>(p + 2), name_size);
+    p += 2 + name_size;
+    f.block = read_u32(p);
+    f.offset = read_u32(p + 4);
+    f.length = read_u32(p + 8);
+    f.crc = read_u32(p + 12);
+    f.modified_date = (time_t)(int64_t)read_u64(p + 16);
+    f.external_fa = read_u32(p + 24);
+    p += kRecordSize;
+    files.push_back(std::move(f));
+  }
+  return files;
+}
+
+SolidIndex::SolidIndex(std::vector<SolidFile> files) : files_(std::move(files)) {
+  by_name_.reserve(files_.size());
+  for (size_t i = 0; i < files_.size(); ++i) {
+    by_name_[files_[i].name] = i;  // a later file of the same name wins
+    by_folded_.emplace(GlobMatcher::fold(files_[i].name), i);
+  }
+}
+
+const SolidFile* SolidIndex::find(const std::string& name) const {
+  auto it = by_name_.find(name);
+  if (it == by_name_.end()) {
+    it = by_folded_.find(GlobMatcher::fold(name));
+    if (it == by_folded_.end()) {
+      return nullptr;
+    }
+  }
+  return &files_[it->second];
+}
+
+BlockCache::Block BlockCache::get(uint32_t block,
+                                  const std::function<void(std::string& data)>& load) {
+  auto it = map_.find(block);
+  if (it != map_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+  }
+
+  auto data = std::make_shared<std::string>();
+  load(*data);
+  size_ += data->size();
+  lru_.emplace_front(block, data);
+  map_[block] = lru_.begin();
+  while (size_ > limit_ && lru_.size() > 1) {
+    size_ -= lru_.back().second->size();
+    map_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+  return data;
+}
+
+void BlockCache::clear() {
+  lru_.clear();
+  map_.clear();
+  size_ = 0;
+}
+
+}  // namespace ziputil
@@ -0,0 +1,74 @@
+#ifndef SOLID_INDEX_H
+#define SOLID_INDEX_H
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ziputil {
+
+// Entry listing the files packed into solid blocks, written last.
+extern const char kSolidIndexEntry[];
+// Entry names of solid blocks, `.mzip/solid/` and the block number.
+extern const char kSolidBlockPrefix[];
+std::string solid_block_name(uint32_t block);
+
+// A small file stored inside a solid block instead of as its own entry.
+struct SolidFile {
+  std::string name;
+  uint32_t block;
+  uint32_t offset;  /* in the uncompressed block */
+  uint32_t length;
+  uint32_t crc;
+  time_t modified_date;
+  uint32_t external_fa;
+};
+
+// Little-endian records behind a magic; throws ZipException on decoding
+// anything else.
+std::string encode_solid_index(const std::vector<SolidFile>& files);
+std::vector<SolidFile> decode_solid_index(const std::string& data);
+
+class SolidIndex {
+ public:
+  explicit SolidIndex(std::vector<SolidFile> files);
+
+  // By exact name, then ignoring case as the reader's other lookups do.
+  const SolidFile* find(const std::string& name) const;
+  const std::vector<SolidFile>& files() const { return files_; }
+
+ private:
+  std::vector<SolidFile> files_;
+  std::unordered_map<std::string, size_t> by_name_;
+  std::unordered_map<std::string, size_t> by_folded_;  /* first wins */
+};
+
+// Decompressed solid blocks, most recently used first, up to `limit`
+// bytes; the block in use is kept even when it alone is larger.
+class BlockCache {
+ public:
+  typedef std::shared_ptr<const std::string> Block;
+
+  explicit BlockCache(size_t limit) : limit_(limit) {}
+
+  // The cached block, or the one `load` fills in.
+  Block get(uint32_t block, const std::function<void(std::string& data)>& load);
+  void clear();
+
+ private:
+  size_t limit_;
+  size_t size_ = 0;
+  std::list<std::pair<uint32_t, Block>> lru_;
+  std::unordered_map<uint32_t, std::list<std::pair<uint32_t, Block>>::iterator> map_;
+};
+
+}  // namespace ziputil
+#endif  // SOLID_INDEX_H
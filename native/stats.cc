@@ -0,0 +1,172 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include <fmt/core.h>
+
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace stats {
+
+std::atomic<bool> g_enabled{false};
+std::atomic<bool> g_tracing{false};
+
+namespace {
+
+const size_t kMaxSpans = 1 << 16;
+
+OpStats g_ops[(int)Op::kCount];
+
+std::mutex g_spans_mu;
+std::vector<Span> g_spans;
+size_t g_spans_next = 0;  // ring buffer position once g_spans is full
+
+}  // namespace
+
+const char* op_name(Op op) {
+  switch (op) {
+    case Op::kOpen: return "open";
+    case Op::kCreate: return "create";
+    case Op::kClose: return "close";
+    case Op::kRead: return "read";
+    case Op::kReadRange: return "readRange";
+    case Op::kExtract: return "extract";
+    case Op::kExtractAll: return "extract_all";
+    case Op::kAddFile: return "addFile";
+    case Op::kAddDir: return "addDir";
+    case Op::kAddBuffer: return "addBuffer";
+    case Op::kFlush: return "flush";
+    case Op::kVerify: return "verify";
+    case Op::kTrainDictionary: return "trainDictionary";
+    default: return "unknown";
+  }
+}
+
+void set_enabled(bool on) { g_enabled.store(on, std::memory_order_relaxed); }
+
+void set_tracing(bool on) {
+  // Spans carry the queue/exec timings, so tracing implies stats.
+  if (on) set_enabled(true);
+  g_tracing.store(on, std::memory_order_relaxed);
+}
+
+uint64_t now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void Histogram::record(uint64_t us) {
+  int b = 0;
+  while (b < kBuckets - 1 && (1ull << b) <= us) {
+    ++b;
+  }
+  buckets_[b].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(us, std::memory_order_relaxed);
+  uint64_t prev = max_.load(std::memory_order_relaxed);
+  while (prev < us && !max_.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {
+  }
+}
+
+void Histogram::reset() {
+  for (auto& b : buckets_) {
+    b.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+// Upper bound of the bucket holding the p-th percentile.
+uint64_t Histogram::percentile(double p) const {
+  uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p * total + 0.5);
+  uint64_t seen = 0;
+  for (int b = 0; b < kBuckets; ++b) {
+    seen += buckets_[b].load(std::memory_order_relaxed);
+    if (seen >= rank && seen > 0) {
+      return b == 0 ? 0 : std::min<uint64_t>(1ull << b, max());
+    }
+  }
+  return max();
+}
+
+OpStats& get(Op op) { return g_ops[(int)op]; }
+
+void reset() {
+  for (auto& s : g_ops) {
+    s.ops.store(0, std::memory_order_relaxed);
+    s.errors.store(0, std::memory_order_relaxed);
+    s.bytes_in.store(0, std::memory_order_relaxed);
+    s.bytes_out.store(0, std::memory_order_relaxed);
+    s.queued_us.reset();
+    s.exec_us.reset();
+    s.lock_wait_us.reset();
+  }
+  std::lock_guard<std::mutex> lock(g_spans_mu);
+  g_spans.clear();
+  g_spans_next = 0;
+}
+
+void add_span(Op op, uint64_t ts_us, uint64_t dur_us) {
+  Span span{op, ts_us, dur_us, std::hash<std::thread::id>()(std::this_thread::get_id())};
+  std::lock_guard<std::mutex> lock(g_spans_mu);
+  if (g_spans.size() < kMaxSpans) {
+    g_spans.push_back(span);
+  } else {
+    g_spans[g_spans_next] = span;
+    g_spans_next = (g_spans_next + 1) % kMaxSpans;
+  }
+}
+
+std::string take_trace_json() {
+  std::vector<Span> spans;
+  size_t next = 0;
+  {
+    std::lock_guard<std::mutex> lock(g_spans_mu);
+    spans.swap(g_spans);
+    next = g_spans_next;
+    g_spans_next = 0;
+  }
+
+  int pid = (int)getpid();
+  std::string json = "{\"traceEvents\":[";
+  for (size_t i = 0; i < spans.size(); ++i) {
+    const Span& s = spans[(next + i) % spans.size()];
+    json += fmt::format("{}{{\"name\":\"{}\",\"cat\":\"mzip\",\"ph\":\"X\",\"ts\":{},\"dur\":{},\"pid\":{},\"tid\":{}}}",
+                        i ? "," : "", op_name(s.op), s.ts_us, s.dur_us, pid, s.tid % 1000000);
+  }
+  json += "],\"displayTimeUnit\":\"ms\"}";
+  return json;
+}
+
+void OpTrace::finish(bool ok) {
+  if (!queued_us_ || !start_us_) {
+    return;
+  }
+  uint64_t end_us = now_us();
+  auto& s = get(op_);
+  s.ops.fetch_add(1, std::memory_order_relaxed);
+  if (!ok) {
+    s.errors.fetch_add(1, std::memory_order_relaxed);
+  }
+  s.queued_us.record(start_us_ - queued_us_);
+  s.exec_us.record(end_us - start_us_);
+  if (tracing()) {
+    add_span(op_, start_us_, end_us - start_us_);
+  }
+}
+
+}  // namespace stats
@@ -0,0 +1,137 @@
+#ifndef STATS_H
+#define STATS_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Low overhead counters, latency histograms and trace spans for the reader
+// and writer operations. Everything is off by default; while disabled each
+// probe costs a single relaxed atomic load.
+namespace stats {
+
+enum class Op : int {
+  kOpen,
+  kCreate,
+  kClose,
+  kRead,
+  kReadRange,
+  kExtract,
+  kExtractAll,
+  kAddFile,
+  kAddDir,
+  kAddBuffer,
+  kFlush,
+  kVerify,
+  kTrainDictionary,
+  kCount
+};
+
+const char* op_name(Op op);
+
+extern std::atomic<bool> g_enabled;
+extern std::atomic<bool> g_tracing;
+
+inline bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+inline bool tracing() { return g_tracing.load(std::memory_order_relaxed); }
+void set_enabled(bool on);
+void set_tracing(bool on);
+
+uint64_t now_us();
+
+// Power-of-two buckets of microseconds.
+class Histogram {
+ public:
+  static const int kBuckets = 32;
+
+  Histogram() { reset(); }
+  void record(uint64_t us);
+  void reset();
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+  uint64_t percentile(double p) const;
+
+ private:
+  std::atomic<uint64_t> buckets_[kBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+struct OpStats {
+  std::atomic<uint64_t> ops{0};
+  std::atomic<uint64_t> errors{0};
+  std::atomic<uint64_t> bytes_in{0};   /* compressed bytes read / input bytes written */
+  std::atomic<uint64_t> bytes_out{0};  /* bytes produced by the operation */
+  Histogram queued_us;                 /* waiting for a libuv pool thread */
+  Histogram exec_us;                   /* running on the pool thread */
+  Histogram lock_wait_us;              /* waiting for the object's mutex */
+};
+
+OpStats& get(Op op);
+void reset();
+
+inline void add_bytes(Op op, uint64_t in, uint64_t out) {
+  if (enabled()) {
+    auto& s = get(op);
+    s.bytes_in.fetch_add(in, std::memory_order_relaxed);
+    s.bytes_out.fetch_add(out, std::memory_order_relaxed);
+  }
+}
+
+// A complete ("ph":"X") trace_events span.
+struct Span {
+  Op op;
+  uint64_t ts_us;
+  uint64_t dur_us;
+  uint64_t tid;
+};
+
+void add_span(Op op, uint64_t ts_us, uint64_t dur_us);
+// Drains the recorded spans as a trace_events JSON document, loadable in
+// chrome://tracing or Perfetto.
+std::string take_trace_json();
+
+// Follows one asynchronous operation from queueing to completion.
+class OpTrace {
+ public:
+  explicit OpTrace(Op op) : op_(op), queued_us_(enabled() ? now_us() : 0) {}
+
+  void start() {
+    if (queued_us_) start_us_ = now_us();
+  }
+  void finish(bool ok);
+
+ private:
+  Op op_;
+  uint64_t queued_us_;
+  uint64_t start_us_ = 0;
+};
+
+// std::lock_guard that records how long the lock took to acquire.
+class TimedLock {
+ public:
+  TimedLock(std::mutex& mu, Op op) : lock_(mu, std::defer_lock) {
+    if (!enabled()) {
+      lock_.lock();
+      return;
+    }
+    uint64_t t0 = now_us();
+    lock_.lock();
+    get(op).lock_wait_us.record(now_us() - t0);
+  }
+
+ private:
+  std::unique_lock<std::mutex> lock_;
+};
+
+}  // namespace stats
+
+#endif  // STATS_H
@@ -0,0 +1,84 @@
+#include "stats_api.h"
+
+#include "stats.h"
+
+namespace api {
+
+namespace {
+
+Napi::Object HistogramToObject(Napi::Env env, const stats::Histogram& h) {
+  auto obj = Napi::Object::New(env);
+  uint64_t count = h.count();
+  obj.Set("count", (double)count);
+  obj.Set("mean_us", count ? (double)h.sum() / count : 0.0);
+  obj.Set("p50_us", (double)h.percentile(0.5));
+  obj.Set("p99_us", (double)h.percentile(0.99));
+  obj.Set("max_us", (double)h.max());
+  return obj;
+}
+
+Napi::Value Stats(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  auto result = Napi::Object::New(env);
+  result.Set("enabled", stats::enabled());
+  result.Set("tracing", stats::tracing());
+
+  auto ops = Napi::Object::New(env);
+  for (int i = 0; i < (int)stats::Op::kCount; ++i) {
+    auto op = (stats::Op)i;
+    const auto& s = stats::get(op);
+    uint64_t count = s.ops.load();
+    if (count == 0) {
+      continue;
+    }
+    uint64_t in = s.bytes_in.load();
+    uint64_t out = s.bytes_out.load();
+    auto obj = Napi::Object::New(env);
+    obj.Set("ops", (double)count);
+    obj.Set("errors", (double)s.errors.load());
+    obj.Set("bytes_in", (double)in);
+    obj.Set("bytes_out", (double)out);
+    // uncompressed / compressed, whichever direction the operation goes
+    if (in && out) {
+      obj.Set("compression_ratio", in > out ? (double)in / out : (double)out / in);
+    }
+    obj.Set("queued", HistogramToObject(env, s.queued_us));
+    obj.Set("exec", HistogramToObject(env, s.exec_us));
+    obj.Set("lock_wait", HistogramToObject(env, s.lock_wait_us));
+    ops.Set(stats::op_name(op), obj);
+  }
+  result.Set("ops", ops);
+  return result;
+}
+
+Napi::Value StatsReset(const Napi::CallbackInfo& info) {
+  stats::reset();
+  return info.Env().Undefined();
+}
+
+Napi::Value SetStats(const Napi::CallbackInfo& info) {
+  stats::set_enabled(info.Length() < 1 || info[0].ToBoolean());
+  return info.Env().Undefined();
+}
+
+Napi::Value SetTracing(const Napi::CallbackInfo& info) {
+  stats::set_tracing(info.Length() < 1 || info[0].ToBoolean());
+  return info.Env().Undefined();
+}
+
+Napi::Value TraceEvents(const Napi::CallbackInfo& info) {
+  return Napi::String::New(info.Env(), stats::take_trace_json());
+}
+
+}  // namespace
+
+Napi::Object StatsAPI::Init(Napi::Env env, Napi::Object exports) {
+  exports.Set("stats", Napi::Function::New(env, Stats, "stats"));
+  exports.Set("stats_reset", Napi::Function::New(env, StatsReset, "stats_reset"));
+  exports.Set("set_stats", Napi::Function::New(env, SetStats, "set_stats"));
+  exports.Set("set_tracing", Napi::Function::New(env, SetTracing, "set_tracing"));
+  exports.Set("trace_events", Napi::Function::New(env, TraceEvents, "trace_events"));
+  return exports;
+}
+
+}  // namespace api
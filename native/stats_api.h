@@ -0,0 +1,17 @@
+#ifndef STATS_API_H
+#define STATS_API_H
+#pragma once
+
+#include <napi.h>
+
+namespace api {
+
+// mzip.stats(), mzip.stats_reset(), mzip.set_stats(on), mzip.set_tracing(on)
+// and mzip.trace_events().
+class StatsAPI {
+ public:
+  static Napi::Object Init(Napi::Env env, Napi::Object exports);
+};
+
+}  // namespace api
+#endif /* ifndef STATS_API_H */
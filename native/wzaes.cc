@@ -0,0 +1,226 @@
+#include "wzaes.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include <mz_crypt.h>
+
+#if defined(MZIP_HAVE_OPENSSL)
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#endif
+
+namespace ziputil {
+
+namespace {
+
+const int32_t kIterations = 1000;
+const size_t kBatchBlocks = 512;
+// Parts of one entry encrypted by separate threads; a multiple of the
+// block size.
+const size_t kSegmentSize = 1024 * 1024;
+
+}  // namespace
+
+void derive_aes_keys(const std::string& password, const uint8_t* salt, int32_t key_length,
+                     AesKeys& keys) {
+  uint8_t derived[2 * MZ_AES_KEY_LENGTH_MAX + kAesVerifierSize];
+  int32_t salt_length = key_length / 2;
+  int32_t derived_length = 2 * key_length + kAesVerifierSize;
+#if defined(MZIP_HAVE_OPENSSL)
+  bool ok = PKCS5_PBKDF2_HMAC_SHA1(password.data(), (int)password.size(), salt, salt_length,
+                                   kIterations, derived_length, derived) == 1;
+#else
+  bool ok = mz_crypt_pbkdf2((uint8_t*)password.data(), (int32_t)password.size(), (uint8_t*)salt,
+                            salt_length, kIterations, derived, derived_length) == MZ_OK;
+#endif
+  if (!ok) {
+    throw ZipException(MZ_CRYPT_ERROR, "key derivation failed");
+  }
+  keys.key_length = key_length;
+  memcpy(keys.aes, derived, key_length);
+  memcpy(keys.mac, derived + key_length, key_length);
+  memcpy(keys.verifier, derived + 2 * key_length, kAesVerifierSize);
+}
+
+void random_bytes(uint8_t* buf, int32_t len) {
+#if defined(MZIP_HAVE_OPENSSL)
+  bool ok = RAND_bytes(buf, len) == 1;
+#else
+  bool ok = mz_crypt_rand(buf, len) == len;
+#endif
+  if (!ok) {
+    throw ZipException(MZ_CRYPT_ERROR, "random source failed");
+  }
+}
+
+AesCtr::AesCtr(const uint8_t* key, int32_t key_length, uint64_t first_block)
+    : stream_(kBatchBlocks * MZ_AES_BLOCK_SIZE) {
+  used_ = stream_.size();
+  for (int i = 0; i < 8; ++i) {
+    counter_[i] = (uint8_t)(first_block >> (8 * i));
+  }
+#if defined(MZIP_HAVE_OPENSSL)
+  const EVP_CIPHER* cipher = key_length == 16   ? EVP_aes_128_ecb()
+                             : key_length == 24 ? EVP_aes_192_ecb()
+                                                : EVP_aes_256_ecb();
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  if (ctx == nullptr || EVP_EncryptInit_ex(ctx, cipher, nullptr, key, nullptr) != 1) {
+    EVP_CIPHER_CTX_free(ctx);
+    throw ZipException(MZ_CRYPT_ERROR, "AES key setup failed");
+  }
+  EVP_CIPHER_CTX_set_padding(ctx, 0);
+  cipher_ = ctx;
+#else
+  mz_crypt_aes_create(&cipher_);
+  mz_crypt_aes_set_mode(cipher_, (key_length - 8) / 8);
+  if (mz_crypt_aes_set_encrypt_key(cipher_, key, key_length) != MZ_OK) {
+    mz_crypt_aes_delete(&cipher_);
+    throw ZipException(MZ_CRYPT_ERROR, "AES key setup failed");
+  }
+#endif
+}
+
+AesCtr::~AesCtr() {
+#if defined(MZIP_HAVE_OPENSSL)
+  EVP_CIPHER_CTX_free(static_cast<EVP_CIPHER_CTX*>(cipher_));
+#else
+  mz_crypt_aes_delete(&cipher_);
+#endif
+}
+
+void AesCtr::apply(uint8_t* data, size_t len) {
+  while (len > 0) {
+    if (used_ == stream_.size()) {
+      refill();
+    }
+    size_t n = std::min(len, stream_.size() - used_);
+    const uint8_t* key = &stream_[used_];
+    for (size_t i = 0; i < n; ++i) {
+      data[i] ^= key[i];
+    }
+    data += n;
+    len -= n;
+    used_ += n;
+  }
+}
+
+void AesCtr::refill() {
+  for (size_t b = 0; b < kBatchBlocks; ++b) {
+    for (int i = 0; i < MZ_AES_BLOCK_SIZE && ++counter_[i] == 0; ++i) {
+    }
+    memcpy(&stream_[b * MZ_AES_BLOCK_SIZE], counter_, MZ_AES_BLOCK_SIZE);
+  }
+#if defined(MZIP_HAVE_OPENSSL)
+  int n = 0;
+  if (EVP_EncryptUpdate(static_cast<EVP_CIPHER_CTX*>(cipher_), stream_.data(), &n,
+                        stream_.data(), (int)stream_.size()) != 1 ||
+      n != (int)stream_.size()) {
+    throw ZipException(MZ_CRYPT_ERROR, "AES failed");
+  }
+#else
+  for (size_t b = 0; b < kBatchBlocks; ++b) {
+    mz_crypt_aes_encrypt(cipher_, &stream_[b * MZ_AES_BLOCK_SIZE], MZ_AES_BLOCK_SIZE);
+  }
+#endif
+  used_ = 0;
+}
+
+HmacSha1::HmacSha1(const uint8_t* key, int32_t key_length) {
+  mz_crypt_hmac_create(&hmac_);
+  mz_crypt_hmac_set_algorithm(hmac_, MZ_HASH_SHA1);
+  if (mz_crypt_hmac_init(hmac_, key, key_length) != MZ_OK) {
+    mz_crypt_hmac_delete(&hmac_);
+    throw ZipException(MZ_CRYPT_ERROR, "HMAC setup failed");
+  }
+}
+
+HmacSha1::~HmacSha1() { mz_crypt_hmac_delete(&hmac_); }
+
+void HmacSha1::update(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    int32_t n = (int32_t)std::min<size_t>(len, INT32_MAX);
+    mz_crypt_hmac_update(hmac_, data, n);
+    data += n;
+    len -= n;
+  }
+}
+
+void HmacSha1::end(uint8_t (&digest)[MZ_HASH_SHA1_SIZE]) {
+  mz_crypt_hmac_end(hmac_, digest, MZ_HASH_SHA1_SIZE);
+}
+
+void aes_encrypt(const AesKeys& keys, uint8_t* data, size_t len, unsigned threads,
+                 uint8_t (&mac)[kAesMacSize]) {
+  HmacSha1 hmac(keys.mac, keys.key_length);
+  size_t segments = (len + kSegmentSize - 1) / kSegmentSize;
+  if (threads < 2 || segments < 2) {
+    AesCtr ctr(keys.aes, keys.key_length);
+    ctr.apply(data, len);
+    hmac.update(data, len);
+  } else {
+    // Workers take segments in order; this thread authenticates each one
+    // as soon as it is encrypted, while the next ones still are.
+    std::mutex mu;
+    std::condition_variable cv;
+    std::vector<char> done(segments, 0);
+    std::exception_ptr error;
+    size_t next = 0;
+    auto work = [&]() {
+      for (;;) {
+        size_t i;
+        {
+          std::lock_guard<std::mutex> lock(mu);
+          if (next == segments || error) {
+            return;
+          }
+          i = next++;
+        }
+        try {
+          size_t n = std::min(kSegmentSize, len - i * kSegmentSize);
+          AesCtr ctr(keys.aes, keys.key_length, i * (kSegmentSize / MZ_AES_BLOCK_SIZE));
+          ctr.apply(data + i * kSegmentSize, n);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mu);
+          error = std::current_exception();
+        }
+        {
+          std::lock_guard<std::mutex> lock(mu);
+          done[i] = 1;
+        }
+        cv.notify_all();
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < std::min<size_t>(threads, segments); ++t) {
+      workers.emplace_back(work);
+    }
+    for (size_t i = 0; i < segments; ++i) {
+      {
+        std::unique_lock<std::mutex> lock(mu);
+        cv.wait(lock, [&] { return done[i] || error; });
+        if (error) {
+          break;
+        }
+      }
+      hmac.update(data + i * kSegmentSize, std::min(kSegmentSize, len - i * kSegmentSize));
+    }
+    for (auto& w : workers) {
+      w.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  uint8_t digest[MZ_HASH_SHA1_SIZE];
+  hmac.end(digest);
+  memcpy(mac, digest, kAesMacSize);
+}
+
+}  // namespace ziputil
@@ -0,0 +1,81 @@
+#ifndef WZAES_H
+#define WZAES_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "zip_common.h"
+
+namespace ziputil {
+
+// WinZip AES (AE-1/AE-2) building blocks. The payload of an entry is
+// salt | password verifier | ciphertext | first 10 bytes of HMAC-SHA1 over
+// the ciphertext.
+const int32_t kAesVerifierSize = 2;
+const int32_t kAesMacSize = 10;
+
+struct AesKeys {
+  int32_t key_length;
+  uint8_t aes[MZ_AES_KEY_LENGTH_MAX];
+  uint8_t mac[MZ_AES_KEY_LENGTH_MAX];
+  uint8_t verifier[kAesVerifierSize];
+};
+
+// PBKDF2-HMAC-SHA1 over 1000 rounds; throws ZipException.
+void derive_aes_keys(const std::string& password, const uint8_t* salt, int32_t key_length,
+                     AesKeys& keys);
+// Fills `buf` from the crypto backend's random source; throws ZipException.
+void random_bytes(uint8_t* buf, int32_t len);
+
+// WinZip's counter mode: the keystream is AES of a little-endian counter
+// that starts at 1. Keystream is made in batches of blocks, enough for
+// AES-NI to pipeline.
+class AesCtr {
+ public:
+  // Starts at keystream byte `first_block` * 16, so separate instances can
+  // cover separate parts of one entry.
+  AesCtr(const uint8_t* key, int32_t key_length, uint64_t first_block = 0);
+  ~AesCtr();
+
+  AesCtr(const AesCtr&) = delete;
+  AesCtr& operator=(const AesCtr&) = delete;
+
+  // Encrypts or decrypts in place.
+  void apply(uint8_t* data, size_t len);
+
+ private:
+  void refill();
+
+  uint8_t counter_[MZ_AES_BLOCK_SIZE] = {};
+  std::vector<uint8_t> stream_;
+  size_t used_;
+  void* cipher_ = nullptr;
+};
+
+class HmacSha1 {
+ public:
+  HmacSha1(const uint8_t* key, int32_t key_length);
+  ~HmacSha1();
+
+  HmacSha1(const HmacSha1&) = delete;
+  HmacSha1& operator=(const HmacSha1&) = delete;
+
+  void update(const uint8_t* data, size_t len);
+  void end(uint8_t (&digest)[MZ_HASH_SHA1_SIZE]);
+
+ private:
+  void* hmac_ = nullptr;
+};
+
+// Encrypts `data` in place for `keys`, on up to `threads` threads for large
+// inputs, and returns the authentication code computed over the result in
+// one pass.
+void aes_encrypt(const AesKeys& keys, uint8_t* data, size_t len, unsigned threads,
+                 uint8_t (&mac)[kAesMacSize]);
+
+}  // namespace ziputil
+#endif  // WZAES_H
@@ -0,0 +1,165 @@
+#include "wzaes_reader.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <zlib.h>
+
+namespace ziputil {
+
+namespace {
+
+const int32_t kChunkSize = 256 * 1024;
+
+}  // namespace
+
+std::shared_ptr<const AesKeys> AesKeyCache::get(const std::string& password,
+                                                 const uint8_t* salt, int32_t key_length) {
+  // Salts have a fixed length per key length, so this is unambiguous.
+  int32_t salt_length = key_length / 2;
+  std::string id(1, (char)key_length);
+  id.append(reinterpret_cast<const char*>(salt), salt_length);
+  id.append(password);
+  auto it = keys_.find(id);
+  if (it != keys_.end()) {
+    ++hits_;
+    return it->second;
+  }
+
+  ++misses_;
+  auto keys = std::make_shared<AesKeys>();
+  derive_aes_keys(password, salt, key_length, *keys);
+  if (keys_.size() >= capacity_) {
+    keys_.clear();
+  }
+  keys_.emplace(std::move(id), keys);
+  return keys;
+}
+
+bool WzAesReader::read(const mz_zip_file& info, const std::string& password,
+                       const std::function<bool(const char* data, int32_t len)>& sink) {
+  if (!(info.flag & MZ_ZIP_FLAG_ENCRYPTED) || info.aes_version == 0 ||
+      info.aes_encryption_mode < 1 || info.aes_encryption_mode > 3 ||
+      (info.compression_method != MZ_COMPRESS_METHOD_STORE &&
+       info.compression_method != MZ_COMPRESS_METHOD_DEFLATE)) {
+    return false;
+  }
+  int64_t payload = local_data_offset(stream(), info.disk_offset);
+  if (payload < 0) {
+    return false;
+  }
+  int32_t key_length = MZ_AES_KEY_LENGTH(info.aes_encryption_mode);
+  int32_t salt_length = key_length / 2;
+  int64_t body = info.compressed_size - salt_length - kAesVerifierSize - kAesMacSize;
+  if (body < 0) {
+    throw ZipException(MZ_FORMAT_ERROR, "truncated AES entry");
+  }
+
+  uint8_t header[MZ_AES_KEY_LENGTH_MAX / 2 + kAesVerifierSize];
+  read_at(stream(), payload, header, salt_length + kAesVerifierSize);
+  auto keys = keys_.get(password, header, key_length);
+  if (memcmp(keys->verifier, header + salt_length, kAesVerifierSize) != 0) {
+    throw ZipException(MZ_PASSWORD_ERROR, "wrong password");
+  }
+
+  AesCtr ctr(keys->aes, key_length);
+  HmacSha1 mac(keys->mac, key_length);
+  bool deflated = info.compression_method == MZ_COMPRESS_METHOD_DEFLATE;
+  z_stream zs = {};
+  if (deflated && inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+    throw ZipException(MZ_MEM_ERROR, "inflate init failed");
+  }
+  std::vector<uint8_t> in(kChunkSize);
+  std::vector<uint8_t> out(deflated ? kChunkSize : 0);
+  uLong crc = crc32(0, Z_NULL, 0);
+  int64_t total = 0;
+  bool stopped = false;
+  auto emit = [&](const uint8_t* data, size_t len) {
+    crc = crc32(crc, data, (uInt)len);
+    total += (int64_t)len;
+    stopped = !sink(reinterpret_cast<const char*>(data), (int32_t)len);
+  };
+
+  int64_t pos = payload + salt_length + kAesVerifierSize;
+  int ret = Z_OK;
+  try {
+    for (int64_t left = body; left > 0 && !stopped && ret != Z_STREAM_END;) {
+      int32_t n = (int32_t)std::min<int64_t>(left, kChunkSize);
+      read_at(stream(), pos, in.data(), n);
+      pos += n;
+      left -= n;
+      // The authentication code covers the ciphertext.
+      mac.update(in.data(), n);
+      ctr.apply(in.data(), n);
+      if (!deflated) {
+        emit(in.data(), n);
+        continue;
+      }
+      zs.next_in = in.data();
+      zs.avail_in = (uInt)n;
+      do {
+        zs.next_out = out.data();
+        zs.avail_out = (uInt)out.size();
+        ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+          throw ZipException(MZ_DATA_ERROR, "corrupt deflate stream");
+        }
+        size_t produced = out.size() - zs.avail_out;
+        if (produced > 0) {
+          emit(out.data(), produced);
+        } else if (ret == Z_BUF_ERROR) {
+          break;
+        }
+      } while (!stopped && ret != Z_STREAM_END && (zs.avail_in > 0 || zs.avail_out == 0));
+    }
+    if (deflated && !stopped && ret != Z_STREAM_END) {
+      throw ZipException(MZ_DATA_ERROR, "truncated deflate stream");
+    }
+  } catch (...) {
+    if (deflated) {
+      inflateEnd(&zs);
+    }
+    throw;
+  }
+  if (deflated) {
+    inflateEnd(&zs);
+  }
+  if (stopped) {
+    return true;
+  }
+
+  // A stream that ended early leaves ciphertext the code also covers.
+  for (int64_t end = payload + salt_length + kAesVerifierSize + body; pos < end;) {
+    int32_t n = (int32_t)std::min<int64_t>(end - pos, kChunkSize);
+    read_at(stream(), pos, in.data(), n);
+    mac.update(in.data(), n);
+    pos += n;
+  }
+  uint8_t expected[kAesMacSize];
+  uint8_t digest[MZ_HASH_SHA1_SIZE];
+  read_at(stream(), pos, expected, kAesMacSize);
+  mac.end(digest);
+  if (memcmp(digest, expected, kAesMacSize) != 0) {
+    throw ZipException(MZ_HASH_ERROR, "authentication code mismatch");
+  }
+  if (total != info.uncompressed_size) {
+    throw ZipException(MZ_DATA_ERROR, "entry size mismatch");
+  }
+  // AE-2 entries store no CRC.
+  if (info.aes_version != 2 && (uint32_t)crc != info.crc) {
+    throw ZipException(MZ_CRC_ERROR, "CRC mismatch");
+  }
+  return true;
+}
+
+void* WzAesReader::stream() {
+  if (mz_stream_is_open(file_) != MZ_OK &&
+      mz_stream_open(file_, archive_.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    throw ZipException(MZ_OPEN_ERROR, "opening archive failed");
+  }
+  return file_;
+}
+
+}  // namespace ziputil
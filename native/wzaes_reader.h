@@ -0,0 +1,63 @@
+#ifndef WZAES_READER_H
+#define WZAES_READER_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "wzaes.h"
+#include "zip_common.h"
+
+namespace ziputil {
+
+// Keys derived from a password and an entry salt with PBKDF2-HMAC-SHA1
+// (1000 rounds), which dominates reading small WinZip AES entries.
+class AesKeyCache {
+ public:
+  // Keeps at most `capacity` salts; a full cache starts over.
+  explicit AesKeyCache(size_t capacity = 4096) : capacity_(capacity) {}
+
+  std::shared_ptr<const AesKeys> get(const std::string& password, const uint8_t* salt,
+                                     int32_t key_length);
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  size_t capacity_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+  std::unordered_map<std::string, std::shared_ptr<const AesKeys>> keys_;
+};
+
+// WinZip AES entries (AE-1 and AE-2, stored or deflated) decoded from the
+// raw archive bytes instead of minizip's wzaes stream, so that keys come
+// from an AesKeyCache and the counter mode runs over whole batches of
+// blocks.
+class WzAesReader {
+ public:
+  explicit WzAesReader(const std::string& archive) : archive_(archive) {}
+
+  // Streams the plaintext of `info` through `sink` like
+  // ZipReader::readEntry. False, with nothing read, when the entry is not
+  // one this reader handles. Throws ZipException for a wrong password, a
+  // failed authentication code or CRC, and read errors.
+  bool read(const mz_zip_file& info, const std::string& password,
+            const std::function<bool(const char* data, int32_t len)>& sink);
+
+  const AesKeyCache& keys() const { return keys_; }
+
+ private:
+  void* stream();
+
+  std::string archive_;
+  MzOsStream file_;
+  AesKeyCache keys_;
+};
+
+}  // namespace ziputil
+#endif  // WZAES_READER_H
@@ -8,4 +8,23 @@ ZipException::ZipException(int code, const std::string& message) : code_(code) {
   message_ = fmt::format("zip error: {} code: {}", message, code);
 }
 
+void read_at(void* stream, int64_t offset, void* buf, int32_t len) {
+  if (mz_stream_seek(stream, offset, MZ_SEEK_SET) != MZ_OK ||
+      mz_stream_read(stream, buf, len) != len) {
+    throw ZipException(MZ_READ_ERROR, "reading archive failed");
+  }
+}
+
+int64_t local_data_offset(void* stream, int64_t disk_offset) {
+  if (disk_offset < 0) {
+    return -1;
+  }
+  uint8_t header[kLocalHeaderSize];
+  read_at(stream, disk_offset, header, kLocalHeaderSize);
+  if (read_u32(header) != kLocalHeaderMagic) {
+    return -1;
+  }
+  return disk_offset + kLocalHeaderSize + read_u16(header + 26) + read_u16(header + 28);
+}
+
 }  // namespace ziputil
@@ -4,14 +4,35 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <utility>
 
 #include <mz.h>
 #include <mz_os.h>
 #include <mz_strm.h>
+#include <mz_strm_os.h>
 #include <mz_zip.h>
 #include <mz_zip_rw.h>
 
 namespace ziputil {
+
+const uint32_t kLocalHeaderMagic = 0x04034b50;
+const uint32_t kDataDescriptorMagic = 0x08074b50;
+const uint32_t kCentralHeaderMagic = 0x02014b50;
+const uint32_t kEndOfCentralDirMagic = 0x06054b50;
+const uint32_t kZip64EndOfCentralDirMagic = 0x06064b50;
+const uint16_t kZip64ExtraId = 0x0001;
+const uint16_t kAesExtraId = 0x9901;
+const int32_t kLocalHeaderSize = 30;
+
+// Little-endian field access for zip records.
+inline uint16_t read_u16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+inline uint32_t read_u32(const uint8_t* p) {
+  return read_u16(p) | ((uint32_t)read_u16(p + 2) << 16);
+}
+inline uint64_t read_u64(const uint8_t* p) {
+  return read_u32(p) | ((uint64_t)read_u32(p + 4) << 32);
+}
+
 class ZipException : public std::exception {
  public:
   ZipException(int code, const std::string& message);
@@ -89,5 +110,34 @@ class MzWriterHandle {
   void* writer;
 };
 
+class MzOsStream {
+ public:
+  MzOsStream() : stream(nullptr) { mz_stream_os_create(&stream); }
+
+  ~MzOsStream() {
+    if (stream) {
+      if (mz_stream_is_open(stream) == MZ_OK) {
+        mz_stream_close(stream);
+      }
+      mz_stream_os_delete(&stream);
+    }
+  }
+
+  MzOsStream(const MzOsStream&) = delete;
+  MzOsStream& operator=(const MzOsStream&) = delete;
+
+  operator void*() { return stream; }
+
+ private:
+  void* stream;
+};
+
+// Reads exactly `len` bytes at `offset` of an open stream; throws
+// ZipException.
+void read_at(void* stream, int64_t offset, void* buf, int32_t len);
+// Offset of the data behind the local header at `disk_offset`, -1 when there
+// is no local header there.
+int64_t local_data_offset(void* stream, int64_t disk_offset);
+
 }  // namespace ziputil
 #endif /* ifndef ZIP_COMMON_H */
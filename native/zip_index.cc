@@ -0,0 +1,430 @@
+#include "zip_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <tuple>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "glob_matcher.h"
+#include "zip_reader.h"
+
+namespace ziputil {
+
+namespace {
+
+const char kIndexMagic[8] = {'M', 'Z', 'I', 'D', 'X', '0', '0', '1'};
+// End of central directory record plus the longest possible comment.
+const int64_t kTailSize = 22 + 0xFFFF;
+
+enum EntryFlags : uint16_t { kEncrypted = 1, kDirectory = 2, kSymlink = 4 };
+
+// On-disk layout, little-endian, every section 8-byte aligned.
+struct IndexHeader {
+  char magic[8];
+  uint64_t archive_size;
+  int64_t archive_mtime;
+  uint64_t tail_hash;
+  uint32_t entry_count;
+  uint32_t node_count;
+  uint32_t child_count;
+  uint32_t reserved;
+  uint64_t entries_offset;
+  uint64_t hashes_offset;
+  uint64_t nodes_offset;
+  uint64_t children_offset;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+};
+
+struct IndexEntry {
+  uint32_t name;
+  uint32_t name_len;
+  uint32_t linkname;
+  uint32_t linkname_len;
+  uint32_t comment;
+  uint32_t comment_len;
+  int64_t compressed_size;
+  int64_t uncompressed_size;
+  int64_t disk_offset;
+  int64_t modified_date;
+  int64_t accessed_date;
+  int64_t creation_date;
+  uint32_t crc;
+  uint32_t external_fa;
+  uint16_t compression_method;
+  uint16_t version_madeby;
+  uint16_t flags;
+  uint16_t reserved;
+};
+
+struct IndexHash {
+  uint64_t hash; /* of the case-folded name */
+  uint32_t entry;
+  uint32_t reserved;
+};
+
+struct IndexNode {
+  uint32_t name;
+  uint32_t name_len;
+  int32_t parent;
+  int32_t entry;
+  uint32_t children; /* first index into the children section */
+  uint32_t child_count;
+  uint32_t is_directory;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(IndexHeader) == 96, "index header layout");
+static_assert(sizeof(IndexEntry) == 88, "index entry layout");
+static_assert(sizeof(IndexHash) == 16, "index hash layout");
+static_assert(sizeof(IndexNode) == 32, "index node layout");
+
+uint64_t fnv1a(const void* data, size_t len, uint64_t hash = 14695981039346656037ULL) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ p[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t align8(uint64_t n) { return (n + 7) & ~(uint64_t)7; }
+
+bool inFile(uint64_t offset, uint64_t count, size_t item, size_t file_size) {
+  return offset <= file_size && count <= (file_size - offset) / item;
+}
+
+class StringTable {
+ public:
+  std::pair<uint32_t, uint32_t> add(const std::string& s) {
+    if (data_.size() + s.size() > UINT32_MAX) {
+      throw ZipException(MZ_PARAM_ERROR, "index string table too large");
+    }
+    uint32_t offset = (uint32_t)data_.size();
+    data_ += s;
+    return {offset, (uint32_t)s.size()};
+  }
+  const std::string& data() const { return data_; }
+
+ private:
+  std::string data_;
+};
+
+}  // namespace
+
+ArchiveStamp ArchiveStamp::of(const std::string& archive) {
+  ArchiveStamp stamp;
+  MzOsStream stream;
+  if (mz_stream_open(stream, archive.c_str(), MZ_OPEN_MODE_READ) != MZ_OK ||
+      mz_stream_seek(stream, 0, MZ_SEEK_END) != MZ_OK) {
+    throw ZipException(MZ_OPEN_ERROR, "opening archive failed");
+  }
+  int64_t size = mz_stream_tell(stream);
+  int64_t tail = std::min(size, kTailSize);
+  std::vector<uint8_t> buf((size_t)tail);
+  if (mz_stream_seek(stream, size - tail, MZ_SEEK_SET) != MZ_OK ||
+      mz_stream_read(stream, buf.data(), (int32_t)tail) != (int32_t)tail) {
+    throw ZipException(MZ_READ_ERROR, "read archive failed");
+  }
+
+  time_t modified = 0, accessed = 0, creation = 0;
+  mz_os_get_file_date(archive.c_str(), &modified, &accessed, &creation);
+  stamp.size = (uint64_t)size;
+  stamp.mtime = (int64_t)modified;
+  stamp.tail_hash = fnv1a(buf.data(), buf.size());
+  return stamp;
+}
+
+// Read-only view of the whole index file: mmap on POSIX, a heap copy on
+// Windows.
+class ZipIndex::MappedFile {
+ public:
+  bool open(const std::string& path) {
+#if defined(_WIN32)
+    MzOsStream stream;
+    if (mz_stream_open(stream, path.c_str(), MZ_OPEN_MODE_READ) != MZ_OK ||
+        mz_stream_seek(stream, 0, MZ_SEEK_END) != MZ_OK) {
+      return false;
+    }
+    int64_t size = mz_stream_tell(stream);
+    if (size <= 0 || mz_stream_seek(stream, 0, MZ_SEEK_SET) != MZ_OK) {
+      return false;
+    }
+    buffer_.resize((size_t)size);
+    size_t done = 0;
+    while (done < buffer_.size()) {
+      int32_t n = mz_stream_read(stream, &buffer_[done],
+                                 (int32_t)std::min<size_t>(buffer_.size() - done, INT32_MAX));
+      if (n <= 0) {
+        return false;
+      }
+      done += n;
+    }
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    return true;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+      ::close(fd);
+      return false;
+    }
+    void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    data_ = static_cast<const uint8_t*>(p);
+    size_ = (size_t)st.st_size;
+    return true;
+#endif
+  }
+
+  ~MappedFile() {
+#if !defined(_WIN32)
+    if (data_) {
+      munmap(const_cast<uint8_t*>(data_), size_);
+    }
+#endif
+  }
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+#if defined(_WIN32)
+  std::vector<uint8_t> buffer_;
+#endif
+};
+
+ZipIndex::~ZipIndex() = default;
+
+std::unique_ptr<ZipIndex> ZipIndex::load(const std::string& path, const ArchiveStamp& stamp) {
+  std::unique_ptr<ZipIndex> index(new ZipIndex());
+  index->file_.reset(new MappedFile());
+  if (!index->file_->open(path)) {
+    return nullptr;
+  }
+  index->base_ = index->file_->data();
+  index->size_ = index->file_->size();
+  if (index->size_ < sizeof(IndexHeader)) {
+    return nullptr;
+  }
+
+  const auto* h = reinterpret_cast<const IndexHeader*>(index->base_);
+  if (memcmp(h->magic, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+      h->archive_size != stamp.size || h->archive_mtime != stamp.mtime ||
+      h->tail_hash != stamp.tail_hash) {
+    return nullptr;
+  }
+  size_t size = index->size_;
+  if (!inFile(h->entries_offset, h->entry_count, sizeof(IndexEntry), size) ||
+      !inFile(h->hashes_offset, h->entry_count, sizeof(IndexHash), size) ||
+      !inFile(h->nodes_offset, h->node_count, sizeof(IndexNode), size) ||
+      !inFile(h->children_offset, h->child_count, sizeof(uint32_t), size) ||
+      !inFile(h->strings_offset, h->strings_size, 1, size) || h->node_count == 0) {
+    return nullptr;
+  }
+  return index;
+}
+
+void ZipIndex::write(const std::string& path, const ArchiveStamp& stamp,
+                     const std::vector<ZipEntry>& entries, const ZipTree& tree) {
+  StringTable strings;
+  std::vector<IndexEntry> records;
+  std::vector<IndexHash> hashes;
+  records.reserve(entries.size());
+  hashes.reserve(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const ZipEntry& e = entries[i];
+    IndexEntry r = IndexEntry();
+    std::tie(r.name, r.name_len) = strings.add(e.name);
+    std::tie(r.linkname, r.linkname_len) = strings.add(e.linkname);
+    std::tie(r.comment, r.comment_len) = strings.add(e.comment);
+    r.compressed_size = e.compressed_size;
+    r.uncompressed_size = e.uncompressed_size;
+    r.disk_offset = e.disk_offset;
+    r.modified_date = e.modified_date;
+    r.accessed_date = e.accessed_date;
+    r.creation_date = e.creation_date;
+    r.crc = e.crc;
+    r.external_fa = e.external_fa;
+    r.compression_method = e.compression_method;
+    r.version_madeby = e.version_madeby;
+    r.flags = (e.is_encrypted ? kEncrypted : 0) | (e.is_directory ? kDirectory : 0) |
+              (e.is_symlink ? kSymlink : 0);
+    records.push_back(r);
+
+    std::string folded = GlobMatcher::fold(e.name);
+    hashes.push_back(IndexHash{fnv1a(folded.data(), folded.size()), (uint32_t)i, 0});
+  }
+  std::sort(hashes.begin(), hashes.end(), [](const IndexHash& a, const IndexHash& b) {
+    return a.hash < b.hash || (a.hash == b.hash && a.entry < b.entry);
+  });
+
+  std::vector<IndexNode> nodes;
+  std::vector<uint32_t> children;
+  for (size_t i = 0; i < tree.size(); ++i) {
+    const ZipTree::Node& n = tree.node((uint32_t)i);
+    IndexNode r = IndexNode();
+    std::tie(r.name, r.name_len) = strings.add(n.name);
+    r.parent = n.parent;
+    r.entry = n.entry;
+    r.children = (uint32_t)children.size();
+    r.child_count = (uint32_t)n.children.size();
+    r.is_directory = n.is_directory;
+    children.insert(children.end(), n.children.begin(), n.children.end());
+    nodes.push_back(r);
+  }
+
+  IndexHeader h = IndexHeader();
+  memcpy(h.magic, kIndexMagic, sizeof(kIndexMagic));
+  h.archive_size = stamp.size;
+  h.archive_mtime = stamp.mtime;
+  h.tail_hash = stamp.tail_hash;
+  h.entry_count = (uint32_t)records.size();
+  h.node_count = (uint32_t)nodes.size();
+  h.child_count = (uint32_t)children.size();
+  h.entries_offset = sizeof(IndexHeader);
+  h.hashes_offset = align8(h.entries_offset + records.size() * sizeof(IndexEntry));
+  h.nodes_offset = align8(h.hashes_offset + hashes.size() * sizeof(IndexHash));
+  h.children_offset = align8(h.nodes_offset + nodes.size() * sizeof(IndexNode));
+  h.strings_offset = align8(h.children_offset + children.size() * sizeof(uint32_t));
+  h.strings_size = strings.data().size();
+
+  std::string tmp = path + ".tmp";
+  {
+    MzOsStream stream;
+    if (mz_stream_open(stream, tmp.c_str(), MZ_OPEN_MODE_WRITE | MZ_OPEN_MODE_CREATE) != MZ_OK) {
+      throw ZipException(MZ_OPEN_ERROR, "create index failed");
+    }
+    uint64_t pos = 0;
+    auto put = [&](uint64_t offset, const void* data, size_t len) {
+      static const char kZero[8] = {0};
+      if (offset > pos) {
+        mz_stream_write(stream, kZero, (int32_t)(offset - pos));
+        pos = offset;
+      }
+      const char* p = static_cast<const char*>(data);
+      while (len > 0) {
+        int32_t n = (int32_t)std::min<size_t>(len, INT32_MAX);
+        if (mz_stream_write(stream, p, n) != n) {
+          throw ZipException(MZ_WRITE_ERROR, "write index failed");
+        }
+        p += n;
+        len -= n;
+        pos += n;
+      }
+    };
+    put(0, &h, sizeof(h));
+    put(h.entries_offset, records.data(), records.size() * sizeof(IndexEntry));
+    put(h.hashes_offset, hashes.data(), hashes.size() * sizeof(IndexHash));
+    put(h.nodes_offset, nodes.data(), nodes.size() * sizeof(IndexNode));
+    put(h.children_offset, children.data(), children.size() * sizeof(uint32_t));
+    put(h.strings_offset, strings.data().data(), strings.data().size());
+  }
+  if (mz_os_rename(tmp.c_str(), path.c_str()) != MZ_OK) {
+    mz_os_unlink(tmp.c_str());
+    throw ZipException(MZ_WRITE_ERROR, "rename index failed");
+  }
+}
+
+size_t ZipIndex::count() const {
+  return reinterpret_cast<const IndexHeader*>(base_)->entry_count;
+}
+
+std::string ZipIndex::str(uint32_t offset, uint32_t len) const {
+  const auto* h = reinterpret_cast<const IndexHeader*>(base_);
+  if ((uint64_t)offset + len > h->strings_size) {
+    throw ZipException(MZ_FORMAT_ERROR, "corrupt index");
+  }
+  return std::string(reinterpret_cast<const char*>(base_ + h->strings_offset + offset), len);
+}
+
+void ZipIndex::entries(std::vector<ZipEntry>& out) const {
+  const auto* h = reinterpret_cast<const IndexHeader*>(base_);
+  const auto* records = reinterpret_cast<const IndexEntry*>(base_ + h->entries_offset);
+  out.clear();
+  out.reserve(h->entry_count);
+  for (uint32_t i = 0; i < h->entry_count; ++i) {
+    const IndexEntry& r = records[i];
+    out.emplace_back(ZipEntry{
+        str(r.name, r.name_len),
+        str(r.linkname, r.linkname_len),
+        r.compressed_size,
+        r.uncompressed_size,
+        (r.flags & kEncrypted) != 0,
+        (r.flags & kDirectory) != 0,
+        (r.flags & kSymlink) != 0,
+        r.crc,
+        str(r.comment, r.comment_len),
+        (time_t)r.modified_date,
+        (time_t)r.accessed_date,
+        (time_t)r.creation_date,
+        r.compression_method,
+        r.disk_offset,
+        r.external_fa,
+        r.version_madeby,
+    });
+  }
+}
+
+void ZipIndex::nodes(std::vector<ZipTree::Node>& out) const {
+  const auto* h = reinterpret_cast<const IndexHeader*>(base_);
+  const auto* records = reinterpret_cast<const IndexNode*>(base_ + h->nodes_offset);
+  const auto* children = reinterpret_cast<const uint32_t*>(base_ + h->children_offset);
+  out.clear();
+  out.reserve(h->node_count);
+  for (uint32_t i = 0; i < h->node_count; ++i) {
+    const IndexNode& r = records[i];
+    // Parents precede their children, as ZipTree::build creates them.
+    if ((r.parent >= (int32_t)i) || (i > 0 && r.parent < 0) ||
+        r.entry >= (int32_t)h->entry_count ||
+        (uint64_t)r.children + r.child_count > h->child_count) {
+      throw ZipException(MZ_FORMAT_ERROR, "corrupt index");
+    }
+    ZipTree::Node node{str(r.name, r.name_len), r.parent, r.entry, r.is_directory != 0,
+                       std::vector<uint32_t>(children + r.children,
+                                             children + r.children + r.child_count)};
+    for (auto c : node.children) {
+      if (c <= i || c >= h->node_count) {
+        throw ZipException(MZ_FORMAT_ERROR, "corrupt index");
+      }
+    }
+    out.push_back(std::move(node));
+  }
+}
+
+int64_t ZipIndex::lookup(const std::string& name) const {
+  const auto* h = reinterpret_cast<const IndexHeader*>(base_);
+  const auto* hashes = reinterpret_cast<const IndexHash*>(base_ + h->hashes_offset);
+  const auto* records = reinterpret_cast<const IndexEntry*>(base_ + h->entries_offset);
+  std::string folded = GlobMatcher::fold(name);
+  uint64_t hash = fnv1a(folded.data(), folded.size());
+  auto it = std::lower_bound(hashes, hashes + h->entry_count, hash,
+                             [](const IndexHash& a, uint64_t value) { return a.hash < value; });
+  for (; it != hashes + h->entry_count && it->hash == hash; ++it) {
+    if (it->entry >= h->entry_count) {
+      break;
+    }
+    const IndexEntry& r = records[it->entry];
+    if (r.name_len == name.size() && GlobMatcher::fold(str(r.name, r.name_len)) == folded) {
+      return it->entry;
+    }
+  }
+  return -1;
+}
+
+}  // namespace ziputil
@@ -0,0 +1,68 @@
+#ifndef ZIP_INDEX_H
+#define ZIP_INDEX_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zip_tree.h"
+
+namespace ziputil {
+
+struct ZipEntry;
+
+// Identifies one version of an archive without reading its central
+// directory: size, modification time and a hash of the archive tail, which
+// holds the end of central directory records.
+struct ArchiveStamp {
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  uint64_t tail_hash = 0;
+
+  // Throws ZipException when the archive can not be read.
+  static ArchiveStamp of(const std::string& archive);
+  bool operator==(const ArchiveStamp& other) const {
+    return size == other.size && mtime == other.mtime && tail_hash == other.tail_hash;
+  }
+};
+
+// Sidecar index of an immutable archive: fixed-size entry records, name
+// hashes sorted for binary search, the directory tree and a string table,
+// in one file that is memory-mapped as is.
+class ZipIndex {
+ public:
+  ~ZipIndex();
+
+  // Maps the index at `path` if it exists, is well formed and was written
+  // for `stamp`; nullptr otherwise.
+  static std::unique_ptr<ZipIndex> load(const std::string& path, const ArchiveStamp& stamp);
+  // Writes through a temporary file renamed into place; throws ZipException.
+  static void write(const std::string& path, const ArchiveStamp& stamp,
+                    const std::vector<ZipEntry>& entries, const ZipTree& tree);
+
+  size_t count() const;
+  // Both throw ZipException when a record points outside the file.
+  void entries(std::vector<ZipEntry>& out) const;
+  void nodes(std::vector<ZipTree::Node>& out) const;
+
+  // Index of the entry named `name`, compared like mz_path_compare with
+  // ignore_case, or -1.
+  int64_t lookup(const std::string& name) const;
+
+ private:
+  class MappedFile;
+
+  ZipIndex() = default;
+  std::string str(uint32_t offset, uint32_t len) const;
+
+  std::unique_ptr<MappedFile> file_;
+  const uint8_t* base_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace ziputil
+#endif  // ZIP_INDEX_H
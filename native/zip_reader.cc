@@ -1,14 +1,41 @@
 #include "zip_reader.h"
 
 #include <stdint.h>
+#include <string.h>
 #include <algorithm>
+#include <thread>
+#include <unordered_set>
 
+#include <fmt/core.h>
+#include <zlib.h>
+
+#include "extract_pipeline.h"
+#include "file_writer.h"
+#include "glob_matcher.h"
 #include "fs_util.h"
+#include "range_reader.h"
+#include "solid_index.h"
+#include "wzaes_reader.h"
+#include "stats.h"
+#include "zip_verifier.h"
+#include "zstd_dict.h"
 
 namespace ziputil {
 
 using namespace fs_util;
 
+namespace {
+
+const int32_t kReadChunkSize = 256 * 1024;
+// Bytes of inflate windows readRange keeps for checkpoints.
+const size_t kCheckpointCacheLimit = 64 * 1024 * 1024;
+// Decompressed solid blocks kept for reads of their neighbours.
+const size_t kBlockCacheLimit = 32 * 1024 * 1024;
+
+}  // namespace
+
+ZipReader::ZipReader() = default;
+
 ZipReader::ZipReader(const std::string &filename) { open(filename, ""); }
 
 ZipReader::~ZipReader() { close(); }
@@ -18,23 +45,116 @@ void ZipReader::close() {
   if (mz_zip_reader_is_open(reader_) == MZ_OK) {
     mz_zip_reader_close(reader_);
   }
+  // Readers with a handle of their own on the archive.
+  ranges_.reset();
+  aes_.reset();
+  zstd_.reset();
 }
 
-bool ZipReader::open(const std::string &filename, const std::string &password) {
-  mz_zip_file *file_info = NULL;
-  int32_t err = MZ_OK;
-  std::vector<ZipEntry> files;
-
+bool ZipReader::open(const std::string &filename, const std::string &password,
+                     const ReaderOptions &options) {
   close();
+  index_.reset();
+  ranges_.reset();
+  aes_.reset();
+  dictionary_.reset();
+  zstd_.reset();
+  solid_.reset();
+  blocks_.reset();
+
+  // A valid sidecar index replaces the central directory walk; the stamp
+  // only reads the archive tail.
+  ArchiveStamp stamp;
+  if (!options.index.empty()) {
+    stamp = ArchiveStamp::of(filename);
+    index_ = ZipIndex::load(options.index, stamp);
+  }
 
   password_ = password;
+  max_read_size_ = options.max_read_size;
+  checkpoint_span_ = options.checkpoint_span;
   mz_zip_reader_set_password(reader_, password_.c_str());
-  err = mz_zip_reader_open_file(reader_, filename.c_str());
+  int32_t err = mz_zip_reader_open_file(reader_, filename.c_str());
   if (err != MZ_OK) {
     throw ZipException(err, "opening archive failed");
   }
 
-  err = mz_zip_reader_goto_first_entry(reader_);
+  bool indexed = false;
+  if (index_) {
+    try {
+      std::vector<ZipTree::Node> nodes;
+      index_->entries(entries_);
+      index_->nodes(nodes);
+      tree_.assign(std::move(nodes));
+      indexed = true;
+    } catch (const ZipException &) {
+      index_.reset();  // corrupt: fall back to the central directory
+    }
+  }
+  if (!indexed) {
+    readEntries(entries_);
+    tree_.build(entries_);
+    if (!options.index.empty()) {
+      try {
+        ZipIndex::write(options.index, stamp, entries_, tree_);
+      } catch (const ZipException &) {
+        // Best effort, e.g. a read-only directory.
+      }
+    }
+  }
+
+  folded_names_.clear();
+  sorted_.clear();
+  filename_ = filename;
+  is_open_ = true;
+
+  // Written with a dictionary: it is needed for every zstd entry.
+  int32_t node = tree_.find(kDictionaryEntry);
+  if (node != ZipTree::kNone && tree_.node(node).entry != ZipTree::kNone) {
+    std::string content;
+    readEntry(kDictionaryEntry, [&](const char *buf, int32_t len) {
+      content.append(buf, len);
+      return true;
+    });
+    try {
+      dictionary_ = std::make_shared<const ZstdDictionary>(std::move(content));
+    } catch (const ZipException &) {
+      // Some other file by that name; its zstd entries are plain ones.
+    }
+  }
+
+  node = tree_.find(kSolidIndexEntry);
+  if (node != ZipTree::kNone && tree_.node(node).entry != ZipTree::kNone) {
+    std::string index;
+    readEntry(kSolidIndexEntry, [&](const char *buf, int32_t len) {
+      index.append(buf, len);
+      return true;
+    });
+    solid_.reset(new SolidIndex(decode_solid_index(index)));
+    blocks_.reset(new BlockCache(kBlockCacheLimit));
+  }
+
+  directory_.clear();
+  if (dictionary_ || solid_) {
+    std::vector<ZipEntry> listed;
+    listed.reserve(entries_.size());
+    for (auto &e : entries_) {
+      if (!isInternal(e.name)) {
+        listed.push_back(e);
+      }
+    }
+    directory_.swap(entries_);
+    entries_.swap(listed);
+    tree_.build(entries_);
+  }
+  return true;
+}
+
+void ZipReader::readEntries(std::vector<ZipEntry> &files) {
+  mz_zip_file *file_info = NULL;
+  files.clear();
+
+  int32_t err = mz_zip_reader_goto_first_entry(reader_);
   if (err != MZ_OK && err != MZ_END_OF_LIST) {
     throw ZipException(err, "read archive failed");
   }
@@ -49,7 +169,7 @@ bool ZipReader::open(const std::string &filename, const std::string &password) {
     files.emplace_back(ZipEntry{
         file_info->filename,
         file_info->linkname ? file_info->linkname : "",
-        file_info->comment_size,
+        file_info->compressed_size,
         file_info->uncompressed_size,
         (file_info->flag & MZ_ZIP_FLAG_ENCRYPTED) == MZ_ZIP_FLAG_ENCRYPTED,
         mz_zip_attrib_is_dir(file_info->external_fa, file_info->version_madeby) == MZ_OK,
@@ -59,6 +179,10 @@ bool ZipReader::open(const std::string &filename, const std::string &password) {
         file_info->modified_date,
         file_info->accessed_date,
         file_info->creation_date,
+        file_info->compression_method,
+        file_info->disk_number == 0 ? file_info->disk_offset : -1,
+        file_info->external_fa,
+        file_info->version_madeby,
     });
 
     err = mz_zip_reader_goto_next_entry(reader_);
@@ -69,13 +193,16 @@ bool ZipReader::open(const std::string &filename, const std::string &password) {
 
   if (err != MZ_END_OF_LIST)
     throw ZipException(err, "read entry info failed");
-
-  entries_ = std::move(files);
-  is_open_ = true;
-  return true;
 }
 
 bool ZipReader::exists(const std::string &filename) {
+  if (findSolid(filename)) {
+    return true;
+  }
+  // The sidecar index also lists the internal entries.
+  if (index_ && directory_.empty()) {
+    return index_->lookup(filename) >= 0;
+  }
   return std::find_if(std::cbegin(entries_), std::cend(entries_), [&](auto &e) {
            return e.name.size() == filename.size() && mz_zip_path_compare(e.name.c_str(), filename.c_str(), 1) == 0;
          }) != entries_.end();
@@ -92,60 +219,505 @@ bool ZipReader::extractTo(const std::string &filename,
 }
 
 size_t ZipReader::extractAll(const std::string &outDir,
-                             const std::string &pattern) {
-  size_t cnt = 0;
-  std::for_each(entries_.cbegin(), entries_.cend(), [&](auto &p) {
-    if (pattern.empty() ||
-        mz_path_compare_wc(p.name.c_str(), pattern.c_str(), 1) == 0) {
-      if (this->extractTo(p.name, outDir)) {
-        ++cnt;
+                             const std::string &pattern,
+                             const ExtractOptions &extract_options) {
+  std::vector<std::string> include = extract_options.include;
+  if (!pattern.empty()) {
+    include.push_back(pattern);
+  }
+  GlobMatcher matcher(include, extract_options.exclude);
+  bool everything = include.empty() && extract_options.exclude.empty();
+  std::vector<const ZipEntry *> selected;
+  if (everything) {
+    for (auto &p : entries_) {
+      selected.push_back(&p);
+    }
+  } else {
+    selected = select(matcher);
+  }
+  std::vector<const SolidFile *> solid;
+  if (solid_) {
+    // In index order, which is block order, so each block inflates once.
+    for (auto &f : solid_->files()) {
+      if (everything || matcher.matches(GlobMatcher::fold(f.name))) {
+        solid.push_back(&f);
       }
     }
-  });
+  }
+
+  std::unordered_set<std::string> dirs;
+  // Collect every directory the extraction needs, ancestors included.
+  auto add_dirs = [&](const std::string &name, bool is_directory) {
+    auto end = is_directory ? name.find_last_not_of("/\\") + 1 : name.find_last_of("/\\");
+    std::string dir = end == std::string::npos ? std::string() : name.substr(0, end);
+    while (!dir.empty() && dirs.insert(dir).second) {
+      auto sep = dir.find_last_of("/\\");
+      dir = sep == std::string::npos ? std::string() : dir.substr(0, sep);
+    }
+  };
+  for (auto *entry : selected) {
+    add_dirs(entry->name, entry->is_directory);
+  }
+  for (auto *f : solid) {
+    add_dirs(f->name, false);
+  }
+
+  // All directories are created up front, so entries are saved without the
+  // per-file parent lookup and mkdir of mz_zip_reader_entry_save_file.
+  std::vector<std::string> dir_list(dirs.begin(), dirs.end());
+  unsigned threads = std::max(1u, std::min(8u, std::thread::hardware_concurrency()));
+  if (!fs_util::make_dir_set(outDir, dir_list, threads)) {
+    throw ZipException(MZ_WRITE_ERROR, "create directories failed");
+  }
+
+  // Plain entries go through the read/inflate/write pipeline; encrypted,
+  // symlink and oversized entries keep the serial minizip path.
+  size_t cnt = 0;
+  std::vector<const ZipEntry *> serial;
+  std::vector<ExtractJob> jobs;
+  PipelineOptions options;
+  options.threads = threads;
+  options.sparse = extract_options.sparse;
+  ExtractPipeline pipeline(filename_, options);
+  for (auto *p : selected) {
+    if (p->is_directory) {
+      ++cnt;
+    } else if (pipeline.supports(*p)) {
+      jobs.push_back(ExtractJob{p, fs_util::join(outDir, p->name)});
+    } else {
+      serial.push_back(p);
+    }
+  }
+  if (!jobs.empty() && !pipeline.aligned(*jobs.front().entry)) {
+    for (auto &job : jobs) {
+      serial.push_back(job.entry);
+    }
+    jobs.clear();
+  }
+  if (!jobs.empty()) {
+    cnt += pipeline.run(std::move(jobs));
+  }
+
+  for (auto *p : serial) {
+    if (this->extractEntry(p->name, fs_util::join(outDir, p->name),
+                           stats::Op::kExtractAll, false, extract_options)) {
+      ++cnt;
+    }
+  }
+  for (auto *f : solid) {
+    if (extractSolid(f->name, fs_util::join(outDir, f->name), stats::Op::kExtractAll, false,
+                     extract_options)) {
+      ++cnt;
+    }
+  }
+
+  // Directory dates and attributes last, deepest first: writing a file
+  // touches its parent's date, and a read-only parent refuses new files.
+  std::vector<const ZipEntry *> dir_entries;
+  for (auto *p : selected) {
+    if (p->is_directory) {
+      dir_entries.push_back(p);
+    }
+  }
+  auto depth = [](const ZipEntry *p) {
+    return std::count_if(p->name.begin(), p->name.end(),
+                         [](char c) { return c == '/' || c == '\\'; });
+  };
+  std::stable_sort(dir_entries.begin(), dir_entries.end(),
+                   [&](const ZipEntry *a, const ZipEntry *b) { return depth(a) > depth(b); });
+  for (auto *p : dir_entries) {
+    std::string name = p->name.substr(0, p->name.find_last_not_of("/\\") + 1);
+    std::string path = fs_util::join(outDir, name);
+    mz_os_set_file_date(path.c_str(), p->modified_date, p->accessed_date, p->creation_date);
+    uint32_t target_attrib = 0;
+    if (mz_zip_attrib_convert(MZ_HOST_SYSTEM(p->version_madeby), p->external_fa,
+                              MZ_VERSION_MADEBY_HOST_SYSTEM, &target_attrib) == MZ_OK) {
+      mz_os_set_file_attribs(path.c_str(), target_attrib);
+    }
+  }
   return cnt;
 }
 
-bool ZipReader::extractAs(const std::string &filename,
-                          const std::string &newname) {
-  int err = mz_zip_reader_locate_entry(reader_, filename.c_str(), 0);
-  if (err == MZ_END_OF_LIST) {
-    return false;
+// Entries matching the globs, in archive order. Only the sorted index
+// ranges under the include prefixes are scanned, and subtrees excluded by a
+// `dir/*` pattern are skipped with one binary search.
+std::vector<const ZipEntry *> ZipReader::select(const GlobMatcher &matcher) {
+  if (sorted_.size() != entries_.size()) {
+    folded_names_.clear();
+    for (auto &e : entries_) {
+      folded_names_.push_back(GlobMatcher::fold(e.name));
+    }
+    sorted_.resize(entries_.size());
+    for (size_t i = 0; i < sorted_.size(); ++i) {
+      sorted_[i] = (uint32_t)i;
+    }
+    std::sort(sorted_.begin(), sorted_.end(),
+              [&](uint32_t a, uint32_t b) { return folded_names_[a] < folded_names_[b]; });
   }
-  if (err != MZ_OK) {
-    throw ZipException(err, "entry not found");
+
+  auto has_prefix = [&](uint32_t i, const std::string &prefix) {
+    return folded_names_[i].compare(0, prefix.size(), prefix) == 0;
+  };
+  std::vector<uint32_t> picked;
+  for (auto &prefix : matcher.includePrefixes()) {
+    auto it = std::lower_bound(sorted_.begin(), sorted_.end(), prefix,
+                               [&](uint32_t i, const std::string &value) {
+                                 return folded_names_[i] < value;
+                               });
+    while (it != sorted_.end() && has_prefix(*it, prefix)) {
+      const std::string &name = folded_names_[*it];
+      size_t excluded = matcher.excludedPrefix(name);
+      if (excluded > 0) {
+        std::string subtree = name.substr(0, excluded);
+        it = std::partition_point(it, sorted_.end(),
+                                  [&](uint32_t i) { return has_prefix(i, subtree); });
+        continue;
+      }
+      if (matcher.matches(name)) {
+        picked.push_back(*it);
+      }
+      ++it;
+    }
+  }
+
+  std::sort(picked.begin(), picked.end());
+  std::vector<const ZipEntry *> selected;
+  for (auto i : picked) {
+    selected.push_back(&entries_[i]);
+  }
+  return selected;
+}
+
+bool ZipReader::extractAs(const std::string &filename,
+                          const std::string &newname,
+                          const ExtractOptions &options) {
+  return extractEntry(filename, newname, stats::Op::kExtract, true, options);
+}
+
+bool ZipReader::extractEntry(const std::string &filename,
+                             const std::string &newname, stats::Op op,
+                             bool make_parent, const ExtractOptions &options) {
+  if (locate(filename) == nullptr) {
+    return extractSolid(filename, newname, op, make_parent, options);
   }
 
-  err = mz_zip_reader_entry_save_file(reader_, newname.c_str());
+  int32_t err = MZ_OK;
+  if (mz_zip_reader_entry_is_dir(reader_) == MZ_OK) {
+    err = mz_zip_reader_entry_save_file(reader_, newname.c_str());
+  } else {
+    auto sep = newname.find_last_of("/\\");
+    if (make_parent && sep != std::string::npos && sep > 0) {
+      mz_dir_make(newname.substr(0, sep).c_str());
+    }
+    err = saveEntry(newname, options);
+  }
   if (err != MZ_OK) {
     throw ZipException(err, "save entry failed");
   }
+
+  if (stats::enabled()) {
+    mz_zip_file *file_info = NULL;
+    if (mz_zip_reader_entry_get_info(reader_, &file_info) == MZ_OK) {
+      stats::add_bytes(op, file_info->compressed_size, file_info->uncompressed_size);
+    }
+  }
   return true;
 }
 
+// mz_zip_reader_entry_save_file for the current entry, minus the parent
+// directory check; the caller guarantees the directory exists. The output
+// is preallocated to its final size and written in large blocks.
+int32_t ZipReader::saveEntry(const std::string &path, const ExtractOptions &options) {
+  mz_zip_file *file_info = NULL;
+  int32_t err = mz_zip_reader_entry_get_info(reader_, &file_info);
+  if (err != MZ_OK) {
+    return err;
+  }
+  if (mz_zip_attrib_is_symlink(file_info->external_fa, file_info->version_madeby) == MZ_OK) {
+    return mz_zip_reader_entry_save_file(reader_, path.c_str());
+  }
+
+  try {
+    FileWriter writer(path, file_info->uncompressed_size, options.sparse);
+    if (dictionary_ && file_info->compression_method == MZ_COMPRESS_METHOD_ZSTD) {
+      streamEntry(file_info, [&](const char *buf, int32_t len) {
+        writer.write(buf, len);
+        return true;
+      });
+    } else {
+      err = mz_zip_reader_entry_save(reader_, &writer, FileWriter::writeCallback);
+      if (err != MZ_OK) {
+        return err;
+      }
+    }
+    writer.close();
+  } catch (const ZipException &) {
+    return MZ_WRITE_ERROR;
+  }
+
+  mz_os_set_file_date(path.c_str(), file_info->modified_date,
+                      file_info->accessed_date, file_info->creation_date);
+  uint32_t target_attrib = 0;
+  if (mz_zip_attrib_convert(MZ_HOST_SYSTEM(file_info->version_madeby),
+                            file_info->external_fa, MZ_VERSION_MADEBY_HOST_SYSTEM,
+                            &target_attrib) == MZ_OK) {
+    mz_os_set_file_attribs(path.c_str(), target_attrib);
+  }
+  return MZ_OK;
+}
+
+VerifyResult ZipReader::verify(const VerifyOptions &options) const {
+  ZipVerifier verifier(filename_, password_, options, dictionary_);
+  // The verifier walks the central directory by position.
+  return verifier.run(directory_.empty() ? entries_ : directory_);
+}
+
 bool ZipReader::readFile(const std::string &filename, std::string &data) {
+  auto too_large = [&]() {
+    return ZipException(MZ_MEM_ERROR,
+                        fmt::format("entry {} is larger than the read limit of {} bytes, "
+                                    "extract it instead",
+                                    filename, max_read_size_));
+  };
+  mz_zip_file *file_info = locate(filename);
+  if (file_info == nullptr) {
+    const SolidFile *file = findSolid(filename);
+    if (file == nullptr) {
+      return false;
+    }
+    if ((int64_t)file->length > max_read_size_) {
+      throw too_large();
+    }
+    auto block = solidBlock(*file);
+    data.assign(*block, file->offset, file->length);
+    stats::add_bytes(stats::Op::kRead, 0, data.size());
+    return true;
+  }
+  if (file_info->uncompressed_size > max_read_size_) {
+    throw too_large();
+  }
+  int64_t compressed_size = file_info->compressed_size;
+
+  data.clear();
+  data.reserve((size_t)std::max<int64_t>(0, file_info->uncompressed_size));
+  streamEntry(file_info, [&](const char *buf, int32_t len) {
+    // The header size is only a claim; the limit holds for what inflates.
+    if ((int64_t)(data.size() + len) > max_read_size_) {
+      throw too_large();
+    }
+    data.append(buf, len);
+    return true;
+  });
+  stats::add_bytes(stats::Op::kRead, compressed_size, data.size());
+  return true;
+}
+
+bool ZipReader::readRange(const std::string &filename, int64_t offset, int64_t length,
+                          std::string &data) {
+  if (offset < 0 || length < 0) {
+    throw ZipException(MZ_PARAM_ERROR, "negative range");
+  }
+  if (!is_open_) {
+    throw ZipException(MZ_PARAM_ERROR, "archive is closed");
+  }
+  int32_t node = tree_.find(filename);
+  if (node == ZipTree::kNone || tree_.node(node).entry == ZipTree::kNone) {
+    const SolidFile *file = findSolid(filename);
+    if (file == nullptr) {
+      return false;
+    }
+    length = std::max<int64_t>(0, std::min(length, (int64_t)file->length - offset));
+    data.clear();
+    if (length > 0) {
+      data.assign(*solidBlock(*file), file->offset + offset, (size_t)length);
+    }
+    stats::add_bytes(stats::Op::kReadRange, 0, data.size());
+    return true;
+  }
+  const ZipEntry &entry = entries_[tree_.node(node).entry];
+  length = std::max<int64_t>(0, std::min(length, entry.uncompressed_size - offset));
+  if (length > max_read_size_) {
+    throw ZipException(MZ_MEM_ERROR,
+                       fmt::format("range of {} bytes is larger than the read limit of {} bytes",
+                                   length, max_read_size_));
+  }
+
+  data.clear();
+  if (length == 0) {
+    return true;
+  }
+  if (!ranges_) {
+    ranges_.reset(new RangeReader(filename_, checkpoint_span_, kCheckpointCacheLimit));
+  }
+  if (!ranges_->read(entry, offset, length, data)) {
+    // Encrypted or unusual entries: inflate from the start, keep the range.
+    int64_t pos = 0;
+    int64_t end = offset + length;
+    data.reserve((size_t)length);
+    readEntry(entry.name, [&](const char *buf, int32_t len) {
+      int64_t from = std::max(offset, pos);
+      int64_t to = std::min(end, pos + len);
+      if (from < to) {
+        data.append(buf + (from - pos), (size_t)(to - from));
+      }
+      pos += len;
+      return pos < end;
+    });
+  }
+  stats::add_bytes(stats::Op::kReadRange, 0, data.size());
+  return true;
+}
+
+bool ZipReader::readEntry(const std::string &filename,
+                          const std::function<bool(const char *data, int32_t len)> &sink) {
+  mz_zip_file *file_info = locate(filename);
+  if (file_info == nullptr) {
+    const SolidFile *file = findSolid(filename);
+    if (file == nullptr) {
+      return false;
+    }
+    auto block = solidBlock(*file);
+    for (uint32_t pos = 0; pos < file->length;) {
+      int32_t n = (int32_t)std::min<uint32_t>(file->length - pos, kReadChunkSize);
+      if (!sink(block->data() + file->offset + pos, n)) {
+        break;
+      }
+      pos += n;
+    }
+    return true;
+  }
+  streamEntry(file_info, sink);
+  return true;
+}
+
+mz_zip_file *ZipReader::locate(const std::string &filename) {
   mz_zip_reader_set_password(reader_, password_.c_str());
+  // An exact match first, then ignoring case like exists and the tree.
   int err = mz_zip_reader_locate_entry(reader_, filename.c_str(), 0);
   if (err == MZ_END_OF_LIST) {
-    return false;
+    err = mz_zip_reader_locate_entry(reader_, filename.c_str(), 1);
+  }
+  if (err == MZ_END_OF_LIST) {
+    return nullptr;
   }
   if (err != MZ_OK) {
     throw ZipException(err, "entry not found");
   }
-
   mz_zip_file *file_info = NULL;
   err = mz_zip_reader_entry_get_info(reader_, &file_info);
   if (err != MZ_OK) {
     throw ZipException(err, "read entry info failed");
   }
+  return file_info;
+}
 
-  std::vector<char> buf(file_info->uncompressed_size);
-  err = mz_zip_reader_entry_save_buffer(reader_, buf.data(), buf.size());
+void ZipReader::streamEntry(const mz_zip_file *info,
+                            const std::function<bool(const char *data, int32_t len)> &sink) {
+  // Keys derived once per entry salt are reused on later reads.
+  if (!password_.empty() && (info->flag & MZ_ZIP_FLAG_ENCRYPTED) && info->aes_version != 0) {
+    if (!aes_) {
+      aes_.reset(new WzAesReader(filename_));
+    }
+    if (aes_->read(*info, password_, sink)) {
+      return;
+    }
+  }
+  if (dictionary_ && info->compression_method == MZ_COMPRESS_METHOD_ZSTD) {
+    if (!zstd_) {
+      zstd_.reset(new ZstdDictReader(filename_, dictionary_));
+    }
+    if (zstd_->read(*info, sink)) {
+      return;
+    }
+  }
+
+  int32_t err = mz_zip_reader_entry_open(reader_);
   if (err != MZ_OK) {
     throw ZipException(err, "read entry data failed");
   }
 
-  data = std::string(buf.begin(), buf.end());
+  std::vector<char> buf(kReadChunkSize);
+  int32_t n = 0;
+  bool stopped = false;
+  try {
+    while ((n = mz_zip_reader_entry_read(reader_, buf.data(), (int32_t)buf.size())) > 0) {
+      if (!sink(buf.data(), n)) {
+        stopped = true;
+        break;
+      }
+    }
+  } catch (...) {
+    mz_zip_reader_entry_close(reader_);
+    throw;
+  }
+  // A CRC mismatch surfaces at close, once the whole entry went through.
+  err = mz_zip_reader_entry_close(reader_);
+  if (n < 0) {
+    throw ZipException(n, "read entry data failed");
+  }
+  if (err != MZ_OK && !stopped) {
+    throw ZipException(err, "read entry data failed");
+  }
+}
+
+const SolidFile *ZipReader::findSolid(const std::string &filename) const {
+  return solid_ ? solid_->find(filename) : nullptr;
+}
+
+std::shared_ptr<const std::string> ZipReader::solidBlock(const SolidFile &file) {
+  auto block = blocks_->get(file.block, [&](std::string &data) {
+    std::string name = solid_block_name(file.block);
+    if (!readEntry(name, [&](const char *buf, int32_t len) {
+          data.append(buf, len);
+          return true;
+        })) {
+      throw ZipException(MZ_FORMAT_ERROR, fmt::format("solid block {} is missing", name));
+    }
+  });
+  if ((uint64_t)file.offset + file.length > block->size() ||
+      (uint32_t)crc32(0, reinterpret_cast<const Bytef *>(block->data() + file.offset),
+                      file.length) != file.crc) {
+    throw ZipException(MZ_CRC_ERROR, fmt::format("solid file {} is corrupt", file.name));
+  }
+  return block;
+}
+
+bool ZipReader::extractSolid(const std::string &filename, const std::string &newname,
+                             stats::Op op, bool make_parent, const ExtractOptions &options) {
+  const SolidFile *file = findSolid(filename);
+  if (file == nullptr) {
+    return false;
+  }
+  auto sep = newname.find_last_of("/\\");
+  if (make_parent && sep != std::string::npos && sep > 0) {
+    mz_dir_make(newname.substr(0, sep).c_str());
+  }
+  auto block = solidBlock(*file);
+  try {
+    FileWriter writer(newname, file->length, options.sparse);
+    writer.write(block->data() + file->offset, file->length);
+    writer.close();
+  } catch (const ZipException &) {
+    throw ZipException(MZ_WRITE_ERROR, "save entry failed");
+  }
+  mz_os_set_file_date(newname.c_str(), file->modified_date, file->modified_date,
+                      file->modified_date);
+  uint32_t target_attrib = 0;
+  if (file->external_fa != 0 &&
+      mz_zip_attrib_convert(MZ_HOST_SYSTEM(MZ_VERSION_MADEBY), file->external_fa,
+                            MZ_VERSION_MADEBY_HOST_SYSTEM, &target_attrib) == MZ_OK) {
+    mz_os_set_file_attribs(newname.c_str(), target_attrib);
+  }
+  stats::add_bytes(op, 0, file->length);
   return true;
 }
 
+bool ZipReader::isInternal(const std::string &name) const {
+  if (dictionary_ && name == kDictionaryEntry) {
+    return true;
+  }
+  return solid_ && (name == kSolidIndexEntry ||
+                    name.compare(0, strlen(kSolidBlockPrefix), kSolidBlockPrefix) == 0);
+}
+
 }  // namespace ziputil
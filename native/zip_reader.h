@@ -3,11 +3,16 @@
 
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "stats.h"
 #include "zip_common.h"
+#include "zip_index.h"
+#include "zip_tree.h"
 
 namespace ziputil {
 
@@ -24,38 +29,121 @@ struct ZipEntry {
   time_t modified_date; /* last modified date in unix time */
   time_t accessed_date; /* last accessed date in unix time */
   time_t creation_date; /* creation date in unix time */
+  uint16_t compression_method;
+  int64_t disk_offset; /* local header offset, -1 when not on the first disk */
+  uint32_t external_fa;
+  uint16_t version_madeby;
 };
 
+struct ExtractOptions {
+  bool sparse = false; /* skip writing zero blocks, leaving holes */
+  std::vector<std::string> include; /* globs, any may match; all entries if empty */
+  std::vector<std::string> exclude; /* globs, none may match */
+};
+
+struct ReaderOptions {
+  std::string index; /* sidecar index path, used when valid, (re)written otherwise */
+  int64_t max_read_size = 512 * 1024 * 1024; /* largest entry readFile holds in memory */
+  int64_t checkpoint_span = 1024 * 1024; /* inflate checkpoint spacing for readRange */
+};
+
+class BlockCache;
+class GlobMatcher;
+class RangeReader;
+class SolidIndex;
+struct SolidFile;
+class WzAesReader;
+class ZstdDictionary;
+class ZstdDictReader;
+struct VerifyOptions;
+struct VerifyResult;
+
 class ZipReader {
  public:
-  ZipReader() = default;
+  ZipReader();
   explicit ZipReader(const std::string& filename);
   ~ZipReader();
 
   ZipReader(const ZipReader&) = delete;
   ZipReader& operator=(const ZipReader&) = delete;
 
-  bool open(const std::string& filename, const std::string& password);
+  bool open(const std::string& filename, const std::string& password,
+            const ReaderOptions& options = ReaderOptions());
   void close();
 
   bool is_open() const { return is_open_; }
 
+  // Files packed into solid blocks are found, read and extracted by name
+  // like entries, through the archive's solid index.
   bool exists(const std::string& filename);
   void setPassword(std::string password);
   size_t count() const { return entries_.size(); }
   const ZipEntry& item(size_t index) const { return entries_[index]; }
   const std::vector<ZipEntry>& entries() const { return entries_; };
+  const ZipTree& tree() const { return tree_; }
 
   bool extractTo(const std::string& filename, const std::string& outDir);
-  bool extractAs(const std::string& filename, const std::string& newname);
+  bool extractAs(const std::string& filename, const std::string& newname,
+                 const ExtractOptions& options = ExtractOptions());
+  // Whole entry in memory; throws for entries over max_read_size, which
+  // have to be extracted or read with readEntry.
   bool readFile(const std::string& filename, std::string& data);
-  size_t extractAll(const std::string& outDir, const std::string& pattern = "");
+  // Streams the entry through `sink` in chunks, any size; `sink` returns
+  // false to stop early. False when there is no such entry.
+  bool readEntry(const std::string& filename,
+                 const std::function<bool(const char* data, int32_t len)>& sink);
+  // Up to `length` bytes of the entry from `offset`, clipped to its size.
+  // Deflated entries get an index of inflate checkpoints on first use, so
+  // later ranges only inflate from the nearest one. Throws for ranges over
+  // max_read_size; false when there is no such entry.
+  bool readRange(const std::string& filename, int64_t offset, int64_t length, std::string& data);
+  size_t extractAll(const std::string& outDir, const std::string& pattern = "",
+                    const ExtractOptions& options = ExtractOptions());
+  // Inflates every entry on worker threads with their own handles, nothing
+  // is written; does not use this reader's handle.
+  VerifyResult verify(const VerifyOptions& options) const;
 
  private:
+  bool extractEntry(const std::string& filename, const std::string& newname, stats::Op op,
+                    bool make_parent, const ExtractOptions& options);
+  int32_t saveEntry(const std::string& path, const ExtractOptions& options);
+  std::vector<const ZipEntry*> select(const GlobMatcher& matcher);
+  void readEntries(std::vector<ZipEntry>& files);
+  // Current entry's info, or nullptr when there is no such entry.
+  mz_zip_file* locate(const std::string& filename);
+  // Streams the located entry; WinZip AES entries go through aes_, and
+  // zstd entries compressed with the archive's dictionary through zstd_.
+  void streamEntry(const mz_zip_file* info,
+                   const std::function<bool(const char* data, int32_t len)>& sink);
+  // Solid file by name, nullptr without a solid index or such a file.
+  const SolidFile* findSolid(const std::string& filename) const;
+  // The decompressed block holding `file`, which is checked against its CRC.
+  std::shared_ptr<const std::string> solidBlock(const SolidFile& file);
+  bool extractSolid(const std::string& filename, const std::string& newname, stats::Op op,
+                    bool make_parent, const ExtractOptions& options);
+  // The writer's own entries: the zstd dictionary, solid blocks and their
+  // index. They are left out of the listing and of extraction.
+  bool isInternal(const std::string& name) const;
+
   MzReaderHandle reader_;
   bool is_open_ = false;
+  std::string filename_;
   std::string password_;
+  int64_t max_read_size_ = 0;
+  int64_t checkpoint_span_ = 0;
+  std::unique_ptr<RangeReader> ranges_;
+  std::unique_ptr<WzAesReader> aes_;
+  std::shared_ptr<const ZstdDictionary> dictionary_;
+  std::unique_ptr<ZstdDictReader> zstd_;
+  std::unique_ptr<SolidIndex> solid_;
+  std::unique_ptr<BlockCache> blocks_;
   std::vector<ZipEntry> entries_;
+  std::vector<ZipEntry> directory_;  /* every entry in directory order, for verify */
+  ZipTree tree_;
+  std::unique_ptr<ZipIndex> index_;
+  // Case-folded names and entry indices sorted by them, built on first use.
+  std::vector<std::string> folded_names_;
+  std::vector<uint32_t> sorted_;
 };
 
 }  // namespace ziputil
@@ -9,6 +9,7 @@
 #include "fs_util.h"
 #include "napi.h"
 #include "zip_reader.h"
+#include "zip_verifier.h"
 #include "async_op.h"
 
 namespace api {
@@ -17,19 +18,24 @@ using namespace ziputil;
 
 class OpenZipAsync : public Napi::AsyncWorker {
  public:
-  OpenZipAsync(Napi::Env env, std::string filename, std::string password, AddonData* addon_data)
+  OpenZipAsync(Napi::Env env, std::string filename, std::string password,
+               ReaderOptions options, AddonData* addon_data)
       : Napi::AsyncWorker(env),
         deferred(Napi::Promise::Deferred::New(env)),
         addon_data_(addon_data),
         filename_(std::move(filename)),
-        password_(std::move(password)) {}
+        password_(std::move(password)),
+        options_(std::move(options)) {}
   ~OpenZipAsync() {}
 
   void Execute() override {
+    trace_.start();
     reader_ = std::make_unique<ZipReader>();
     try {
-      reader_->open(filename_, password_);
+      reader_->open(filename_, password_, options_);
+      trace_.finish(true);
     } catch (const std::exception& e) {
+      trace_.finish(false);
       SetError(e.what());
     }
   }
@@ -55,6 +61,8 @@ class OpenZipAsync : public Napi::AsyncWorker {
   AddonData* addon_data_;
   std::string filename_;
   std::string password_;
+  ReaderOptions options_;
+  stats::OpTrace trace_{stats::Op::kOpen};
 };
 
 Napi::Value OpenZip(const Napi::CallbackInfo& info) {
@@ -71,21 +79,56 @@ Napi::Value OpenZip(const Napi::CallbackInfo& info) {
     return env.Null();
   }
 
+  std::string filename = info[0].ToString();
   std::string password;
-  if (info.Length() > 1) {
+  ReaderOptions options;
+  if (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNull()) {
     if (!info[1].IsString()) {
       Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
       return env.Null();
     }
     password = info[1].ToString();
   }
+  if (info.Length() > 2 && info[2].IsObject()) {
+    auto opts = info[2].ToObject();
+    if (opts.Has("index")) {
+      // true: next to the archive; a string: that path.
+      auto index = opts.Get("index");
+      if (index.IsString()) {
+        options.index = index.ToString();
+      } else if (index.ToBoolean()) {
+        options.index = filename + ".mzidx";
+      }
+    }
+    if (opts.Has("maxReadSize") && opts.Get("maxReadSize").IsNumber()) {
+      options.max_read_size = opts.Get("maxReadSize").ToNumber().Int64Value();
+    }
+    if (opts.Has("checkpointSpan") && opts.Get("checkpointSpan").IsNumber()) {
+      options.checkpoint_span = opts.Get("checkpointSpan").ToNumber().Int64Value();
+    }
+  }
 
   auto addon_data = (AddonData*)info.Data();
-  auto* wk = new OpenZipAsync(info.Env(), info[0].ToString(), password, addon_data);
+  auto* wk = new OpenZipAsync(info.Env(), filename, password, std::move(options), addon_data);
   wk->Queue();
   return wk->deferred.Promise();
 }
 
+Napi::Object EntryToObject(Napi::Env env, const ZipEntry& p) {
+  auto obj = Napi::Object::New(env);
+  obj.Set("name", p.name);
+  obj.Set("is_encrypted", p.is_encrypted);
+  obj.Set("is_directory", p.is_directory);
+  obj.Set("is_symlink", p.is_symlink);
+  obj.Set("comment", p.comment);
+  if (p.is_symlink) {
+    obj.Set("linkname", p.linkname);
+  }
+  obj.Set("uncompressed_size", p.uncompressed_size);
+  obj.Set("modified_date", p.modified_date);
+  return obj;
+}
+
 //
 // ZipReaderAPI
 //
@@ -101,8 +144,13 @@ Napi::Object ZipReaderAPI::Init(Napi::Env env, Napi::Object exports, AddonData*
                   {InstanceMethod("item", &ZipReaderAPI::item),
                    InstanceMethod("extract", &ZipReaderAPI::extract),
                    InstanceMethod("extract_all", &ZipReaderAPI::extractAll),
+                   InstanceMethod("verify", &ZipReaderAPI::verify),
                    InstanceMethod("read", &ZipReaderAPI::readFile),
+                   InstanceMethod("readRange", &ZipReaderAPI::readRange),
                    InstanceMethod("exists", &ZipReaderAPI::exists),
+                   InstanceMethod("readdir", &ZipReaderAPI::readdir),
+                   InstanceMethod("stat", &ZipReaderAPI::stat),
+                   InstanceMethod("walk", &ZipReaderAPI::walk),
                    InstanceAccessor("count", &ZipReaderAPI::count, nullptr),
                    InstanceMethod("close", &ZipReaderAPI::close)}, nullptr);
 
@@ -113,54 +161,170 @@ Napi::Object ZipReaderAPI::Init(Napi::Env env, Napi::Object exports, AddonData*
 Napi::Value ZipReaderAPI::setPassword(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   std::string password = info[0].ToString();
-  reader_->setPassword(std::move(password));
+  reader().setPassword(std::move(password));
   return env.Undefined();
 }
 
 Napi::Value ZipReaderAPI::item(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   int idx = info[0].ToNumber();
-  if (idx < 0 || idx >= (int)reader_->count()) {
+  if (idx < 0 || idx >= (int)reader().count()) {
     Napi::TypeError::New(env, "Wrong number of arguments")
         .ThrowAsJavaScriptException();
     return env.Undefined();
   }
 
-  auto p = reader_->item(idx);
-  auto obj = Napi::Object::New(env);
-  obj.Set("name", p.name);
-  obj.Set("is_encrypted", p.is_encrypted);
-  obj.Set("is_directory", p.is_directory);
-  obj.Set("is_symlink", p.is_symlink);
-  obj.Set("comment", p.comment);
-  if (p.is_symlink) {
-    obj.Set("linkname", p.linkname);
-  }
-  obj.Set("uncompressed_size", p.uncompressed_size);
-  obj.Set("modified_date", p.modified_date);
-  return obj;
+  return EntryToObject(env, reader().item(idx));
 }
 
 Napi::Value ZipReaderAPI::readFile(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   std::string name = info[0].ToString();
-  auto op = [this, name = std::move(name)]() {
+  auto op = [state = state_, ticket = state_->enter(), name = std::move(name)]() {
     std::string content;
-    const std::lock_guard<std::mutex> lock(this->mu_);
-    reader_->readFile(name, content);
+    Shared<ZipReader>::Lock lock(*state, ticket, stats::Op::kRead);
+    lock.get().readFile(name, content);
     return content;
   };
-  return MakePromise(env, op);
+  return MakePromise(env, stats::Op::kRead, op);
+}
+
+// Resolves a Buffer: a range may cut through a multi-byte character.
+class ReadRangeAsync : public Napi::AsyncWorker {
+ public:
+  ReadRangeAsync(Napi::Env env, std::shared_ptr<Shared<ZipReader>> reader, std::string name,
+                 int64_t offset, int64_t length)
+      : Napi::AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        reader_(std::move(reader)),
+        ticket_(reader_->enter()),
+        name_(std::move(name)),
+        offset_(offset),
+        length_(length) {}
+
+  void Execute() override {
+    trace_.start();
+    try {
+      Shared<ZipReader>::Lock lock(*reader_, ticket_, stats::Op::kReadRange);
+      found_ = lock.get().readRange(name_, offset_, length_, data_);
+    } catch (const std::exception& e) {
+      trace_.finish(false);
+      SetError(e.what());
+      return;
+    }
+    trace_.finish(true);
+  }
+
+  void OnOK() override {
+    Napi::HandleScope scope(Env());
+    if (!found_) {
+      deferred.Resolve(Env().Null());
+      return;
+    }
+    deferred.Resolve(Napi::Buffer<char>::Copy(Env(), data_.data(), data_.size()));
+  }
+
+  void OnError(Napi::Error const& error) override {
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise::Deferred deferred;
+
+ private:
+  std::shared_ptr<Shared<ZipReader>> reader_;
+  uint64_t ticket_;
+  std::string name_;
+  int64_t offset_;
+  int64_t length_;
+  bool found_ = false;
+  std::string data_;
+  stats::OpTrace trace_{stats::Op::kReadRange};
+};
+
+Napi::Value ZipReaderAPI::readRange(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 3 || !info[1].IsNumber() || !info[2].IsNumber()) {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  int64_t offset = info[1].ToNumber().Int64Value();
+  int64_t length = info[2].ToNumber().Int64Value();
+  if (offset < 0 || length < 0) {
+    Napi::RangeError::New(env, "out of range").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  auto* wk = new ReadRangeAsync(env, state_, info[0].ToString(), offset, length);
+  wk->Queue();
+  return wk->deferred.Promise();
 }
 
 Napi::Value ZipReaderAPI::exists(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   std::string name = info[0].ToString();
-  return Napi::Boolean::From(env, reader_->exists(name));
+  return Napi::Boolean::From(env, reader().exists(name));
+}
+
+Napi::Value ZipReaderAPI::readdir(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  std::string path = info.Length() > 0 && info[0].IsString() ? info[0].ToString() : std::string();
+  const ZipTree& tree = reader().tree();
+  int32_t n = tree.find(path);
+  if (n == ZipTree::kNone || !tree.node(n).is_directory) {
+    return env.Null();
+  }
+
+  const auto& children = tree.node(n).children;
+  auto result = Napi::Array::New(env, children.size());
+  for (uint32_t i = 0; i < children.size(); ++i) {
+    result.Set(i, tree.node(children[i]).name);
+  }
+  return result;
+}
+
+Napi::Value ZipReaderAPI::stat(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  std::string path = info.Length() > 0 && info[0].IsString() ? info[0].ToString() : std::string();
+  const ZipTree& tree = reader().tree();
+  int32_t n = tree.find(path);
+  if (n == ZipTree::kNone) {
+    return env.Null();
+  }
+
+  const ZipTree::Node& node = tree.node(n);
+  if (node.entry != ZipTree::kNone) {
+    auto obj = EntryToObject(env, reader().item(node.entry));
+    obj.Set("implicit", false);
+    return obj;
+  }
+  // A directory only present as part of other entry names.
+  ZipEntry dir = ZipEntry();
+  dir.name = n == 0 ? std::string() : tree.path(n) + "/";
+  dir.is_directory = true;
+  auto obj = EntryToObject(env, dir);
+  obj.Set("implicit", true);
+  return obj;
+}
+
+Napi::Value ZipReaderAPI::walk(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  std::string path = info.Length() > 0 && info[0].IsString() ? info[0].ToString() : std::string();
+  const ZipTree& tree = reader().tree();
+  int32_t n = tree.find(path);
+  if (n == ZipTree::kNone) {
+    return env.Null();
+  }
+
+  std::vector<std::string> paths;
+  tree.walk(n, paths);
+  auto result = Napi::Array::New(env, paths.size());
+  for (uint32_t i = 0; i < paths.size(); ++i) {
+    result.Set(i, paths[i]);
+  }
+  return result;
 }
 
 Napi::Value ZipReaderAPI::count(const Napi::CallbackInfo& info) {
-  return Napi::Number::From(info.Env(), reader_->count());
+  return Napi::Number::From(info.Env(), reader().count());
 }
 
 Napi::Value ZipReaderAPI::ZipReaderAPI::extract(
@@ -174,13 +338,14 @@ Napi::Value ZipReaderAPI::ZipReaderAPI::extract(
 
   std::string name;
   std::string dst;
+  ExtractOptions extract_options;
   if (info[0].IsNumber()) {
     int idx = info[0].ToNumber();
-    if (idx < 0 || idx >= reader_->count()) {
+    if (idx < 0 || idx >= reader().count()) {
       Napi::RangeError::New(env, "out of range").ThrowAsJavaScriptException();
       return env.Null();
     }
-    name = reader_->item(idx).name;
+    name = reader().item(idx).name;
   } else {
     name = info[0].ToString();
   }
@@ -196,15 +361,19 @@ Napi::Value ZipReaderAPI::ZipReaderAPI::extract(
     if (options.Has("name")) {
       targetName = options.Get("name").ToString();
     }
+    if (options.Has("sparse")) {
+      extract_options.sparse = options.Get("sparse").ToBoolean();
+    }
     dst = fs_util::join(targetDir, targetName);
   } else {
     Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
   }
-  auto op = [this, name = std::move(name), dst = std::move(dst)]() {
-    const std::lock_guard<std::mutex> lock(this->mu_);
-    return reader_->extractAs(name, dst);
+  auto op = [state = state_, ticket = state_->enter(), name = std::move(name), dst = std::move(dst),
+             extract_options]() {
+    Shared<ZipReader>::Lock lock(*state, ticket, stats::Op::kExtract);
+    return lock.get().extractAs(name, dst, extract_options);
   };
-  return MakePromise(env, op);
+  return MakePromise(env, stats::Op::kExtract, op);
 }
 
 Napi::Value ZipReaderAPI::ZipReaderAPI::extractAll(
@@ -212,26 +381,130 @@ Napi::Value ZipReaderAPI::ZipReaderAPI::extractAll(
   Napi::Env env = info.Env();
   std::string dir = info[0].ToString();
   std::string pattern;
-  if (info.Length() > 1) {
-    pattern = info[1].ToString();
+  ExtractOptions extract_options;
+  auto to_strings = [](Napi::Value value, std::vector<std::string>& out) {
+    if (value.IsArray()) {
+      auto arr = value.As<Napi::Array>();
+      for (uint32_t i = 0; i < arr.Length(); ++i) {
+        out.push_back(arr.Get(i).ToString());
+      }
+    } else if (value.IsString()) {
+      out.push_back(value.ToString());
+    }
+  };
+  size_t next = 1;
+  if (info.Length() > next && info[next].IsString()) {
+    pattern = info[next++].ToString();
+  } else if (info.Length() > next && info[next].IsArray()) {
+    to_strings(info[next++], extract_options.include);
+  }
+  if (info.Length() > next && info[next].IsObject()) {
+    auto options = info[next].ToObject();
+    if (options.Has("sparse")) {
+      extract_options.sparse = options.Get("sparse").ToBoolean();
+    }
+    if (options.Has("include")) {
+      to_strings(options.Get("include"), extract_options.include);
+    }
+    if (options.Has("exclude")) {
+      to_strings(options.Get("exclude"), extract_options.exclude);
+    }
   }
 
-  auto op = [this, outdir = std::move(dir), pattern = std::move(pattern)]() {
-    const std::lock_guard<std::mutex> lock(this->mu_);
-    return reader_->extractAll(outdir, pattern);
+  auto op = [state = state_, ticket = state_->enter(), outdir = std::move(dir), pattern = std::move(pattern),
+             extract_options = std::move(extract_options)]() {
+    Shared<ZipReader>::Lock lock(*state, ticket, stats::Op::kExtractAll);
+    return lock.get().extractAll(outdir, pattern, extract_options);
   };
 
-  return MakePromise(env, op);
+  return MakePromise(env, stats::Op::kExtractAll, op);
+}
+
+class VerifyAsync : public Napi::AsyncWorker {
+ public:
+  VerifyAsync(Napi::Env env, std::shared_ptr<Shared<ZipReader>> reader, VerifyOptions options)
+      : Napi::AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        reader_(std::move(reader)),
+        ticket_(reader_->enter()),
+        options_(options) {}
+
+  void Execute() override {
+    trace_.start();
+    try {
+      // Verification opens its own handles, so other operations on this
+      // reader go on meanwhile.
+      Shared<ZipReader>::Ticket ticket(*reader_, ticket_);
+      result_ = ticket.get().verify(options_);
+    } catch (const std::exception& e) {
+      trace_.finish(false);
+      SetError(e.what());
+      return;
+    }
+    trace_.finish(true);
+  }
+
+  void OnOK() override {
+    Napi::HandleScope scope(Env());
+    auto obj = Napi::Object::New(Env());
+    obj.Set("ok", result_.failures.empty());
+    obj.Set("entries", (double)result_.entries);
+    obj.Set("bytes", (double)result_.bytes);
+    obj.Set("compressed_bytes", (double)result_.compressed_bytes);
+    obj.Set("seconds", result_.seconds);
+    obj.Set("mb_per_s", result_.seconds > 0 ? result_.bytes / 1e6 / result_.seconds : 0.0);
+    auto failures = Napi::Array::New(Env(), result_.failures.size());
+    for (uint32_t i = 0; i < result_.failures.size(); ++i) {
+      auto failure = Napi::Object::New(Env());
+      failure.Set("name", result_.failures[i].name);
+      failure.Set("error", result_.failures[i].error);
+      failures.Set(i, failure);
+    }
+    obj.Set("failures", failures);
+    deferred.Resolve(obj);
+  }
+
+  void OnError(Napi::Error const& error) override {
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise::Deferred deferred;
+
+ private:
+  std::shared_ptr<Shared<ZipReader>> reader_;
+  uint64_t ticket_;
+  VerifyOptions options_;
+  VerifyResult result_;
+  stats::OpTrace trace_{stats::Op::kVerify};
+};
+
+Napi::Value ZipReaderAPI::verify(const Napi::CallbackInfo& info) {
+  VerifyOptions options;
+  if (info.Length() > 0 && info[0].IsObject()) {
+    auto opts = info[0].ToObject();
+    if (opts.Has("threads") && opts.Get("threads").IsNumber()) {
+      options.threads = std::max(1u, opts.Get("threads").ToNumber().Uint32Value());
+    }
+  }
+  auto* wk = new VerifyAsync(info.Env(), state_, options);
+  wk->Queue();
+  return wk->deferred.Promise();
 }
 
 Napi::Value ZipReaderAPI::close(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
-  reader_->close();
-  return env.Undefined();
+  // Entries stay readable after close, so only the archive handle is
+  // released here; the reader itself goes with the wrapper.
+  auto op = [state = state_, ticket = state_->enter()]() {
+    Shared<ZipReader>::Lock lock(*state, ticket, stats::Op::kClose, true);
+    lock.get().close();
+    return true;
+  };
+  return MakePromise(env, stats::Op::kClose, op);
 }
 
 ZipReaderAPI::ZipReaderAPI(const Napi::CallbackInfo& info)
-    : Napi::ObjectWrap<ZipReaderAPI>(info) {
+    : Napi::ObjectWrap<ZipReaderAPI>(info), state_(std::make_shared<Shared<ZipReader>>()) {
   Napi::Env env = info.Env();
   Napi::HandleScope scope(env);
 
@@ -245,9 +518,11 @@ ZipReaderAPI::ZipReaderAPI(const Napi::CallbackInfo& info)
     return;
   }
 
-  reader_.reset(info[0].As<Napi::External<ZipReader>>().Data());
+  state_->value.reset(info[0].As<Napi::External<ZipReader>>().Data());
 }
 
+ZipReaderAPI::~ZipReaderAPI() { DisposeLater(std::move(state_)); }
+
 Napi::Object ZipReaderAPI::NewInstance(Napi::Env env, Napi::Value arg, AddonData* addon_data) {
   Napi::EscapableHandleScope scope(env);
 #if NAPI_VERSION > 5  
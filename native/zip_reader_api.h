@@ -4,30 +4,44 @@
 
 #include <napi.h>
 
+#include <memory>
 #include <thread>
 
 #include "addon.h"
+#include "disposer.h"
 #include "zip_reader.h"
 
 namespace api {
 
+Napi::Object EntryToObject(Napi::Env env, const ziputil::ZipEntry& entry);
+
 class ZipReaderAPI : public Napi::ObjectWrap<ZipReaderAPI> {
  public:
   static Napi::Object Init(Napi::Env env, Napi::Object exports, AddonData* addon_data);
   static Napi::Object NewInstance(Napi::Env env, Napi::Value arg, AddonData* addon_data);
 
   ZipReaderAPI(const Napi::CallbackInfo& info);
+  ~ZipReaderAPI();
+
  private:
   Napi::Value setPassword(const Napi::CallbackInfo& info);
   Napi::Value item(const Napi::CallbackInfo& info);
   Napi::Value readFile(const Napi::CallbackInfo& info);
+  Napi::Value readRange(const Napi::CallbackInfo& info);
   Napi::Value exists(const Napi::CallbackInfo& info);
+  Napi::Value readdir(const Napi::CallbackInfo& info);
+  Napi::Value stat(const Napi::CallbackInfo& info);
+  Napi::Value walk(const Napi::CallbackInfo& info);
   Napi::Value count(const Napi::CallbackInfo& info);
   Napi::Value extract(const Napi::CallbackInfo& info);
   Napi::Value extractAll(const Napi::CallbackInfo& info);
+  Napi::Value verify(const Napi::CallbackInfo& info);
   Napi::Value close(const Napi::CallbackInfo& info);
-  std::unique_ptr<ziputil::ZipReader> reader_;
-  std::mutex mu_;
+  // Metadata calls run on the JS thread without `mu`; they only read what
+  // open() left behind, which close() does not touch.
+  ziputil::ZipReader& reader() { return *state_->value; }
+
+  std::shared_ptr<Shared<ziputil::ZipReader>> state_;
 };
 }  // namespace api
 #endif /* ifndef ZIP_READER_API_H */
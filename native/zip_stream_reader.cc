@@ -0,0 +1,263 @@
+#include "zip_stream_reader.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace ziputil {
+
+namespace {
+
+const size_t kOutputChunk = 64 * 1024;
+
+}  // namespace
+
+ZipStreamParser::ZipStreamParser() { memset(&zs_, 0, sizeof(zs_)); }
+
+ZipStreamParser::~ZipStreamParser() {
+  if (zs_init_) {
+    inflateEnd(&zs_);
+  }
+}
+
+void ZipStreamParser::feed(const uint8_t* data, size_t len,
+                           std::vector<Event>& events) {
+  if (state_ == State::kDone) {
+    return;
+  }
+  // Drop consumed bytes before growing the buffer.
+  if (pos_ > 0 && pos_ >= pending_.size() / 2) {
+    pending_.erase(0, pos_);
+    pos_ = 0;
+  }
+  pending_.append(reinterpret_cast<const char*>(data), len);
+
+  while (state_ != State::kDone && step(events)) {
+  }
+}
+
+void ZipStreamParser::finish() {
+  if (state_ != State::kSignature && state_ != State::kDone) {
+    throw ZipException(MZ_END_OF_STREAM, "unexpected end of archive");
+  }
+  state_ = State::kDone;
+}
+
+bool ZipStreamParser::step(std::vector<Event>& events) {
+  switch (state_) {
+    case State::kSignature: {
+      if (available() < 4) {
+        return false;
+      }
+      uint32_t magic = read_u32(input());
+      // pos_ restarts at 0 whenever the buffer is compacted.
+      bool first = !started_;
+      started_ = true;
+      if (magic == kLocalHeaderMagic) {
+        state_ = State::kLocalHeader;
+        return true;
+      }
+      if (magic == kCentralHeaderMagic || magic == kEndOfCentralDirMagic ||
+          magic == kZip64EndOfCentralDirMagic) {
+        // Everything after the last entry is the central directory.
+        state_ = State::kDone;
+        pending_.clear();
+        pos_ = 0;
+        return false;
+      }
+      if (magic == kDataDescriptorMagic && first) {
+        pos_ += 4;  // spanned archive marker
+        return true;
+      }
+      throw ZipException(MZ_FORMAT_ERROR, "invalid local header signature");
+    }
+    case State::kLocalHeader:
+      return readLocalHeader(events);
+    case State::kStored:
+      return readStored(events);
+    case State::kInflate:
+      return readDeflated(events);
+    case State::kDescriptor:
+      return readDescriptor(events);
+    case State::kDone:
+      break;
+  }
+  return false;
+}
+
+bool ZipStreamParser::readLocalHeader(std::vector<Event>& events) {
+  if (available() < (size_t)kLocalHeaderSize) {
+    return false;
+  }
+  const uint8_t* h = input();
+  uint16_t filename_size = read_u16(h + 26);
+  uint16_t extrafield_size = read_u16(h + 28);
+  size_t header_size = kLocalHeaderSize + filename_size + extrafield_size;
+  if (available() < header_size) {
+    return false;
+  }
+
+  flag_ = read_u16(h + 6);
+  uint16_t method = read_u16(h + 8);
+  expected_crc_ = read_u32(h + 14);
+  int64_t compressed_size = read_u32(h + 18);
+  int64_t uncompressed_size = read_u32(h + 22);
+
+  zip64_ = false;
+  const uint8_t* extra = h + kLocalHeaderSize + filename_size;
+  for (size_t i = 0; i + 4 <= extrafield_size;) {
+    uint16_t id = read_u16(extra + i);
+    uint16_t size = read_u16(extra + i + 2);
+    if (i + 4 + size > extrafield_size) {
+      break;
+    }
+    if (id == kZip64ExtraId) {
+      zip64_ = true;
+      const uint8_t* field = extra + i + 4;
+      const uint8_t* field_end = field + size;
+      if (uncompressed_size == 0xFFFFFFFF && field + 8 <= field_end) {
+        uncompressed_size = (int64_t)read_u64(field);
+        field += 8;
+      }
+      if (compressed_size == 0xFFFFFFFF && field + 8 <= field_end) {
+        compressed_size = (int64_t)read_u64(field);
+      }
+    } else if (id == kAesExtraId && size >= 7) {
+      method = read_u16(extra + i + 4 + 5);
+    }
+    i += 4 + size;
+  }
+
+  ZipEntry entry = ZipEntry();
+  entry.name.assign(reinterpret_cast<const char*>(h + kLocalHeaderSize), filename_size);
+  entry.compressed_size = compressed_size;
+  entry.uncompressed_size = uncompressed_size;
+  entry.is_encrypted = (flag_ & MZ_ZIP_FLAG_ENCRYPTED) != 0;
+  entry.is_directory = !entry.name.empty() &&
+                       (entry.name.back() == '/' || entry.name.back() == '\\');
+  entry.is_symlink = false;
+  entry.crc = expected_crc_;
+  entry.modified_date = mz_zip_dosdate_to_time_t(read_u32(h + 10));
+
+  if (entry.is_encrypted) {
+    throw ZipException(MZ_SUPPORT_ERROR, "encrypted entries can not be streamed: " + entry.name);
+  }
+
+  bool has_descriptor = (flag_ & MZ_ZIP_FLAG_DATA_DESCRIPTOR) != 0;
+  if (method == MZ_COMPRESS_METHOD_STORE) {
+    if (has_descriptor && compressed_size == 0 && !entry.is_directory) {
+      // Without a size the end of stored data can not be found reliably.
+      throw ZipException(MZ_SUPPORT_ERROR, "stored entry without size: " + entry.name);
+    }
+    remaining_ = compressed_size;
+    state_ = State::kStored;
+  } else if (method == MZ_COMPRESS_METHOD_DEFLATE) {
+    if (!zs_init_) {
+      if (inflateInit2(&zs_, -MAX_WBITS) != Z_OK) {
+        throw ZipException(MZ_MEM_ERROR, "inflate init failed");
+      }
+      zs_init_ = true;
+    } else {
+      inflateReset(&zs_);
+    }
+    state_ = State::kInflate;
+  } else {
+    throw ZipException(MZ_SUPPORT_ERROR, "unsupported compression method: " + entry.name);
+  }
+
+  crc_ = 0;
+  produced_ = 0;
+  pos_ += header_size;
+  events.push_back(Event{Event::kEntry, std::move(entry), std::string()});
+  return true;
+}
+
+bool ZipStreamParser::readStored(std::vector<Event>& events) {
+  if (remaining_ > 0) {
+    size_t n = (size_t)std::min<int64_t>(remaining_, available());
+    if (n == 0) {
+      return false;
+    }
+    emitData(input(), n, events);
+    pos_ += n;
+    remaining_ -= n;
+    if (remaining_ > 0) {
+      return false;
+    }
+  }
+
+  if (flag_ & MZ_ZIP_FLAG_DATA_DESCRIPTOR) {
+    state_ = State::kDescriptor;
+  } else {
+    endEntry(events);
+  }
+  return true;
+}
+
+bool ZipStreamParser::readDeflated(std::vector<Event>& events) {
+  if (available() == 0) {
+    return false;
+  }
+
+  uint8_t out[kOutputChunk];
+  zs_.next_in = const_cast<Bytef*>(input());
+  zs_.avail_in = (uInt)std::min<size_t>(available(), UINT32_MAX);
+  int ret = Z_OK;
+  do {
+    zs_.next_out = out;
+    zs_.avail_out = sizeof(out);
+    ret = inflate(&zs_, Z_NO_FLUSH);
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+      throw ZipException(MZ_DATA_ERROR, "inflate failed");
+    }
+    size_t n = sizeof(out) - zs_.avail_out;
+    if (n > 0) {
+      emitData(out, n, events);
+    }
+  } while (ret == Z_OK && (zs_.avail_in > 0 || zs_.avail_out == 0));
+
+  pos_ = zs_.next_in - reinterpret_cast<const Bytef*>(pending_.data());
+  if (ret != Z_STREAM_END) {
+    return false;
+  }
+
+  if (flag_ & MZ_ZIP_FLAG_DATA_DESCRIPTOR) {
+    state_ = State::kDescriptor;
+  } else {
+    endEntry(events);
+  }
+  return true;
+}
+
+bool ZipStreamParser::readDescriptor(std::vector<Event>& events) {
+  if (available() < 4) {
+    return false;
+  }
+  // The signature is optional; sizes are 8 bytes each for zip64 entries.
+  size_t offset = read_u32(input()) == kDataDescriptorMagic ? 4 : 0;
+  size_t size = offset + 4 + (zip64_ ? 16 : 8);
+  if (available() < size) {
+    return false;
+  }
+  expected_crc_ = read_u32(input() + offset);
+  pos_ += size;
+  endEntry(events);
+  return true;
+}
+
+void ZipStreamParser::endEntry(std::vector<Event>& events) {
+  if (crc_ != expected_crc_) {
+    throw ZipException(MZ_CRC_ERROR, "crc mismatch");
+  }
+  events.push_back(Event{Event::kEntryEnd, ZipEntry(), std::string()});
+  state_ = State::kSignature;
+}
+
+void ZipStreamParser::emitData(const uint8_t* data, size_t len,
+                               std::vector<Event>& events) {
+  crc_ = (uint32_t)crc32(crc_, data, (uInt)len);
+  produced_ += len;
+  events.push_back(Event{Event::kData, ZipEntry(), std::string(reinterpret_cast<const char*>(data), len)});
+}
+
+}  // namespace ziputil
@@ -0,0 +1,71 @@
+#ifndef ZIP_STREAM_READER_H
+#define ZIP_STREAM_READER_H
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "zip_reader.h"
+
+namespace ziputil {
+
+// Forward-only reader that walks local file headers as bytes arrive, for
+// archives that cannot be seeked (pipes, sockets). The central directory is
+// never consulted, so only what the local headers carry is reported.
+class ZipStreamParser {
+ public:
+  struct Event {
+    enum Type { kEntry, kData, kEntryEnd };
+    Type type;
+    ZipEntry entry;    /* kEntry */
+    std::string data;  /* kData */
+  };
+
+  ZipStreamParser();
+  ~ZipStreamParser();
+
+  ZipStreamParser(const ZipStreamParser&) = delete;
+  ZipStreamParser& operator=(const ZipStreamParser&) = delete;
+
+  // Consumes `len` bytes and appends the entries and content they complete.
+  void feed(const uint8_t* data, size_t len, std::vector<Event>& events);
+  // Signals end of input; throws if it ends in the middle of an entry.
+  void finish();
+
+  bool done() const { return state_ == State::kDone; }
+
+ private:
+  enum class State { kSignature, kLocalHeader, kStored, kInflate, kDescriptor, kDone };
+
+  bool step(std::vector<Event>& events);
+  bool readLocalHeader(std::vector<Event>& events);
+  bool readStored(std::vector<Event>& events);
+  bool readDeflated(std::vector<Event>& events);
+  bool readDescriptor(std::vector<Event>& events);
+  void endEntry(std::vector<Event>& events);
+  void emitData(const uint8_t* data, size_t len, std::vector<Event>& events);
+
+  size_t available() const { return pending_.size() - pos_; }
+  const uint8_t* input() const { return reinterpret_cast<const uint8_t*>(pending_.data()) + pos_; }
+
+  State state_ = State::kSignature;
+  std::string pending_;
+  size_t pos_ = 0;
+  bool started_ = false;  /* past the first signature of the stream */
+
+  uint16_t flag_ = 0;
+  bool zip64_ = false;
+  int64_t remaining_ = 0;  /* stored bytes left in the current entry */
+  uint32_t expected_crc_ = 0;
+  uint32_t crc_ = 0;
+  int64_t produced_ = 0;
+
+  z_stream zs_;
+  bool zs_init_ = false;
+};
+
+}  // namespace ziputil
+#endif  // ZIP_STREAM_READER_H
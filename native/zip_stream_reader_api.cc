@@ -0,0 +1,127 @@
+#include "zip_stream_reader_api.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "napi.h"
+#include "zip_reader_api.h"
+
+namespace api {
+
+using namespace ziputil;
+
+class StreamFeedAsync : public Napi::AsyncWorker {
+ public:
+  StreamFeedAsync(Napi::Env env, ZipStreamReaderAPI* owner)
+      : Napi::AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        owner_(owner),
+        owner_ref_(Napi::Reference<Napi::Object>::New(owner->Value(), 1)) {}
+  ~StreamFeedAsync() {
+    owner_ref_.Unref();
+    if (!data_ref_.IsEmpty()) {
+      data_ref_.Unref();
+    }
+  }
+
+  void setData(Napi::Buffer<uint8_t>& data) {
+    data_ref_ = Napi::ObjectReference::New(data, 1);
+    data_ = data.Data();
+    len_ = data.ByteLength();
+  }
+
+  void Execute() override {
+    try {
+      const std::lock_guard<std::mutex> lock(owner_->mutex());
+      if (data_) {
+        owner_->parser()->feed(data_, len_, events_);
+      } else {
+        owner_->parser()->finish();
+      }
+    } catch (const std::exception& e) {
+      SetError(e.what());
+    }
+  }
+
+  // Executed when the async work is complete
+  // this function will be run inside the main event loop
+  // so it is safe to use JS engine data again
+  void OnOK() override {
+    Napi::Env env = Env();
+    Napi::HandleScope scope(env);
+    auto result = Napi::Array::New(env, events_.size());
+    for (size_t i = 0; i < events_.size(); ++i) {
+      auto& ev = events_[i];
+      auto obj = Napi::Object::New(env);
+      switch (ev.type) {
+        case ZipStreamParser::Event::kEntry:
+          obj.Set("type", "entry");
+          obj.Set("entry", EntryToObject(env, ev.entry));
+          break;
+        case ZipStreamParser::Event::kData:
+          obj.Set("type", "data");
+          obj.Set("data", Napi::Buffer<char>::Copy(env, ev.data.data(), ev.data.size()));
+          break;
+        case ZipStreamParser::Event::kEntryEnd:
+          obj.Set("type", "entry_end");
+          break;
+      }
+      result.Set((uint32_t)i, obj);
+    }
+    deferred.Resolve(result);
+  }
+
+  void OnError(Napi::Error const& error) override {
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise::Deferred deferred;
+
+ private:
+  ZipStreamReaderAPI* owner_;
+  Napi::Reference<Napi::Object> owner_ref_;
+  Napi::ObjectReference data_ref_;
+  const uint8_t* data_ = nullptr;
+  size_t len_ = 0;
+  std::vector<ZipStreamParser::Event> events_;
+};
+
+Napi::Object ZipStreamReaderAPI::Init(Napi::Env env, Napi::Object exports, AddonData* addon_data) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function func =
+      DefineClass(env, "ZipStreamReader",
+                  {InstanceMethod("write", &ZipStreamReaderAPI::write),
+                   InstanceMethod("end", &ZipStreamReaderAPI::end)}, nullptr);
+
+  addon_data->ctor_stream_reader = Napi::Persistent(func);
+  exports.Set("ZipStreamReader", func);
+  return exports;
+}
+
+ZipStreamReaderAPI::ZipStreamReaderAPI(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<ZipStreamReaderAPI>(info),
+      parser_(std::make_unique<ZipStreamParser>()) {}
+
+Napi::Value ZipStreamReaderAPI::write(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsBuffer()) {
+    Napi::TypeError::New(env, "Expected an Buffer").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto buf = info[0].As<Napi::Buffer<uint8_t>>();
+  auto* wk = new StreamFeedAsync(env, this);
+  wk->setData(buf);
+  wk->Queue();
+  return wk->deferred.Promise();
+}
+
+Napi::Value ZipStreamReaderAPI::end(const Napi::CallbackInfo& info) {
+  auto* wk = new StreamFeedAsync(info.Env(), this);
+  wk->Queue();
+  return wk->deferred.Promise();
+}
+
+}  // namespace api
@@ -0,0 +1,34 @@
+#ifndef ZIP_STREAM_READER_API_H
+#define ZIP_STREAM_READER_API_H
+#pragma once
+
+#include <napi.h>
+
+#include <memory>
+#include <mutex>
+
+#include "addon.h"
+#include "zip_stream_reader.h"
+
+namespace api {
+
+// Native side of mzip.parse(); chunks are pushed with write(buffer) and
+// each call resolves with the entry/data/entry_end events they complete.
+class ZipStreamReaderAPI : public Napi::ObjectWrap<ZipStreamReaderAPI> {
+ public:
+  static Napi::Object Init(Napi::Env env, Napi::Object exports, AddonData* addon_data);
+
+  ZipStreamReaderAPI(const Napi::CallbackInfo& info);
+
+  ziputil::ZipStreamParser* parser() { return parser_.get(); }
+  std::mutex& mutex() { return mu_; }
+
+ private:
+  Napi::Value write(const Napi::CallbackInfo& info);
+  Napi::Value end(const Napi::CallbackInfo& info);
+  std::unique_ptr<ziputil::ZipStreamParser> parser_;
+  std::mutex mu_;
+};
+
+}  // namespace api
+#endif /* ifndef ZIP_STREAM_READER_API_H */
@@ -0,0 +1,152 @@
+#include "zip_tree.h"
+
+#include <algorithm>
+
+#include "glob_matcher.h"
+#include "zip_reader.h"
+
+namespace ziputil {
+
+std::string ZipTree::normalize(const std::string& path) {
+  std::string p(path);
+  std::replace(p.begin(), p.end(), '\\', '/');
+  size_t begin = p.find_first_not_of('/');
+  if (begin == std::string::npos) {
+    return std::string();
+  }
+  size_t end = p.find_last_not_of('/');
+  return p.substr(begin, end - begin + 1);
+}
+
+void ZipTree::clear() {
+  nodes_.clear();
+  index_.clear();
+  folded_.clear();
+}
+
+void ZipTree::build(const std::vector<ZipEntry>& entries) {
+  clear();
+  nodes_.push_back(Node{std::string(), kNone, kNone, true, {}});
+  index_.emplace(std::string(), 0);
+  folded_.emplace(std::string(), 0);
+
+  // Entries of one directory are usually adjacent, so the parent of the
+  // previous entry is tried before walking down from the root.
+  std::string last_dir;
+  uint32_t last_parent = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    std::string p = normalize(entries[i].name);
+    if (p.empty()) {
+      continue;
+    }
+    size_t sep = p.rfind('/');
+    size_t name_pos = sep == std::string::npos ? 0 : sep + 1;
+    uint32_t parent = 0;
+    if (name_pos > 0 && p.compare(0, name_pos - 1, last_dir) == 0 &&
+        last_dir.size() == name_pos - 1) {
+      parent = last_parent;
+    } else if (name_pos > 0) {
+      size_t start = 0;
+      while (start < name_pos) {
+        size_t end = p.find('/', start);
+        parent = child(parent, p.substr(0, end), start);
+        nodes_[parent].is_directory = true;
+        start = end + 1;
+      }
+      last_dir = p.substr(0, name_pos - 1);
+      last_parent = parent;
+    }
+
+    uint32_t n = child(parent, p, name_pos);
+    Node& node = nodes_[n];
+    if (node.entry == kNone) {
+      node.entry = (int32_t)i;
+      node.is_directory = node.is_directory || entries[i].is_directory;
+    }
+  }
+
+  for (auto& node : nodes_) {
+    std::sort(node.children.begin(), node.children.end(),
+              [&](uint32_t a, uint32_t b) { return nodes_[a].name < nodes_[b].name; });
+  }
+}
+
+void ZipTree::assign(std::vector<Node> nodes) {
+  clear();
+  nodes_ = std::move(nodes);
+  std::vector<std::string> paths(nodes_.size());
+  index_.reserve(nodes_.size());
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    const Node& node = nodes_[i];
+    if (i > 0) {
+      paths[i] = node.parent > 0 ? paths[node.parent] + "/" + node.name : node.name;
+    }
+    index_.emplace(paths[i], (uint32_t)i);
+    folded_.emplace(GlobMatcher::fold(paths[i]), (uint32_t)i);
+  }
+}
+
+uint32_t ZipTree::child(uint32_t parent, const std::string& path, size_t name_pos) {
+  auto it = index_.find(path);
+  if (it != index_.end()) {
+    return it->second;
+  }
+  uint32_t n = (uint32_t)nodes_.size();
+  nodes_.push_back(Node{path.substr(name_pos), (int32_t)parent, kNone, false, {}});
+  nodes_[parent].children.push_back(n);
+  index_.emplace(path, n);
+  folded_.emplace(GlobMatcher::fold(path), n);
+  return n;
+}
+
+int32_t ZipTree::find(const std::string& path) const {
+  if (nodes_.empty()) {
+    return kNone;
+  }
+  std::string p = normalize(path);
+  auto it = index_.find(p);
+  if (it != index_.end()) {
+    return (int32_t)it->second;
+  }
+  it = folded_.find(GlobMatcher::fold(p));
+  return it == folded_.end() ? kNone : (int32_t)it->second;
+}
+
+std::string ZipTree::path(uint32_t index) const {
+  std::string p = nodes_[index].name;
+  for (int32_t i = nodes_[index].parent; i > 0; i = nodes_[i].parent) {
+    p = nodes_[i].name + "/" + p;
+  }
+  return p;
+}
+
+void ZipTree::walk(uint32_t index, std::vector<std::string>& out) const {
+  std::string base = path(index);
+  if (!base.empty()) {
+    base += '/';
+  }
+  // Explicit stack of (node, length of its parent's prefix in `prefix`).
+  std::vector<std::pair<uint32_t, size_t>> stack;
+  const auto& top = nodes_[index].children;
+  for (auto it = top.rbegin(); it != top.rend(); ++it) {
+    stack.emplace_back(*it, base.size());
+  }
+  std::string prefix = base;
+  while (!stack.empty()) {
+    uint32_t n = stack.back().first;
+    prefix.resize(stack.back().second);
+    stack.pop_back();
+
+    const Node& node = nodes_[n];
+    prefix += node.name;
+    if (node.is_directory) {
+      prefix += '/';
+    }
+    out.push_back(prefix);
+    for (auto it = node.children.rbegin(); it != node.children.rend(); ++it) {
+      stack.emplace_back(*it, prefix.size());
+    }
+  }
+}
+
+}  // namespace ziputil
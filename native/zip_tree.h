@@ -0,0 +1,58 @@
+#ifndef ZIP_TREE_H
+#define ZIP_TREE_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ziputil {
+
+struct ZipEntry;
+
+// Directory hierarchy of an archive, including directories that only exist
+// implicitly as a prefix of some entry name. Paths use `/`, without leading
+// or trailing separators; the root is "".
+class ZipTree {
+ public:
+  static const int32_t kNone = -1;
+
+  struct Node {
+    std::string name;              /* last path component */
+    int32_t parent;
+    int32_t entry;                 /* index into the entries, kNone if implicit */
+    bool is_directory;
+    std::vector<uint32_t> children; /* sorted by name */
+  };
+
+  void build(const std::vector<ZipEntry>& entries);
+  // Takes nodes as produced by build(), parents before children.
+  void assign(std::vector<Node> nodes);
+  void clear();
+  size_t size() const { return nodes_.size(); }
+
+  // Node index of `path` (either separator, surrounding slashes ignored),
+  // or kNone. Case is ignored, as by ZipReader::exists, where no path
+  // matches exactly.
+  int32_t find(const std::string& path) const;
+  const Node& node(uint32_t index) const { return nodes_[index]; }
+  std::string path(uint32_t index) const;
+
+  // Pre-order paths below `index`; directories end with `/`.
+  void walk(uint32_t index, std::vector<std::string>& out) const;
+
+  static std::string normalize(const std::string& path);
+
+ private:
+  uint32_t child(uint32_t parent, const std::string& path, size_t name_pos);
+
+  std::vector<Node> nodes_;
+  std::unordered_map<std::string, uint32_t> index_;
+  std::unordered_map<std::string, uint32_t> folded_;  /* by GlobMatcher::fold, first wins */
+};
+
+}  // namespace ziputil
+#endif  // ZIP_TREE_H
@@ -0,0 +1,210 @@
+#include "zip_verifier.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include <fmt/core.h>
+#include <zlib.h>
+
+#include "stats.h"
+#include "zstd_dict.h"
+
+namespace ziputil {
+
+namespace {
+
+const int32_t kDiscardSize = 256 * 1024;
+
+const char* describe(int32_t err) {
+  switch (err) {
+    case MZ_CRC_ERROR: return "CRC mismatch";
+    case MZ_PASSWORD_ERROR: return "wrong password";
+    case MZ_SUPPORT_ERROR: return "unsupported compression or encryption";
+    case MZ_DATA_ERROR: return "corrupt compressed data";
+    case MZ_FORMAT_ERROR: return "malformed entry";
+    default: return "read failed";
+  }
+}
+
+}  // namespace
+
+ZipVerifier::ZipVerifier(const std::string& archive, const std::string& password,
+                         const VerifyOptions& options,
+                         std::shared_ptr<const ZstdDictionary> dictionary)
+    : archive_(archive),
+      password_(password),
+      options_(options),
+      dictionary_(std::move(dictionary)) {}
+
+VerifyResult ZipVerifier::run(const std::vector<ZipEntry>& entries) {
+  auto t0 = std::chrono::steady_clock::now();
+  std::atomic<size_t> next{0};
+  std::mutex mu;
+  std::exception_ptr error;
+  VerifyResult result;
+
+  unsigned threads = std::max(1u, std::min<unsigned>(options_.threads, (unsigned)entries.size()));
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.emplace_back([&] {
+      VerifyResult mine;
+      try {
+        work(entries, next, mine);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mu);
+        error = std::current_exception();
+        next = entries.size();  // the others stop after their current entry
+      }
+      std::lock_guard<std::mutex> lock(mu);
+      result.entries += mine.entries;
+      result.bytes += mine.bytes;
+      result.compressed_bytes += mine.compressed_bytes;
+      result.failures.insert(result.failures.end(), mine.failures.begin(), mine.failures.end());
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  std::sort(result.failures.begin(), result.failures.end(),
+            [](const VerifyFailure& a, const VerifyFailure& b) { return a.index < b.index; });
+  result.seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  stats::add_bytes(stats::Op::kVerify, result.compressed_bytes, result.bytes);
+  return result;
+}
+
+// Claimed indices only grow, so every worker walks the central directory
+// forward once, skipping what the others took.
+void ZipVerifier::work(const std::vector<ZipEntry>& entries, std::atomic<size_t>& next,
+                       VerifyResult& result) {
+  MzReaderHandle reader;
+  if (!password_.empty()) {
+    mz_zip_reader_set_password(reader, password_.c_str());
+  }
+  int32_t err = mz_zip_reader_open_file(reader, archive_.c_str());
+  if (err != MZ_OK) {
+    throw ZipException(err, "opening archive failed");
+  }
+
+  std::unique_ptr<ZstdDictReader> zstd;
+  if (dictionary_) {
+    zstd.reset(new ZstdDictReader(archive_, dictionary_));
+  }
+
+  err = mz_zip_reader_goto_first_entry(reader);
+  size_t cursor = 0;
+  for (size_t i = next++; i < entries.size(); i = next++) {
+    while (err == MZ_OK && cursor < i) {
+      err = mz_zip_reader_goto_next_entry(reader);
+      ++cursor;
+    }
+    const ZipEntry& entry = entries[i];
+    std::string problem;
+    if (err != MZ_OK) {
+      problem = "missing from the central directory";
+    } else {
+      try {
+        problem = check(reader, zstd.get(), entry, result);
+      } catch (const std::exception& e) {
+        problem = e.what();
+      }
+    }
+    if (!problem.empty()) {
+      result.failures.push_back(VerifyFailure{i, entry.name, problem});
+    }
+  }
+}
+
+std::string ZipVerifier::check(void* reader, ZstdDictReader* zstd, const ZipEntry& entry,
+                               VerifyResult& result) {
+  mz_zip_file* info = nullptr;
+  int32_t err = mz_zip_reader_entry_get_info(reader, &info);
+  if (err != MZ_OK) {
+    return describe(err);
+  }
+  if (entry.name != info->filename) {
+    return "central directory changed since open";
+  }
+  if (entry.is_directory) {
+    return std::string();
+  }
+  ++result.entries;
+
+  // Minizip can not decode entries that need the archive's dictionary; the
+  // dictionary reader checks size and CRC itself.
+  int64_t decoded = 0;
+  if (zstd && info->compression_method == MZ_COMPRESS_METHOD_ZSTD &&
+      zstd->read(*info, [&](const char*, int32_t len) {
+        decoded += len;
+        return true;
+      })) {
+    result.compressed_bytes += info->compressed_size;
+    result.bytes += decoded;
+    return std::string();
+  }
+
+  err = mz_zip_reader_entry_open(reader);
+  if (err != MZ_OK) {
+    return describe(err);
+  }
+
+  // The local header must name the same entry, and agree on CRC and sizes
+  // unless a data descriptor carries them.
+  void* zip = nullptr;
+  mz_zip_file* local = nullptr;
+  mz_zip_reader_get_zip_handle(reader, &zip);
+  std::string problem;
+  if (mz_zip_entry_get_local_info(zip, &local) == MZ_OK && local != nullptr) {
+    if (local->filename == nullptr || strcmp(local->filename, info->filename) != 0) {
+      problem = "local header names a different entry";
+    } else if ((local->flag & MZ_ZIP_FLAG_DATA_DESCRIPTOR) == 0 &&
+               (local->crc != info->crc || local->compressed_size != info->compressed_size ||
+                local->uncompressed_size != info->uncompressed_size)) {
+      problem = "local header disagrees with the central directory";
+    }
+  }
+
+  std::vector<uint8_t> buf(kDiscardSize);
+  uLong crc = crc32(0, Z_NULL, 0);
+  int64_t total = 0;
+  int32_t n = 0;
+  while (problem.empty() &&
+         (n = mz_zip_reader_entry_read(reader, buf.data(), (int32_t)buf.size())) > 0) {
+    crc = crc32(crc, buf.data(), (uInt)n);
+    total += n;
+  }
+  // Closing checks the CRC, or the authentication code of AES entries.
+  err = mz_zip_reader_entry_close(reader);
+  result.compressed_bytes += info->compressed_size;
+  result.bytes += total;
+  if (!problem.empty()) {
+    return problem;
+  }
+  if (n < 0) {
+    return describe(n);
+  }
+  if (err != MZ_OK) {
+    return describe(err);
+  }
+  if (total != info->uncompressed_size) {
+    return fmt::format("inflated to {} bytes, the central directory says {}", total,
+                       info->uncompressed_size);
+  }
+  // AE-2 entries store no CRC; the authentication code stands in for it.
+  bool has_crc = !(info->flag & MZ_ZIP_FLAG_ENCRYPTED) || info->aes_version != 2;
+  if (has_crc && (uint32_t)crc != info->crc) {
+    return "CRC mismatch";
+  }
+  return std::string();
+}
+
+}  // namespace ziputil
@@ -0,0 +1,64 @@
+#ifndef ZIP_VERIFIER_H
+#define ZIP_VERIFIER_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "zip_reader.h"
+
+namespace ziputil {
+
+struct VerifyOptions {
+  unsigned threads = 4;
+};
+
+struct VerifyFailure {
+  size_t index;
+  std::string name;
+  std::string error;
+};
+
+struct VerifyResult {
+  uint64_t entries = 0;           /* checked, directories not counted */
+  uint64_t bytes = 0;             /* inflated */
+  uint64_t compressed_bytes = 0;
+  double seconds = 0;
+  std::vector<VerifyFailure> failures;  /* in archive order */
+};
+
+// Checks every entry of an archive without writing anything. Each worker
+// opens its own reader handle, takes the next unchecked entry, inflates it
+// into a discard buffer and compares CRC, size and local header with the
+// central directory.
+class ZipVerifier {
+ public:
+  // `dictionary` decodes zstd entries written with it, as ZipReader does.
+  ZipVerifier(const std::string& archive, const std::string& password,
+              const VerifyOptions& options,
+              std::shared_ptr<const ZstdDictionary> dictionary = nullptr);
+
+  // `entries` in central directory order, as ZipReader lists them. Throws
+  // ZipException when the archive can not be opened at all.
+  VerifyResult run(const std::vector<ZipEntry>& entries);
+
+ private:
+  void work(const std::vector<ZipEntry>& entries, std::atomic<size_t>& next,
+            VerifyResult& result);
+  // Empty when the current entry checks out.
+  std::string check(void* reader, ZstdDictReader* zstd, const ZipEntry& entry,
+                    VerifyResult& result);
+
+  std::string archive_;
+  std::string password_;
+  VerifyOptions options_;
+  std::shared_ptr<const ZstdDictionary> dictionary_;
+};
+
+}  // namespace ziputil
+#endif  // ZIP_VERIFIER_H
@@ -1,11 +1,265 @@
 #include "zip_writer.h"
 
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
 
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include <mz_crypt.h>
+#include <zlib.h>
+
+#include "fs_util.h"
+#include "stats.h"
+#include "wzaes.h"
 #include "zip_common.h"
 
 namespace ziputil {
 
+namespace {
+
+const int32_t kCopyBufferSize = 64 * 1024;
+const int64_t kMaxPreparedSize = 64 * 1024 * 1024;
+const unsigned kMaxEncryptThreads = 4;
+// Content addDir holds in memory ahead of the entry being compressed.
+const int64_t kMaxPrefetchBytes = 64 * 1024 * 1024;
+// Deterministic mode: the made-by of every entry, whatever system writes it.
+const uint16_t kPortableMadeBy = (MZ_HOST_SYSTEM_UNIX << 8) | (MZ_VERSION_MADEBY & 0xFF);
+
+inline double elapsed_ms(std::chrono::steady_clock::time_point since) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Streaming SHA-256 of the entry content. The digest and the length together
+// identify an input for deduplication.
+class ContentHash {
+ public:
+  ContentHash() : sha_(nullptr) {
+    mz_crypt_sha_create(&sha_);
+    mz_crypt_sha_set_algorithm(sha_, MZ_HASH_SHA256);
+    mz_crypt_sha_begin(sha_);
+  }
+  ~ContentHash() { mz_crypt_sha_delete(&sha_); }
+
+  ContentHash(const ContentHash&) = delete;
+  ContentHash& operator=(const ContentHash&) = delete;
+
+  void update(const void* buf, size_t len) {
+    auto p = static_cast<const uint8_t*>(buf);
+    while (len > 0) {
+      int32_t n = (int32_t)std::min<size_t>(len, kCopyBufferSize);
+      mz_crypt_sha_update(sha_, p, n);
+      size_ += n;
+      p += n;
+      len -= n;
+    }
+  }
+
+  std::string key() {
+    uint8_t digest[MZ_HASH_SHA256_SIZE] = {0};
+    mz_crypt_sha_end(sha_, digest, sizeof(digest));
+    std::string k(reinterpret_cast<const char*>(digest), sizeof(digest));
+    k.append(reinterpret_cast<const char*>(&size_), sizeof(size_));
+    return k;
+  }
+
+  int64_t size() const { return size_; }
+
+ private:
+  void* sha_;
+  int64_t size_ = 0;
+};
+
+bool crcFile(const std::string& path, uint32_t& crc, int64_t& size) {
+  MzOsStream stream;
+  if (mz_stream_open(stream, path.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    return false;
+  }
+  std::vector<uint8_t> buf(kCopyBufferSize);
+  uLong value = crc32(0, Z_NULL, 0);
+  size = 0;
+  int32_t n = 0;
+  while ((n = mz_stream_read(stream, buf.data(), (int32_t)buf.size())) > 0) {
+    value = crc32(value, buf.data(), (uInt)n);
+    size += n;
+  }
+  crc = (uint32_t)value;
+  return n == 0;
+}
+
+bool hashFile(const std::string& path, ContentHash& hash) {
+  MzOsStream stream;
+  if (mz_stream_open(stream, path.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    return false;
+  }
+  std::vector<uint8_t> buf(kCopyBufferSize);
+  int32_t n = 0;
+  while ((n = mz_stream_read(stream, buf.data(), (int32_t)buf.size())) > 0) {
+    hash.update(buf.data(), n);
+  }
+  return n == 0;
+}
+
+// Same attribute layout mz_zip_writer_add_file stores for a file on disk.
+uint32_t externalAttribs(const std::string& path) {
+  uint32_t src_attrib = 0;
+  uint32_t target_attrib = 0;
+  uint32_t external_fa = 0;
+  uint8_t src_sys = MZ_HOST_SYSTEM(MZ_VERSION_MADEBY);
+  if (mz_os_get_file_attribs(path.c_str(), &src_attrib) != MZ_OK) {
+    return 0;
+  }
+  if (src_sys != MZ_HOST_SYSTEM_MSDOS && src_sys != MZ_HOST_SYSTEM_WINDOWS_NTFS) {
+    if (mz_zip_attrib_convert(src_sys, src_attrib, MZ_HOST_SYSTEM_MSDOS, &target_attrib) == MZ_OK) {
+      external_fa = target_attrib;
+    }
+    external_fa |= (src_attrib << 16);
+  } else {
+    external_fa = src_attrib;
+  }
+  return external_fa;
+}
+
+// Regular files 0644, or 0755 when anyone may execute them, directories
+// 0755 and links 0777; owner, group and DOS bits are dropped.
+uint32_t portableAttribs(uint32_t external_fa, bool is_dir) {
+  uint32_t mode = external_fa >> 16;
+  if (is_dir || (external_fa & 0x10) || (mode & 0170000) == 0040000) {
+    return (0040755u << 16) | 0x10;
+  }
+  if ((mode & 0170000) == 0120000) {
+    return 0120777u << 16;
+  }
+  return ((mode & 0111) ? 0100755u : 0100644u) << 16;
+}
+
+// A time_t that localtime turns into the UTC fields of `t`. DOS dates have
+// no time zone and minizip converts through localtime, so this makes the
+// stored fields the same in every zone (bar times in a daylight saving gap).
+time_t utcFields(time_t t) {
+  struct tm fields;
+#if defined(_WIN32)
+  gmtime_s(&fields, &t);
+#else
+  gmtime_r(&t, &fields);
+#endif
+  fields.tm_isdst = -1;
+  return mktime(&fields);
+}
+
+// Whole file, false when it can not be read or is not `size` bytes long.
+bool readContent(const std::string& path, int64_t size, std::vector<uint8_t>& content) {
+  content.resize((size_t)size + 1);
+  MzOsStream stream;
+  if (mz_stream_open(stream, path.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    return false;
+  }
+  int64_t total = 0;
+  int32_t n = 0;
+  while (total < (int64_t)content.size() &&
+         (n = mz_stream_read(stream, content.data() + total,
+                             (int32_t)(content.size() - total))) > 0) {
+    total += n;
+  }
+  content.resize((size_t)size);
+  return n >= 0 && total == size;
+}
+
+std::string entryName(const std::string& path, const std::string& newname) {
+  std::string name = newname.empty() ? fs_util::basename(path) : newname;
+  auto pos = name.find_first_not_of("/\\");
+  return pos == std::string::npos ? std::string() : name.substr(pos);
+}
+
+// The level bits of the general purpose flag, as mz_zip_entry_write_open
+// sets them for a deflated entry.
+const uint16_t kLevelFlags = MZ_ZIP_FLAG_DEFLATE_SUPER_FAST;
+uint16_t levelFlags(uint16_t method, int level) {
+  if (method != MZ_COMPRESS_METHOD_DEFLATE) {
+    return 0;
+  }
+  if (level == 8 || level == 9) {
+    return MZ_ZIP_FLAG_DEFLATE_MAX;
+  }
+  if (level == 2) {
+    return MZ_ZIP_FLAG_DEFLATE_FAST;
+  }
+  return level == 1 ? MZ_ZIP_FLAG_DEFLATE_SUPER_FAST : 0;
+}
+
+// Raw deflate; MZ_COMPRESS_LEVEL_DEFAULT is zlib's default as well.
+bool deflateRaw(const uint8_t* data, size_t len, int level, std::vector<uint8_t>& out) {
+  z_stream zs = {};
+  if (deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  out.resize(deflateBound(&zs, (uLong)len));
+  zs.next_in = const_cast<Bytef*>(data);
+  zs.avail_in = (uInt)len;
+  zs.next_out = out.data();
+  zs.avail_out = (uInt)out.size();
+  int err = deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  return err == Z_STREAM_END;
+}
+
+// Deflates `data` into the entry, or with a dictionary compresses it with
+// zstd, or stores it at level 0 or when that does not shrink it.
+void compressInto(PreparedEntry& entry, const uint8_t* data, size_t len, int level,
+                  const ZstdDictionary* dict) {
+  entry.uncompressed_size = (int64_t)len;
+  entry.crc = (uint32_t)crc32(0, data, (uInt)len);
+  bool packed = false;
+  if (len > 0 && level != 0 && dict) {
+    dict->compress(data, len, level, entry.data);
+    entry.compression_method = MZ_COMPRESS_METHOD_ZSTD;
+    packed = entry.data.size() < len;
+  } else if (len > 0 && level != 0) {
+    entry.compression_method = MZ_COMPRESS_METHOD_DEFLATE;
+    packed = deflateRaw(data, len, level, entry.data) && entry.data.size() < len;
+  }
+  if (!packed) {
+    entry.compression_method = MZ_COMPRESS_METHOD_STORE;
+    entry.data.assign(data, data + len);
+  }
+  entry.level_flags = levelFlags(entry.compression_method, level);
+}
+
+// Wraps the payload as AES-256 AE-1, as mz_zip_writer_set_aes has minizip
+// write it: random salt, key derivation and encryption all happen here, on
+// the preparing thread, instead of under the writer.
+void encryptInto(PreparedEntry& entry, const std::string& password) {
+  const int32_t key_length = MZ_AES_KEY_LENGTH(MZ_AES_ENCRYPTION_MODE_256);
+  const int32_t salt_length = key_length / 2;
+  const size_t header = salt_length + kAesVerifierSize;
+  const size_t body = entry.data.size();
+
+  std::vector<uint8_t> data(header + body + kAesMacSize);
+  random_bytes(data.data(), salt_length);
+  AesKeys keys;
+  derive_aes_keys(password, data.data(), key_length, keys);
+  memcpy(data.data() + salt_length, keys.verifier, kAesVerifierSize);
+  if (body > 0) {
+    memcpy(data.data() + header, entry.data.data(), body);
+  }
+  uint8_t mac[kAesMacSize];
+  unsigned threads = std::min(kMaxEncryptThreads, std::thread::hardware_concurrency());
+  aes_encrypt(keys, data.data() + header, body, threads, mac);
+  memcpy(data.data() + header + body, mac, kAesMacSize);
+
+  entry.data = std::move(data);
+  entry.aes_version = MZ_AES_VERSION;
+  entry.aes_encryption_mode = MZ_AES_ENCRYPTION_MODE_256;
+}
+
+}  // namespace
+
 bool ZipDir(const std::string& dir, const std::string& zipfile,
             const std::string& password) {
   ZipWriter w(zipfile, password);
@@ -20,67 +274,1002 @@ ZipWriter::ZipWriter(const std::string& filename, const std::string& password) {
 }
 
 bool ZipWriter::create(const std::string& filename,
-                       const std::string& password) {
+                       const std::string& password,
+                       const WriterOptions& options) {
   assert(!is_open_);
   if (is_open_) {
     return false;
   }
 
+  filename_ = filename;
   password_ = password;
+  options_ = options;
   mz_zip_writer_set_password(writer_, password_.c_str());
   mz_zip_writer_set_aes(writer_, 1);
+  applyLevel(options_.level);
+  tuner_.reset();
+  dict_.reset();
+  block_.clear();
+  blocks_ = 0;
+  solid_files_.clear();
+  if (!options_.dictionary.empty()) {
+    // Encrypted entries are decoded by WzAesReader, which knows no zstd.
+    if (!password_.empty()) {
+      throw ZipException(MZ_PARAM_ERROR, "a dictionary can not be combined with a password");
+    }
+    dict_.reset(new ZstdDictionary(options_.dictionary));
+    options_.method = MZ_COMPRESS_METHOD_ZSTD;
+    applyLevel(options_.level);
+  }
+  if (options_.deterministic && !password_.empty()) {
+    throw ZipException(MZ_PARAM_ERROR, "a deterministic archive can not be encrypted");
+  }
+  if (options_.deterministic && options_.auto_level) {
+    throw ZipException(MZ_PARAM_ERROR, "automatic levels depend on timing, not only on input");
+  }
+  previous_.clear();
+  if (!options_.previous.empty()) {
+    loadPrevious();
+  }
+  if (options_.auto_level) {
+    bool zstd = options_.method == MZ_COMPRESS_METHOD_ZSTD;
+    int start = options_.level > 0 ? options_.level : (zstd ? 3 : 6);
+    tuner_.reset(new LevelTuner(1, zstd ? 19 : 9, start, options_.target));
+  }
   // mz_zip_writer_set_zip_cd(writer_, 1);
-  int32_t err = mz_zip_writer_open_file(writer_, filename.c_str(), 0, 0);
+  int32_t err = MZ_OK;
+  if (options_.dedup) {
+    // Dedup reads written payloads back, so the archive goes straight to an
+    // os stream (no buffered/split layers) whose positions are file offsets.
+    err = mz_stream_open(out_stream_, filename.c_str(),
+                         MZ_OPEN_MODE_WRITE | MZ_OPEN_MODE_CREATE);
+    if (err == MZ_OK) {
+      err = mz_zip_writer_open(writer_, out_stream_);
+    }
+  } else {
+    err = mz_zip_writer_open_file(writer_, filename.c_str(), 0, 0);
+  }
   if (err != MZ_OK) {
     return false;
   }
   is_open_ = true;
+  if (dict_) {
+    addDictionary();
+  }
   return true;
 }
 
+ZipWriter::~ZipWriter() {
+  try {
+    close();
+  } catch (const std::exception&) {
+  }
+}
+
 bool ZipWriter::close() {
   if (is_open_) {
+    // The central directory is written even when the last block fails.
+    std::exception_ptr error;
+    try {
+      finishSolid();
+    } catch (...) {
+      error = std::current_exception();
+    }
     is_open_ = false;
     mz_zip_writer_close(writer_);
+    if (mz_stream_is_open(out_stream_) == MZ_OK) {
+      mz_stream_close(out_stream_);
+    }
+    if (mz_stream_is_open(blob_reader_) == MZ_OK) {
+      mz_stream_close(blob_reader_);
+    }
+    if (mz_stream_is_open(previous_stream_) == MZ_OK) {
+      mz_stream_close(previous_stream_);
+    }
+    blobs_.clear();
+    previous_.clear();
+    if (tuner_) {
+      stats_.levels = tuner_->report();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
   }
   return true;
 }
 
 bool ZipWriter::addDir(const std::string& dir, const std::string& rootPath,
-                       bool recursive) {
+                       bool recursive, const ScanOptions& scan) {
+  ScanOptions options = scan;
+  options.recursive = recursive;
+  if (options_.deterministic) {
+    options.order = ScanOrder::kName;
+  }
+  // mz_zip_writer_add_path neither dedups, takes a zip64 mode, changes the
+  // level between files, reads ahead, nor filters.
+  if (options_.dedup || options_.zip64 != Zip64Mode::kAuto || tuner_ || dict_ ||
+      options_.solid_block > 0 || options_.prefetch > 0 || !options.include.empty() ||
+      !options.exclude.empty() || options.symlinks != SymlinkPolicy::kFollow ||
+      options.order != ScanOrder::kDirectory) {
+    return addPath(dir, rootPath, rootPath.empty(), options);
+  }
+
+  int64_t start = stats::enabled() ? tell() : 0;
   int32_t err = mz_zip_writer_add_path(
       writer_, dir.c_str(), rootPath.empty() ? NULL : rootPath.c_str(),
       rootPath.empty() ? 1 : 0, recursive);
   if (err != MZ_OK) {
     throw ZipException(err, "Error adding path to archive");
   }
+  if (stats::enabled()) {
+    stats::add_bytes(stats::Op::kAddDir, 0, tell() - start);
+  }
+  return true;
+}
+
+// Mirrors mz_zip_writer_add_path so that every file passes through addFile
+// and its dedup lookup.
+bool ZipWriter::addPath(const std::string& path, const std::string& rootPath,
+                        bool include_path, const ScanOptions& scan) {
+  std::vector<CollectedPath> files;
+  collectPath(path, rootPath, include_path, scan, files);
+  if (options_.prefetch == 0) {
+    for (auto& f : files) {
+      if (f.link) {
+        addLink(f.path, f.name);
+      } else {
+        addInput(f.path, f.name, nullptr);
+      }
+    }
+    return true;
+  }
+
+  // Later files are read while the current one is compressed; stored links
+  // are not read at all.
+  std::vector<std::string> paths;
+  paths.reserve(files.size());
+  for (auto& f : files) {
+    if (!f.link) {
+      paths.push_back(f.path);
+    }
+  }
+  InputPrefetcher prefetcher(std::move(paths), options_.prefetch, kMaxPrefetchBytes);
+  for (auto& f : files) {
+    if (f.link) {
+      addLink(f.path, f.name);
+    } else {
+      auto input = prefetcher.next();
+      addInput(f.path, f.name, input.get());
+    }
+  }
   return true;
 }
 
+void ZipWriter::collectPath(const std::string& path, const std::string& rootPath,
+                            bool include_path, const ScanOptions& scan,
+                            std::vector<CollectedPath>& out) {
+  bool store_links = scan.symlinks == SymlinkPolicy::kStore;
+  std::string dir = path;
+  std::string root = rootPath;
+  ScanOptions options = scan;
+
+  if (path.find('*') != std::string::npos) {
+    dir = fs_util::dirname(path);
+    options.wildcard = fs_util::basename(path);
+    root = dir;
+  } else {
+    bool is_dir = mz_os_is_dir(path.c_str()) == MZ_OK;
+    if (root.empty()) {
+      root = path;
+    }
+
+    std::string name = path;
+    if (!include_path) {
+      name = (!is_dir && root == path) ? fs_util::basename(path) : path.substr(std::min(root.size(), path.size()));
+    }
+    if (!name.empty()) {
+      out.push_back(CollectedPath{
+          path, name, store_links && mz_os_is_symlink(path.c_str()) == MZ_OK});
+    }
+    if (!is_dir) {
+      return;
+    }
+    options.wildcard.clear();
+  }
+
+  for (auto& p : scan_dir(dir, options)) {
+    out.push_back(CollectedPath{
+        p.path, include_path ? p.path : p.path.substr(std::min(root.size(), p.path.size())),
+        store_links && p.is_symlink});
+  }
+}
+
 bool ZipWriter::addFile(const std::string& path, const std::string& newname) {
-  int32_t err = mz_zip_writer_add_file(
-      writer_, path.c_str(), newname.empty() ? nullptr : newname.c_str());
+  // Large files are streamed with the kernel reading ahead; smaller ones
+  // gain nothing from a second copy in memory.
+  std::unique_ptr<InputFile> input;
+  if (options_.prefetch > 0 && mz_os_get_file_size(path.c_str()) > kMaxPreparedSize) {
+    input = InputFile::open(path, 0);
+  }
+  return addInput(path, newname, input.get());
+}
+
+void ZipWriter::addLink(const std::string& path, const std::string& newname) {
+  if (options_.deterministic) {
+    // What minizip stores for a link, minus the link's own time and mode.
+    char target[1024] = {0};
+    if (mz_os_read_symlink(path.c_str(), target, sizeof(target)) != MZ_OK) {
+      throw ZipException(MZ_OPEN_ERROR, "Error reading link");
+    }
+    std::string name = entryName(path, newname);
+    mz_zip_file file_info = {};
+    file_info.filename = name.c_str();
+    file_info.linkname = target;
+    file_info.flag = MZ_ZIP_FLAG_UTF8;
+    file_info.compression_method = MZ_COMPRESS_METHOD_STORE;
+    file_info.external_fa = 0120777u << 16;
+    file_info.zip64 = zip64();
+    normalize(file_info);
+    int32_t err = mz_zip_writer_add_info(writer_, nullptr, nullptr, &file_info);
+    if (err != MZ_OK) {
+      throw ZipException(err, "Error adding path to archive");
+    }
+    ++stats_.entries;
+    return;
+  }
+
+  mz_zip_writer_set_store_links(writer_, 1);
+  int32_t err = mz_zip_writer_add_file(writer_, path.c_str(),
+                                       newname.empty() ? nullptr : newname.c_str());
+  mz_zip_writer_set_store_links(writer_, 0);
+  if (err != MZ_OK) {
+    throw ZipException(err, "Error adding path to archive");
+  }
+  ++stats_.entries;
+}
+
+bool ZipWriter::addInput(const std::string& path, const std::string& newname,
+                         InputFile* input) {
+  const uint8_t* data = input ? input->data() : nullptr;
+  if (options_.solid_block > 0 && (input || (mz_os_is_dir(path.c_str()) != MZ_OK &&
+                                             mz_os_is_symlink(path.c_str()) != MZ_OK))) {
+    int64_t input_size = input ? input->size() : mz_os_get_file_size(path.c_str());
+    std::vector<uint8_t> content;
+    if (solid(input_size) && (data || readContent(path, input_size, content))) {
+      time_t modified_date = 0, accessed_date = 0, creation_date = 0;
+      mz_os_get_file_date(path.c_str(), &modified_date, &accessed_date, &creation_date);
+      addSolid(entryName(path, newname), data ? data : content.data(), (size_t)input_size,
+               modified_date, externalAttribs(path));
+      return true;
+    }
+  }
+
+  if (!previous_.empty() && (input || (mz_os_is_dir(path.c_str()) != MZ_OK &&
+                                       mz_os_is_symlink(path.c_str()) != MZ_OK))) {
+    uint32_t crc = 0;
+    int64_t input_size = 0;
+    if (data) {
+      crc = (uint32_t)crc32(0, data, (uInt)input->size());
+      input_size = input->size();
+    }
+    std::string name = entryName(path, newname);
+    const PreviousEntry* previous = nullptr;
+    if (data || crcFile(path, crc, input_size)) {
+      previous = unchanged(name, levelFor(classify(path)), input_size, crc);
+    }
+    if (previous) {
+      mz_zip_file file_info = {};
+      file_info.filename = name.c_str();
+      mz_os_get_file_date(path.c_str(), &file_info.modified_date,
+                          &file_info.accessed_date, &file_info.creation_date);
+      file_info.external_fa = externalAttribs(path);
+      copyPrevious(*previous, file_info);
+      return true;
+    }
+  }
+
+  std::string key;
+  int64_t size = 0;
+  std::unique_ptr<InputFile> owned;
+  if (options_.dedup && (input || (mz_os_is_dir(path.c_str()) != MZ_OK &&
+                                    mz_os_is_symlink(path.c_str()) != MZ_OK))) {
+    // The hash decides whether the file is written at all, so it comes
+    // first. Files up to kMaxPreparedSize are read once, into memory, for
+    // both; larger ones are read a second time to be compressed.
+    if (!data && mz_os_get_file_size(path.c_str()) <= kMaxPreparedSize) {
+      owned = InputFile::open(path, kMaxPreparedSize);
+      if (owned) {
+        input = owned.get();
+        data = input->data();
+      }
+    }
+    ContentHash hash;
+    if (data) {
+      hash.update(data, (size_t)input->size());
+    } else if (!hashFile(path, hash)) {
+      throw ZipException(MZ_OPEN_ERROR, "Error reading file");
+    }
+    key = hash.key();
+    size = hash.size();
+
+    auto it = blobs_.find(key);
+    if (it != blobs_.end()) {
+      std::string name = entryName(path, newname);
+      mz_zip_file file_info = {};
+      file_info.filename = name.c_str();
+      mz_os_get_file_date(path.c_str(), &file_info.modified_date,
+                          &file_info.accessed_date, &file_info.creation_date);
+      file_info.external_fa = externalAttribs(path);
+      copyBlob(it->second, file_info);
+      return true;
+    }
+  }
+
+  // minizip's zstd stream takes no dictionary, so those entries are
+  // compressed here; only directories, symlinks and large files are not.
+  if (dict_) {
+    int64_t start = key.empty() ? 0 : tell();
+    auto t0 = std::chrono::steady_clock::now();
+    auto entry = loadFile(path, newname, input);
+    if (entry) {
+      addPrepared(*entry);
+      if (!key.empty()) {
+        recordBlob(key, size, start, tell(), elapsed_ms(t0));
+      }
+      return true;
+    }
+  }
+
+  EntryClass entry_class = classify(path);
+  int level = levelFor(entry_class);
+  applyLevel(level);
+  bool measure = !key.empty() || stats::enabled() || tuner_;
+  int64_t start = measure ? tell() : 0;
+  auto t0 = std::chrono::steady_clock::now();
+  int32_t err = options_.zip64 == Zip64Mode::kAuto && !input && !options_.deterministic
+                    ? mz_zip_writer_add_file(writer_, path.c_str(),
+                                             newname.empty() ? nullptr : newname.c_str())
+                    : writeFile(path, newname, level, input);
   if (err != MZ_OK) {
     throw ZipException(err, "Error adding path to archive");
   }
+  if (measure) {
+    int64_t end = tell();
+    int64_t input_size =
+        input ? input->size() : std::max<int64_t>(0, mz_os_get_file_size(path.c_str()));
+    if (!key.empty()) {
+      recordBlob(key, size, start, end, elapsed_ms(t0));
+    }
+    if (tuner_ && mz_os_is_dir(path.c_str()) != MZ_OK) {
+      recordAdd(entry_class, level, input_size, start, t0);
+    }
+    stats::add_bytes(stats::Op::kAddFile, input_size, end - start);
+  }
+  ++stats_.entries;
   return true;
 }
 
 bool ZipWriter::addBuffer(const std::string& name, const FileInfo& buf) {
-  mz_zip_file file_info = {0};
+  if (solid((int64_t)buf.len)) {
+    addSolid(name, static_cast<const uint8_t*>(buf.data), buf.len, now(), 0);
+    return true;
+  }
+
+  mz_zip_file file_info = {};
   file_info.filename = name.c_str();
   file_info.comment = buf.comment.empty() ? nullptr : buf.comment.c_str();
-  file_info.modified_date = time(NULL);
+  file_info.modified_date = now();
+  EntryClass entry_class = classify(name);
+  int level = levelFor(entry_class);
+  applyLevel(level);
   file_info.version_madeby = MZ_VERSION_MADEBY;
-  file_info.compression_method = MZ_COMPRESS_METHOD_DEFLATE;
+  file_info.compression_method = level == 0 ? MZ_COMPRESS_METHOD_STORE : options_.method;
   file_info.aes_version = 1;
   file_info.flag = MZ_ZIP_FLAG_UTF8;
+  file_info.uncompressed_size = (int64_t)buf.len;
+  file_info.zip64 = zip64();
+  if (buf.len > INT32_MAX) {
+    throw ZipException(MZ_PARAM_ERROR, "Buffer larger than 2 GiB, add it as a file");
+  }
+
+  if (!previous_.empty()) {
+    uint32_t crc = (uint32_t)crc32(0, static_cast<const Bytef*>(buf.data), (uInt)buf.len);
+    if (auto previous = unchanged(name, level, (int64_t)buf.len, crc)) {
+      copyPrevious(*previous, file_info);
+      return true;
+    }
+  }
+
+  std::string key;
+  int64_t size = (int64_t)buf.len;
+  if (options_.dedup) {
+    ContentHash hash;
+    hash.update(buf.data, buf.len);
+    key = hash.key();
+
+    auto it = blobs_.find(key);
+    if (it != blobs_.end()) {
+      copyBlob(it->second, file_info);
+      return true;
+    }
+  }
+
+  if (dict_ && (int64_t)buf.len <= kMaxPreparedSize) {
+    int64_t start = key.empty() ? 0 : tell();
+    auto t0 = std::chrono::steady_clock::now();
+    addPrepared(*loadBuffer(name, buf));
+    if (!key.empty()) {
+      recordBlob(key, size, start, tell(), elapsed_ms(t0));
+    }
+    return true;
+  }
+
+  bool measure = !key.empty() || stats::enabled() || tuner_;
+  int64_t start = measure ? tell() : 0;
+  auto t0 = std::chrono::steady_clock::now();
+  normalize(file_info);
   int32_t err =
       mz_zip_writer_add_buffer(writer_, buf.data, buf.len, &file_info);
   if (err != MZ_OK) {
     throw ZipException(err, "Error adding data to archive");
   }
+  if (measure) {
+    int64_t end = tell();
+    if (!key.empty()) {
+      recordBlob(key, size, start, end, elapsed_ms(t0));
+    }
+    if (tuner_) {
+      recordAdd(entry_class, level, size, start, t0);
+    }
+    stats::add_bytes(stats::Op::kAddBuffer, buf.len, end - start);
+  }
+  ++stats_.entries;
   return true;
 }
 
+std::unique_ptr<PreparedEntry> ZipWriter::prepareFile(const std::string& path,
+                                                      const std::string& newname) const {
+  // Dedup hashes as it writes; zstd without a dictionary is left to minizip.
+  if (options_.dedup || !preparable() ||
+      (options_.solid_block > 0 && solid(mz_os_get_file_size(path.c_str())))) {
+    return nullptr;
+  }
+  return loadFile(path, newname);
+}
+
+std::unique_ptr<PreparedEntry> ZipWriter::prepareBuffer(const std::string& name,
+                                                        const FileInfo& buf) const {
+  if (options_.dedup || !preparable() || solid((int64_t)buf.len)) {
+    return nullptr;
+  }
+  return loadBuffer(name, buf);
+}
+
+bool ZipWriter::preparable() const {
+  return options_.method == MZ_COMPRESS_METHOD_DEFLATE || dict_;
+}
+
+std::unique_ptr<PreparedEntry> ZipWriter::loadFile(const std::string& path,
+                                                   const std::string& newname,
+                                                   const InputFile* input) const {
+  if (!input && (mz_os_is_dir(path.c_str()) == MZ_OK ||
+                 mz_os_is_symlink(path.c_str()) == MZ_OK)) {
+    return nullptr;
+  }
+  int64_t size = input ? input->size() : mz_os_get_file_size(path.c_str());
+  if (size < 0 || size > kMaxPreparedSize) {
+    return nullptr;
+  }
+
+  std::vector<uint8_t> content;
+  const uint8_t* data = input ? input->data() : nullptr;
+  if (!data) {
+    if (!readContent(path, size, content)) {
+      return nullptr;  // changed while reading; addFile reports what it finds
+    }
+    data = content.data();
+  }
+  std::string name = entryName(path, newname);
+  if (!previous_.empty() &&
+      unchanged(name, levelFor(classify(name)), size, (uint32_t)crc32(0, data, (uInt)size))) {
+    return nullptr;  // copied by addFile instead of compressed again
+  }
+
+  auto entry = std::make_unique<PreparedEntry>();
+  entry->op = stats::Op::kAddFile;
+  entry->name = name;
+  mz_os_get_file_date(path.c_str(), &entry->modified_date, &entry->accessed_date,
+                      &entry->creation_date);
+  entry->external_fa = externalAttribs(path);
+  compress(*entry, data, (size_t)size);
+  if (!password_.empty()) {
+    encryptInto(*entry, password_);
+  }
+  return entry;
+}
+
+std::unique_ptr<PreparedEntry> ZipWriter::loadBuffer(const std::string& name,
+                                                     const FileInfo& buf) const {
+  if ((int64_t)buf.len > kMaxPreparedSize) {
+    return nullptr;
+  }
+  if (!previous_.empty() &&
+      unchanged(name, levelFor(classify(name)), (int64_t)buf.len,
+                (uint32_t)crc32(0, static_cast<const Bytef*>(buf.data), (uInt)buf.len))) {
+    return nullptr;  // copied by addBuffer instead of compressed again
+  }
+  auto entry = std::make_unique<PreparedEntry>();
+  entry->op = stats::Op::kAddBuffer;
+  entry->name = name;
+  entry->comment = buf.comment;
+  entry->modified_date = now();
+  compress(*entry, static_cast<const uint8_t*>(buf.data), buf.len);
+  if (!password_.empty()) {
+    encryptInto(*entry, password_);
+  }
+  return entry;
+}
+
+bool ZipWriter::addPrepared(const PreparedEntry& entry) {
+  int64_t start = stats::enabled() ? tell() : 0;
+  writeEntry(entry);
+  if (stats::enabled()) {
+    stats::add_bytes(entry.op, entry.uncompressed_size, tell() - start);
+  }
+  ++stats_.entries;
+  return true;
+}
+
+void ZipWriter::writeEntry(const PreparedEntry& entry) {
+  void* zip = nullptr;
+  mz_zip_writer_get_zip_handle(writer_, &zip);
+
+  mz_zip_file file_info = {};
+  file_info.filename = entry.name.c_str();
+  file_info.comment = entry.comment.empty() ? nullptr : entry.comment.c_str();
+  file_info.modified_date = entry.modified_date;
+  file_info.accessed_date = entry.accessed_date;
+  file_info.creation_date = entry.creation_date;
+  file_info.external_fa = entry.external_fa;
+  file_info.version_madeby = MZ_VERSION_MADEBY;
+  file_info.flag = MZ_ZIP_FLAG_UTF8 | entry.level_flags |
+                   (entry.aes_version ? MZ_ZIP_FLAG_ENCRYPTED : 0);
+  file_info.compression_method = entry.compression_method;
+  file_info.aes_version = entry.aes_version;
+  file_info.aes_encryption_mode = entry.aes_encryption_mode;
+  file_info.crc = entry.crc;
+  file_info.compressed_size = (int64_t)entry.data.size();
+  file_info.uncompressed_size = entry.uncompressed_size;
+  file_info.zip64 = zip64();
+  normalize(file_info);
+
+  int32_t err = mz_zip_entry_write_open(zip, &file_info, MZ_COMPRESS_LEVEL_DEFAULT, 1, nullptr);
+  size_t pos = 0;
+  while (err == MZ_OK && pos < entry.data.size()) {
+    int32_t n = (int32_t)std::min<size_t>(entry.data.size() - pos, kCopyBufferSize);
+    if (mz_zip_entry_write(zip, entry.data.data() + pos, n) != n) {
+      err = MZ_WRITE_ERROR;
+    }
+    pos += n;
+  }
+
+  if (err == MZ_OK) {
+    err = mz_zip_entry_close_raw(zip, entry.uncompressed_size, entry.crc);
+  } else if (mz_zip_entry_is_open(zip) == MZ_OK) {
+    mz_zip_entry_close_raw(zip, entry.uncompressed_size, entry.crc);
+  }
+  if (err != MZ_OK) {
+    throw ZipException(err, "Error adding data to archive");
+  }
+}
+
+bool ZipWriter::solid(int64_t size) const {
+  return options_.solid_block > 0 && size >= 0 && size <= options_.solid_max_file;
+}
+
+void ZipWriter::addSolid(const std::string& name, const uint8_t* data, size_t len,
+                         time_t modified_date, uint32_t external_fa) {
+  if (!block_.empty() && (int64_t)(block_.size() + len) > options_.solid_block) {
+    flushBlock();
+  }
+  uint32_t crc = (uint32_t)crc32(0, data, (uInt)len);
+  if (options_.deterministic) {
+    modified_date = entryTime(modified_date);
+    external_fa = portableAttribs(external_fa, false);
+  }
+  solid_files_.push_back(SolidFile{name, blocks_, (uint32_t)block_.size(), (uint32_t)len, crc,
+                                   modified_date, external_fa});
+  block_.append(reinterpret_cast<const char*>(data), len);
+  ++stats_.entries;
+}
+
+void ZipWriter::flushBlock() {
+  if (block_.empty()) {
+    return;
+  }
+  PreparedEntry entry;
+  entry.op = stats::Op::kAddBuffer;
+  entry.name = solid_block_name(blocks_);
+  entry.modified_date = now();
+  compress(entry, reinterpret_cast<const uint8_t*>(block_.data()), block_.size());
+  if (!password_.empty()) {
+    encryptInto(entry, password_);
+  }
+  writeEntry(entry);
+  ++blocks_;
+  block_.clear();
+}
+
+void ZipWriter::finishSolid() {
+  flushBlock();
+  if (solid_files_.empty()) {
+    return;
+  }
+  std::string index = encode_solid_index(solid_files_);
+  PreparedEntry entry;
+  entry.op = stats::Op::kAddBuffer;
+  entry.name = kSolidIndexEntry;
+  entry.modified_date = now();
+  // Names and offsets only, which the central directory shows for every
+  // other entry anyway; left unencrypted, readers open the archive before
+  // they know the password, as they can for plain entries.
+  compressInto(entry, reinterpret_cast<const uint8_t*>(index.data()), index.size(),
+               MZ_COMPRESS_LEVEL_DEFAULT, nullptr);
+  writeEntry(entry);
+  solid_files_.clear();
+}
+
+int ZipWriter::levelFor(EntryClass c) const {
+  return tuner_ ? tuner_->level(c) : options_.level;
+}
+
+void ZipWriter::applyLevel(int level) {
+  mz_zip_writer_set_compress_method(writer_,
+                                    level == 0 ? MZ_COMPRESS_METHOD_STORE : options_.method);
+  mz_zip_writer_set_compress_level(writer_, (int16_t)level);
+}
+
+void ZipWriter::recordAdd(EntryClass c, int level, int64_t bytes, int64_t start,
+                          std::chrono::steady_clock::time_point t0) {
+  double seconds = elapsed_ms(t0) / 1000;
+  tuner_->record(c, level, bytes, tell() - start, seconds);
+}
+
+void ZipWriter::compress(PreparedEntry& entry, const uint8_t* data, size_t len) const {
+  EntryClass entry_class = classify(entry.name);
+  int level = levelFor(entry_class);
+  auto t0 = std::chrono::steady_clock::now();
+  compressInto(entry, data, len, level, dict_.get());
+  if (tuner_) {
+    tuner_->record(entry_class, level, (int64_t)len, (int64_t)entry.data.size(),
+                   elapsed_ms(t0) / 1000);
+  }
+}
+
+// Stored first, so that streaming readers also see it before the entries.
+void ZipWriter::addDictionary() {
+  const std::string& content = dict_->content();
+  mz_zip_file file_info = {};
+  file_info.filename = kDictionaryEntry;
+  file_info.modified_date = now();
+  file_info.version_madeby = MZ_VERSION_MADEBY;
+  file_info.compression_method = MZ_COMPRESS_METHOD_STORE;
+  file_info.flag = MZ_ZIP_FLAG_UTF8;
+  file_info.uncompressed_size = (int64_t)content.size();
+  file_info.zip64 = zip64();
+  normalize(file_info);
+  int32_t err = mz_zip_writer_add_buffer(writer_, const_cast<char*>(content.data()),
+                                         (int32_t)content.size(), &file_info);
+  if (err != MZ_OK) {
+    throw ZipException(err, "Error adding dictionary to archive");
+  }
+}
+
+uint16_t ZipWriter::zip64() const {
+  switch (options_.zip64) {
+    case Zip64Mode::kForce: return MZ_ZIP64_FORCE;
+    case Zip64Mode::kOff: return MZ_ZIP64_DISABLE;
+    default: return MZ_ZIP64_AUTO;
+  }
+}
+
+// What mz_zip_writer_add_file stores, with the zip64 mode it has no
+// setting for, and read from `input` when there is one.
+int32_t ZipWriter::writeFile(const std::string& path, const std::string& newname, int level,
+                             InputFile* input) {
+  bool is_dir = !input && mz_os_is_dir(path.c_str()) == MZ_OK;
+  std::string name = entryName(path, newname);
+  if (is_dir && !name.empty() && name.back() != '/' && name.back() != '\\') {
+    name += '/';
+  }
+
+  mz_zip_file file_info = {};
+  file_info.filename = name.c_str();
+  file_info.version_madeby = MZ_VERSION_MADEBY;
+  file_info.flag = MZ_ZIP_FLAG_UTF8;
+  file_info.compression_method =
+      is_dir || level == 0 ? MZ_COMPRESS_METHOD_STORE : options_.method;
+  file_info.aes_version = 1;
+  file_info.zip64 = zip64();
+  file_info.external_fa = externalAttribs(path);
+  mz_os_get_file_date(path.c_str(), &file_info.modified_date, &file_info.accessed_date,
+                      &file_info.creation_date);
+  normalize(file_info);
+  if (is_dir) {
+    return mz_zip_writer_add_info(writer_, nullptr, nullptr, &file_info);
+  }
+
+  if (input) {
+    file_info.uncompressed_size = input->size();
+    return mz_zip_writer_add_info(writer_, input, InputFile::read, &file_info);
+  }
+  file_info.uncompressed_size = mz_os_get_file_size(path.c_str());
+  MzOsStream stream;
+  int32_t err = mz_stream_open(stream, path.c_str(), MZ_OPEN_MODE_READ);
+  if (err != MZ_OK) {
+    return err;
+  }
+  return mz_zip_writer_add_info(writer_, stream, mz_stream_read, &file_info);
+}
+
+int64_t ZipWriter::tell() {
+  void* zip = nullptr;
+  void* stream = nullptr;
+  mz_zip_writer_get_zip_handle(writer_, &zip);
+  mz_zip_get_stream(zip, &stream);
+  int64_t pos = stream ? mz_stream_tell(stream) : -1;
+  if (pos < 0) {
+    throw ZipException(MZ_TELL_ERROR, "Error locating entry in archive");
+  }
+  return pos;
+}
+
+// Parses the local header the writer just emitted between [start, end) and
+// remembers where its payload lives.
+void ZipWriter::recordBlob(const std::string& key, int64_t uncompressed_size,
+                           int64_t start, int64_t end, double elapsed_ms) {
+  // Seeking the stdio-backed stream flushes it, making the entry readable.
+  mz_stream_seek(out_stream_, end, MZ_SEEK_SET);
+  if (mz_stream_is_open(blob_reader_) != MZ_OK &&
+      mz_stream_open(blob_reader_, filename_.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    throw ZipException(MZ_OPEN_ERROR, "Error reopening archive");
+  }
+
+  uint8_t header[kLocalHeaderSize];
+  if (mz_stream_seek(blob_reader_, start, MZ_SEEK_SET) != MZ_OK ||
+      mz_stream_read(blob_reader_, header, kLocalHeaderSize) != kLocalHeaderSize ||
+      read_u32(header) != kLocalHeaderMagic) {
+    throw ZipException(MZ_FORMAT_ERROR, "Error reading local header");
+  }
+
+  StoredBlob blob = {};
+  blob.flag = read_u16(header + 6) & ~MZ_ZIP_FLAG_DATA_DESCRIPTOR;
+  blob.compression_method = read_u16(header + 8);
+  blob.crc = read_u32(header + 14);
+  uint16_t filename_size = read_u16(header + 26);
+  uint16_t extrafield_size = read_u16(header + 28);
+  blob.offset = start + kLocalHeaderSize + filename_size + extrafield_size;
+
+  std::vector<uint8_t> extra(extrafield_size);
+  if (extrafield_size > 0 &&
+      (mz_stream_seek(blob_reader_, start + kLocalHeaderSize + filename_size, MZ_SEEK_SET) != MZ_OK ||
+       mz_stream_read(blob_reader_, extra.data(), extrafield_size) != extrafield_size)) {
+    throw ZipException(MZ_FORMAT_ERROR, "Error reading local header");
+  }
+
+  bool zip64 = false;
+  for (size_t i = 0; i + 4 <= extra.size();) {
+    uint16_t id = read_u16(&extra[i]);
+    uint16_t size = read_u16(&extra[i + 2]);
+    const uint8_t* data = &extra[i + 4];
+    if (i + 4 + size > extra.size()) {
+      break;
+    }
+    if (id == kZip64ExtraId) {
+      zip64 = true;
+    } else if (id == kAesExtraId && size >= 7) {
+      blob.aes_version = read_u16(data);
+      blob.aes_encryption_mode = data[4];
+      blob.compression_method = read_u16(data + 5);
+    }
+    i += 4 + size;
+  }
+
+  int64_t payload_end = end;
+  if (read_u16(header + 6) & MZ_ZIP_FLAG_DATA_DESCRIPTOR) {
+    uint8_t descriptor[24];
+    int32_t sizes[2] = {zip64 ? 24 : 16, zip64 ? 16 : 24};
+    bool found = false;
+    for (int32_t size : sizes) {
+      if (end - size >= blob.offset &&
+          mz_stream_seek(blob_reader_, end - size, MZ_SEEK_SET) == MZ_OK &&
+          mz_stream_read(blob_reader_, descriptor, size) == size &&
+          read_u32(descriptor) == kDataDescriptorMagic) {
+        blob.crc = read_u32(descriptor + 4);
+        payload_end = end - size;
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      throw ZipException(MZ_FORMAT_ERROR, "Error reading data descriptor");
+    }
+  }
+
+  blob.compressed_size = payload_end - blob.offset;
+  blob.uncompressed_size = uncompressed_size;
+  blob.elapsed_ms = elapsed_ms;
+  blobs_.emplace(key, blob);
+}
+
+// Writes a new entry whose payload is copied raw from an earlier one.
+void ZipWriter::copyBlob(const StoredBlob& blob, mz_zip_file& file_info) {
+  copyRaw(blob_reader_, blob, file_info);
+  ++stats_.entries;
+  ++stats_.duplicates;
+  stats_.bytes_saved += blob.uncompressed_size;
+  stats_.cpu_saved_ms += blob.elapsed_ms;
+}
+
+void ZipWriter::copyRaw(void* source, const StoredBlob& blob, mz_zip_file& file_info) {
+  void* zip = nullptr;
+  mz_zip_writer_get_zip_handle(writer_, &zip);
+
+  file_info.version_madeby = MZ_VERSION_MADEBY;
+  file_info.flag = blob.flag;
+  file_info.compression_method = blob.compression_method;
+  file_info.aes_version = blob.aes_version;
+  file_info.aes_encryption_mode = blob.aes_encryption_mode;
+  file_info.crc = blob.crc;
+  file_info.compressed_size = blob.compressed_size;
+  file_info.uncompressed_size = blob.uncompressed_size;
+  file_info.zip64 = zip64();
+  normalize(file_info);
+
+  int32_t err = mz_zip_entry_write_open(zip, &file_info, MZ_COMPRESS_LEVEL_DEFAULT, 1, nullptr);
+  if (err == MZ_OK) {
+    err = mz_stream_seek(source, blob.offset, MZ_SEEK_SET);
+  }
+
+  std::vector<uint8_t> buf(kCopyBufferSize);
+  int64_t left = blob.compressed_size;
+  while (err == MZ_OK && left > 0) {
+    int32_t n = (int32_t)std::min<int64_t>(left, buf.size());
+    if (mz_stream_read(source, buf.data(), n) != n) {
+      err = MZ_READ_ERROR;
+    } else if (mz_zip_entry_write(zip, buf.data(), n) != n) {
+      err = MZ_WRITE_ERROR;
+    }
+    left -= n;
+  }
+
+  if (err == MZ_OK) {
+    err = mz_zip_entry_close_raw(zip, blob.uncompressed_size, blob.crc);
+  } else if (mz_zip_entry_is_open(zip) == MZ_OK) {
+    mz_zip_entry_close_raw(zip, blob.uncompressed_size, blob.crc);
+  }
+  if (err != MZ_OK) {
+    throw ZipException(err, "Error copying entry");
+  }
+}
+
+void ZipWriter::loadPrevious() {
+  // No previous archive yet is the first build, not an error.
+  if (!fs_util::file_exits(options_.previous)) {
+    return;
+  }
+  if (fs_util::same_file(options_.previous, filename_)) {
+    throw ZipException(MZ_PARAM_ERROR, "the previous archive can not be the one written");
+  }
+  MzReaderHandle reader;
+  int32_t err = mz_zip_reader_open_file(reader, options_.previous.c_str());
+  if (err == MZ_OK) {
+    err = mz_zip_reader_goto_first_entry(reader);
+  }
+  // Entries of a dictionary archive decode only with its dictionary, and
+  // the files of a solid one live inside blocks; neither is copied.
+  bool internal = false;
+  while (err == MZ_OK) {
+    mz_zip_file* info = nullptr;
+    err = mz_zip_reader_entry_get_info(reader, &info);
+    if (err != MZ_OK) {
+      break;
+    }
+    std::string name = info->filename;
+    if (name == kDictionaryEntry || name == kSolidIndexEntry ||
+        name.compare(0, strlen(kSolidBlockPrefix), kSolidBlockPrefix) == 0) {
+      internal = true;
+      break;
+    }
+    // Encrypted payloads belong to another password, and split archives
+    // are not read raw.
+    if (!(info->flag & MZ_ZIP_FLAG_ENCRYPTED) && info->disk_number == 0 &&
+        info->uncompressed_size > 0) {
+      previous_[info->filename] = PreviousEntry{
+          info->disk_offset, info->compressed_size, info->uncompressed_size, info->crc,
+          (uint16_t)(info->flag & ~MZ_ZIP_FLAG_DATA_DESCRIPTOR), info->compression_method};
+    }
+    err = mz_zip_reader_goto_next_entry(reader);
+  }
+  mz_zip_reader_close(reader);
+  if (internal) {
+    previous_.clear();
+    return;
+  }
+  if (err != MZ_END_OF_LIST) {
+    throw ZipException(err, "Error reading previous archive");
+  }
+  if (!previous_.empty() &&
+      mz_stream_open(previous_stream_, options_.previous.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    throw ZipException(MZ_OPEN_ERROR, "Error opening previous archive");
+  }
+}
+
+const ZipWriter::PreviousEntry* ZipWriter::unchanged(const std::string& name, int level,
+                                                     int64_t size, uint32_t crc) const {
+  // Payloads compressed with another dictionary, or to be encrypted, can
+  // not be copied.
+  if (previous_.empty() || dict_ || !password_.empty()) {
+    return nullptr;
+  }
+  auto it = previous_.find(name);
+  if (it == previous_.end() || it->second.uncompressed_size != size || it->second.crc != crc) {
+    return nullptr;
+  }
+  // Copied only as this writer would write it, so an incremental build
+  // matches a clean one. A payload stored although it is now compressed
+  // may be the incompressible-input fallback, but telling that would take
+  // compressing it, so it is compressed again.
+  uint16_t method = level == 0 ? MZ_COMPRESS_METHOD_STORE : options_.method;
+  if (it->second.compression_method != method ||
+      (it->second.flag & kLevelFlags) != levelFlags(method, level)) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+void ZipWriter::copyPrevious(const PreviousEntry& entry, mz_zip_file& file_info) {
+  int64_t payload = local_data_offset(previous_stream_, entry.disk_offset);
+  if (payload < 0) {
+    throw ZipException(MZ_FORMAT_ERROR, "Error reading previous archive");
+  }
+  StoredBlob blob = {};
+  blob.offset = payload;
+  blob.compressed_size = entry.compressed_size;
+  blob.uncompressed_size = entry.uncompressed_size;
+  blob.crc = entry.crc;
+  blob.flag = MZ_ZIP_FLAG_UTF8 | (entry.flag & kLevelFlags);
+  blob.compression_method = entry.compression_method;
+  copyRaw(previous_stream_, blob, file_info);
+  ++stats_.entries;
+  ++stats_.reused;
+}
+
+void ZipWriter::normalize(mz_zip_file& file_info) const {
+  if (!options_.deterministic) {
+    return;
+  }
+  const char* name = file_info.filename;
+  size_t len = name ? strlen(name) : 0;
+  bool is_dir = len > 0 && (name[len - 1] == '/' || name[len - 1] == '\\');
+  file_info.version_madeby = kPortableMadeBy;
+  file_info.external_fa = portableAttribs(file_info.external_fa, is_dir);
+  file_info.modified_date = utcFields(entryTime(file_info.modified_date));
+  // With all three dates minizip adds an NTFS extra field; the access time
+  // alone would change the archive on every build.
+  file_info.accessed_date = 0;
+  file_info.creation_date = 0;
+}
+
+time_t ZipWriter::entryTime(time_t source) const {
+  if (options_.mtime >= 0) {
+    return (time_t)options_.mtime;
+  }
+  return options_.source_mtime && source > kDosEpoch ? source : kDosEpoch;
+}
+
+time_t ZipWriter::now() const {
+  return options_.deterministic ? 0 : time(NULL);
+}
+
 }  // namespace ziputil
@@ -3,11 +3,22 @@
 
 #pragma once
 
+#include <time.h>
+
+#include <chrono>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "dir_scanner.h"
+#include "input_prefetch.h"
+#include "level_tuner.h"
+#include "solid_index.h"
+#include "stats.h"
 #include "zip_common.h"
+#include "zstd_dict.h"
 
 namespace ziputil {
 
@@ -20,27 +31,204 @@ struct FileInfo {
     std::string comment;
 };
 
+enum class Zip64Mode {
+  kAuto,   /* zip64 records only where sizes, offsets or counts need them */
+  kForce,  /* zip64 extra fields on every entry */
+  kOff,    /* classic format; fails where zip64 would be needed */
+};
+
+// 1980-01-01 00:00:00 UTC, the first time a DOS date can hold.
+const time_t kDosEpoch = 315532800;
+
+struct WriterOptions {
+  bool dedup = false;  /* store identical inputs once, copy compressed bytes */
+  Zip64Mode zip64 = Zip64Mode::kAuto;
+  uint16_t method = MZ_COMPRESS_METHOD_DEFLATE;  /* or MZ_COMPRESS_METHOD_ZSTD */
+  int level = MZ_COMPRESS_LEVEL_DEFAULT;         /* 0 stores */
+  bool auto_level = false;  /* tune the level per entry class toward `target` */
+  TuneTarget target;
+  std::string dictionary;  /* zstd dictionary for every entry, stored in the archive */
+  int64_t solid_block = 0;  /* solid mode: uncompressed bytes per block, 0 for off */
+  int64_t solid_max_file = 64 * 1024;  /* larger files keep an entry of their own */
+  size_t prefetch = 8;  /* files addDir opens ahead of the one compressed, 0 for off */
+  // Byte-stable output for the same inputs: entries of addDir sorted by
+  // name, fixed times, and made-by, attributes and extra fields that do
+  // not depend on the machine. Not with a password or auto_level.
+  bool deterministic = false;
+  int64_t mtime = -1;         /* deterministic: time of every entry, -1 for 1980-01-01 */
+  bool source_mtime = false;  /* deterministic: files keep their modification time */
+  std::string previous;  /* archive whose entries with the same name, size and CRC are copied */
+};
+
+struct WriterStats {
+  uint64_t entries = 0;
+  uint64_t duplicates = 0;
+  uint64_t bytes_saved = 0;  /* uncompressed bytes that skipped compression */
+  double cpu_saved_ms = 0;   /* compression time the duplicates did not spend */
+  uint64_t reused = 0;       /* entries copied from the previous archive */
+  std::vector<LevelTuner::Report> levels;  /* with auto_level, filled by close() */
+};
+
+// An input read and compressed ahead of its turn to be written, so that
+// preparing the next entries overlaps writing the current one.
+struct PreparedEntry {
+  stats::Op op;
+  std::string name;
+  std::string comment;
+  time_t modified_date = 0;
+  time_t accessed_date = 0;
+  time_t creation_date = 0;
+  uint32_t external_fa = 0;
+  uint16_t compression_method = 0;
+  uint16_t level_flags = 0;   /* general purpose flag bits for the level */
+  uint32_t crc = 0;
+  int64_t uncompressed_size = 0;
+  uint16_t aes_version = 0;   /* set when `data` is WinZip AES encrypted */
+  uint8_t aes_encryption_mode = 0;
+  std::vector<uint8_t> data;  /* payload as stored in the archive */
+};
+
 class ZipWriter {
  public:
   ZipWriter() = default;
   ZipWriter(const std::string& filename, const std::string& password);
-  ~ZipWriter() = default;
+  ~ZipWriter();
 
   ZipWriter(const ZipWriter&) = delete;
   ZipWriter& operator=(const ZipWriter&) = delete;
 
 
-  bool create(const std::string& filename, const std::string& password);
+  bool create(const std::string& filename, const std::string& password,
+              const WriterOptions& options = WriterOptions());
   bool close();
 
   bool is_open() const { return is_open_; }
+  const WriterStats& stats() const { return stats_; }
 
-  bool addDir(const std::string& dir, const std::string& rootPath, bool recursive=true);
+  // `scan` filters and orders what is added below `dir`; its `recursive`
+  // and `wildcard` are taken from the arguments.
+  bool addDir(const std::string& dir, const std::string& rootPath, bool recursive=true,
+              const ScanOptions& scan = ScanOptions());
   bool addFile(const std::string& path, const std::string& newname);
   bool addBuffer(const std::string& name, const FileInfo& buf);
+
+  // Read, compress and, with a password, encrypt an input without touching
+  // the archive; safe to call from several threads, also while another
+  // thread writes. nullptr when the input has to go through
+  // addFile/addBuffer instead: directories, symlinks, inputs over 64 MiB,
+  // zstd without a dictionary, writers with dedup, and files small enough
+  // for a solid block.
+  std::unique_ptr<PreparedEntry> prepareFile(const std::string& path,
+                                             const std::string& newname) const;
+  std::unique_ptr<PreparedEntry> prepareBuffer(const std::string& name,
+                                               const FileInfo& buf) const;
+  bool addPrepared(const PreparedEntry& entry);
+
  private:
+  // Location of an already written entry whose compressed (and possibly
+  // encrypted) payload can be copied verbatim for identical inputs.
+  struct StoredBlob {
+    int64_t offset;
+    int64_t compressed_size;
+    int64_t uncompressed_size;
+    uint32_t crc;
+    uint16_t flag;
+    uint16_t compression_method;
+    uint16_t aes_version;
+    uint8_t aes_encryption_mode;
+    double elapsed_ms;
+  };
+
+  // An entry of WriterOptions::previous, by the offset of its local header.
+  struct PreviousEntry {
+    int64_t disk_offset;
+    int64_t compressed_size;
+    int64_t uncompressed_size;
+    uint32_t crc;
+    uint16_t flag;
+    uint16_t compression_method;
+  };
+
+  struct CollectedPath {
+    std::string path;
+    std::string name;  /* in the archive */
+    bool link;         /* stored as a link entry, under SymlinkPolicy::kStore */
+  };
+
+  bool addPath(const std::string& path, const std::string& rootPath,
+               bool include_path, const ScanOptions& scan);
+  // `path` and what scan_dir finds under it, with their entry names, in
+  // the order mz_zip_writer_add_path adds them.
+  void collectPath(const std::string& path, const std::string& rootPath, bool include_path,
+                   const ScanOptions& scan, std::vector<CollectedPath>& out);
+  // A symlink as a link entry.
+  void addLink(const std::string& path, const std::string& newname);
+  // addFile, taking the content from `input` when there is one.
+  bool addInput(const std::string& path, const std::string& newname, InputFile* input);
+  int32_t writeFile(const std::string& path, const std::string& newname, int level,
+                    InputFile* input = nullptr);
+  // prepareFile/prepareBuffer minus the dedup check, which addFile and
+  // addBuffer have done already.
+  std::unique_ptr<PreparedEntry> loadFile(const std::string& path, const std::string& newname,
+                                          const InputFile* input = nullptr) const;
+  std::unique_ptr<PreparedEntry> loadBuffer(const std::string& name, const FileInfo& buf) const;
+  // Whether entries can be compressed outside of minizip.
+  bool preparable() const;
+  void addDictionary();
+  // Writes a prepared payload as an entry, without counting it.
+  void writeEntry(const PreparedEntry& entry);
+  // Solid mode: whether a file of `size` goes into a block, appending it
+  // there, and writing out the current block.
+  bool solid(int64_t size) const;
+  void addSolid(const std::string& name, const uint8_t* data, size_t len, time_t modified_date,
+                uint32_t external_fa);
+  void flushBlock();
+  // Last block and the index, before the central directory.
+  void finishSolid();
+  uint16_t zip64() const;
+  // Level for an entry, and the writer's setting for what minizip writes.
+  int levelFor(EntryClass c) const;
+  void applyLevel(int level);
+  // Inline adds in auto_level mode: minizip compresses, so only the time
+  // around the whole add is known.
+  void recordAdd(EntryClass c, int level, int64_t bytes, int64_t start,
+                 std::chrono::steady_clock::time_point t0);
+  // compressInto at the entry's level, timed for the tuner.
+  void compress(PreparedEntry& entry, const uint8_t* data, size_t len) const;
+  int64_t tell();
+  void recordBlob(const std::string& key, int64_t uncompressed_size,
+                  int64_t start, int64_t end, double elapsed_ms);
+  void copyBlob(const StoredBlob& blob, mz_zip_file& file_info);
+  // Writes an entry whose payload is read raw from `source`.
+  void copyRaw(void* source, const StoredBlob& blob, mz_zip_file& file_info);
+  void loadPrevious();
+  // The entry of the previous archive to copy for input `name` at `level`,
+  // or nullptr when there is none or the content changed.
+  const PreviousEntry* unchanged(const std::string& name, int level, int64_t size,
+                                 uint32_t crc) const;
+  void copyPrevious(const PreviousEntry& entry, mz_zip_file& file_info);
+  // Deterministic mode: the fields of an entry that depend on the clock or
+  // the machine, set to portable values.
+  void normalize(mz_zip_file& file_info) const;
+  time_t entryTime(time_t source) const;
+  // Time for entries without a source: the clock, 0 in deterministic mode.
+  time_t now() const;
+
   bool is_open_ = false;
+  std::string filename_;
   std::string password_;
+  WriterOptions options_;
+  WriterStats stats_;
+  std::unordered_map<std::string, StoredBlob> blobs_;
+  std::unordered_map<std::string, PreviousEntry> previous_;
+  MzOsStream previous_stream_;
+  std::unique_ptr<LevelTuner> tuner_;
+  std::unique_ptr<ZstdDictionary> dict_;
+  std::string block_;
+  uint32_t blocks_ = 0;
+  std::vector<SolidFile> solid_files_;
+  MzOsStream out_stream_;
+  MzOsStream blob_reader_;
   MzWriterHandle writer_;
 };
 
@@ -1,5 +1,11 @@
 #include "zip_writer_api.h"
 
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #include "async_op.h"
 #include "napi.h"
 #include "zip_common.h"
@@ -8,21 +14,32 @@ namespace api {
 
 using namespace ziputil;
 
+// Compression speed level: 'auto' aims for when no target is given.
+const double kDefaultTargetMBps = 50;
+// Solid blocks are compressed in memory, like other prepared entries.
+const int64_t kDefaultSolidBlock = 4 * 1024 * 1024;
+const int64_t kMaxSolidBlock = 64 * 1024 * 1024;
+
 class CreateZipAsync : public Napi::AsyncWorker {
  public:
-  CreateZipAsync(Napi::Env env, std::string filename, std::string password, AddonData* addon_data)
+  CreateZipAsync(Napi::Env env, std::string filename, std::string password,
+                 WriterOptions options, AddonData* addon_data)
       : Napi::AsyncWorker(env),
         deferred(Napi::Promise::Deferred::New(env)),
         addon_data_(addon_data),
         filename_(std::move(filename)),
-        password_(std::move(password)) {}
+        password_(std::move(password)),
+        options_(options) {}
   ~CreateZipAsync() {}
 
   void Execute() override {
+    trace_.start();
     w_ = std::make_unique<ZipWriter>();
     try {
-      w_->create(filename_, password_);
+      w_->create(filename_, password_, options_);
+      trace_.finish(true);
     } catch (const std::exception& e) {
+      trace_.finish(false);
       SetError(e.what());
     }
   }
@@ -48,6 +65,8 @@ class CreateZipAsync : public Napi::AsyncWorker {
   AddonData* addon_data_;
   std::string filename_;
   std::string password_;
+  WriterOptions options_;
+  stats::OpTrace trace_{stats::Op::kCreate};
 };
 
 Napi::Value CreateZip(const Napi::CallbackInfo& info) {
@@ -64,7 +83,7 @@ Napi::Value CreateZip(const Napi::CallbackInfo& info) {
   }
 
   std::string password;
-  if (info.Length() > 1) {
+  if (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNull()) {
     if (!info[1].IsString()) {
       Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
       return env.Null();
@@ -72,8 +91,223 @@ Napi::Value CreateZip(const Napi::CallbackInfo& info) {
     password = info[1].ToString();
   }
 
+  WriterOptions options;
+  if (info.Length() > 2 && info[2].IsObject()) {
+    auto opts = info[2].ToObject();
+    if (opts.Has("dedup")) {
+      options.dedup = opts.Get("dedup").ToBoolean();
+    }
+    if (opts.Has("zip64")) {
+      std::string mode = opts.Get("zip64").ToString();
+      if (mode == "force") {
+        options.zip64 = Zip64Mode::kForce;
+      } else if (mode == "off") {
+        options.zip64 = Zip64Mode::kOff;
+      } else if (mode != "auto") {
+        Napi::TypeError::New(env, "zip64 must be 'auto', 'force' or 'off'")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+    if (opts.Has("method") && !opts.Get("method").IsUndefined()) {
+      std::string method = opts.Get("method").ToString();
+      if (method == "zstd") {
+        options.method = MZ_COMPRESS_METHOD_ZSTD;
+      } else if (method != "deflate") {
+        Napi::TypeError::New(env, "method must be 'deflate' or 'zstd'")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+    int max_level = options.method == MZ_COMPRESS_METHOD_ZSTD ? 19 : 9;
+    if (opts.Has("level") && !opts.Get("level").IsUndefined()) {
+      auto level = opts.Get("level");
+      if (level.IsString() && level.ToString().Utf8Value() == "auto") {
+        options.auto_level = true;
+      } else if (level.IsNumber() && level.ToNumber().Int32Value() >= 0 &&
+                 level.ToNumber().Int32Value() <= max_level) {
+        options.level = level.ToNumber().Int32Value();
+      } else {
+        Napi::TypeError::New(env, "level must be 'auto' or 0 to " + std::to_string(max_level))
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+    if (opts.Has("targetMBps") && opts.Get("targetMBps").IsNumber()) {
+      options.target.mb_per_s = opts.Get("targetMBps").ToNumber().DoubleValue();
+    }
+    if (opts.Has("targetRatio") && opts.Get("targetRatio").IsNumber()) {
+      options.target.ratio = opts.Get("targetRatio").ToNumber().DoubleValue();
+    }
+    if (options.auto_level && options.target.mb_per_s <= 0 && options.target.ratio <= 0) {
+      options.target.mb_per_s = kDefaultTargetMBps;
+    }
+    if (opts.Has("dictionary") && !opts.Get("dictionary").IsUndefined()) {
+      if (!opts.Get("dictionary").IsBuffer()) {
+        Napi::TypeError::New(env, "dictionary must be a Buffer").ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      if (opts.Has("method") && opts.Get("method").IsString() &&
+          options.method != MZ_COMPRESS_METHOD_ZSTD) {
+        Napi::TypeError::New(env, "a dictionary needs method 'zstd'")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      if (!password.empty()) {
+        Napi::TypeError::New(env, "a dictionary can not be combined with a password")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      auto dict = opts.Get("dictionary").As<Napi::Buffer<char>>();
+      options.dictionary.assign(dict.Data(), dict.Length());
+      options.method = MZ_COMPRESS_METHOD_ZSTD;
+    }
+    if (opts.Has("solid") && opts.Get("solid").ToBoolean()) {
+      options.solid_block = kDefaultSolidBlock;
+      if (opts.Get("solid").IsObject()) {
+        auto solid = opts.Get("solid").ToObject();
+        if (solid.Has("blockSize") && solid.Get("blockSize").IsNumber()) {
+          options.solid_block = solid.Get("blockSize").ToNumber().Int64Value();
+        }
+        if (solid.Has("maxFileSize") && solid.Get("maxFileSize").IsNumber()) {
+          options.solid_max_file = solid.Get("maxFileSize").ToNumber().Int64Value();
+        }
+      }
+      if (options.solid_block < 1024 || options.solid_block > kMaxSolidBlock ||
+          options.solid_max_file < 0 || options.solid_max_file > options.solid_block) {
+        Napi::RangeError::New(env, "solid blockSize must be 1 KiB to 64 MiB, and maxFileSize "
+                                   "at most blockSize")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+    if (opts.Has("deterministic") && opts.Get("deterministic").ToBoolean()) {
+      options.deterministic = true;
+      if (!password.empty() || options.auto_level) {
+        Napi::TypeError::New(env, "deterministic archives take neither a password nor level 'auto'")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      if (opts.Get("deterministic").IsObject()) {
+        auto mtime = opts.Get("deterministic").ToObject().Get("mtime");
+        if (mtime.IsString() && mtime.ToString().Utf8Value() == "source") {
+          options.source_mtime = true;
+        } else if (mtime.IsNumber() && mtime.ToNumber().Int64Value() >= kDosEpoch) {
+          options.mtime = mtime.ToNumber().Int64Value();
+        } else if (!mtime.IsUndefined()) {
+          Napi::TypeError::New(env, "mtime must be 'source' or seconds since 1970, from 1980 on")
+              .ThrowAsJavaScriptException();
+          return env.Null();
+        }
+      }
+    }
+    if (opts.Has("previous") && !opts.Get("previous").IsUndefined()) {
+      if (!opts.Get("previous").IsString()) {
+        Napi::TypeError::New(env, "previous must be the path of an archive")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      options.previous = opts.Get("previous").ToString();
+    }
+    if (opts.Has("prefetch") && !opts.Get("prefetch").IsUndefined()) {
+      if (!opts.Get("prefetch").IsNumber() || opts.Get("prefetch").ToNumber().Int64Value() < 0) {
+        Napi::TypeError::New(env, "prefetch must be a number of files, 0 for off")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+      options.prefetch = (size_t)opts.Get("prefetch").ToNumber().Int64Value();
+    }
+  }
+
   auto addon_data = (AddonData*)info.Data();
-  auto* wk = new CreateZipAsync(info.Env(), info[0].ToString(), password, addon_data);
+  auto* wk = new CreateZipAsync(info.Env(), info[0].ToString(), password, options, addon_data);
+  wk->Queue();
+  return wk->deferred.Promise();
+}
+
+class TrainDictionaryAsync : public Napi::AsyncWorker {
+ public:
+  TrainDictionaryAsync(Napi::Env env, std::vector<std::string> paths,
+                       std::vector<std::string> samples, TrainOptions options)
+      : Napi::AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        paths_(std::move(paths)),
+        samples_(std::move(samples)),
+        options_(options) {}
+
+  void Execute() override {
+    trace_.start();
+    try {
+      auto found = collect_samples(paths_, options_);
+      samples_.insert(samples_.end(), std::make_move_iterator(found.begin()),
+                      std::make_move_iterator(found.end()));
+      dictionary_ = train_dictionary(samples_, options_);
+    } catch (const std::exception& e) {
+      trace_.finish(false);
+      SetError(e.what());
+      return;
+    }
+    trace_.finish(true);
+  }
+
+  void OnOK() override {
+    Napi::HandleScope scope(Env());
+    deferred.Resolve(Napi::Buffer<char>::Copy(Env(), dictionary_.data(), dictionary_.size()));
+  }
+
+  void OnError(Napi::Error const& error) override {
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise::Deferred deferred;
+
+ private:
+  std::vector<std::string> paths_;
+  std::vector<std::string> samples_;
+  TrainOptions options_;
+  std::string dictionary_;
+  stats::OpTrace trace_{stats::Op::kTrainDictionary};
+};
+
+// trainDictionary(inputs, [options]): inputs are file or directory paths to
+// sample, or Buffers to train on as they are.
+Napi::Value TrainDictionary(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsArray()) {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::vector<std::string> paths;
+  std::vector<std::string> samples;
+  auto inputs = info[0].As<Napi::Array>();
+  for (uint32_t i = 0; i < inputs.Length(); ++i) {
+    Napi::Value input = inputs.Get(i);
+    if (input.IsString()) {
+      paths.push_back(input.ToString());
+    } else if (input.IsBuffer()) {
+      auto buf = input.As<Napi::Buffer<char>>();
+      samples.emplace_back(buf.Data(), buf.Length());
+    } else {
+      Napi::TypeError::New(env, "inputs must be paths or Buffers").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+  }
+
+  TrainOptions options;
+  if (info.Length() > 1 && info[1].IsObject()) {
+    auto opts = info[1].ToObject();
+    if (opts.Has("size") && opts.Get("size").IsNumber()) {
+      options.dictionary_size = (size_t)std::max<int64_t>(
+          1024, opts.Get("size").ToNumber().Int64Value());
+    }
+    if (opts.Has("sampleBytes") && opts.Get("sampleBytes").IsNumber()) {
+      options.sample_bytes = (size_t)std::max<int64_t>(
+          0, opts.Get("sampleBytes").ToNumber().Int64Value());
+    }
+  }
+
+  auto* wk = new TrainDictionaryAsync(env, std::move(paths), std::move(samples), options);
   wk->Queue();
   return wk->deferred.Promise();
 }
@@ -86,12 +320,15 @@ Napi::Object ZipWriterAPI::Init(Napi::Env env, Napi::Object exports, AddonData*
 
   exports.Set(Napi::String::New(env, "create"),
               Napi::Function::New(env, CreateZip, "createZip", addon_data));
+  exports.Set(Napi::String::New(env, "trainDictionary"),
+              Napi::Function::New(env, TrainDictionary, "trainDictionary"));
 
   Napi::Function func =
       DefineClass(env, "ZipWriter",
                   {ZipWriterAPI::InstanceMethod("addDir", &ZipWriterAPI::addDir),
                    ZipWriterAPI::InstanceMethod("addFile", &ZipWriterAPI::addFile),
                    ZipWriterAPI::InstanceMethod("addBuffer", &ZipWriterAPI::addBuffer),
+                   ZipWriterAPI::InstanceMethod("flush", &ZipWriterAPI::flush),
                    ZipWriterAPI::InstanceMethod("close", &ZipWriterAPI::close)}, nullptr);
 
   addon_data->ctor_writer = Napi::Persistent(func);
@@ -109,7 +346,7 @@ Napi::Object ZipWriterAPI::NewInstance(Napi::Env env, Napi::Value arg, AddonData
 }
 
 ZipWriterAPI::ZipWriterAPI(const Napi::CallbackInfo& info)
-    : Napi::ObjectWrap<ZipWriterAPI>(info) {
+    : Napi::ObjectWrap<ZipWriterAPI>(info), state_(std::make_shared<Shared<ZipWriter>>()) {
   Napi::Env env = info.Env();
   Napi::HandleScope scope(env);
 
@@ -123,7 +360,36 @@ ZipWriterAPI::ZipWriterAPI(const Napi::CallbackInfo& info)
     return;
   }
 
-  writer_.reset(info[0].As<Napi::External<ZipWriter>>().Data());
+  state_->value.reset(info[0].As<Napi::External<ZipWriter>>().Data());
+}
+
+ZipWriterAPI::~ZipWriterAPI() { DisposeLater(std::move(state_)); }
+
+// Writer operations read and compress their input in parallel on the pool,
+// then write it once every operation queued before them is done, so entries
+// land in call order while the next ones are being prepared. Failures are
+// also kept for flush() and close(), for callers that do not await each add;
+// see Shared::fail.
+template <typename Prepare, typename Write>
+static bool AddInOrder(Shared<ZipWriter>& state, uint64_t ticket, stats::Op op,
+                       Prepare prepare, Write write) {
+  std::unique_ptr<PreparedEntry> entry;
+  try {
+    // The ticket keeps the writer alive, and preparing does not need `mu`
+    // as long as no close queued earlier can be clearing its state.
+    if (state.value && !state.closedBefore(ticket)) {
+      entry = prepare(*state.value);
+    }
+  } catch (const std::exception&) {
+    // written the slow way below, which reports the problem
+  }
+  try {
+    Shared<ZipWriter>::Lock lock(state, ticket, op, true);
+    return entry ? lock.get().addPrepared(*entry) : write(lock.get());
+  } catch (const std::exception& e) {
+    state.fail(ticket, e.what());
+    throw;
+  }
 }
 
 Napi::Value ZipWriterAPI::addDir(const Napi::CallbackInfo& info) {
@@ -131,16 +397,66 @@ Napi::Value ZipWriterAPI::addDir(const Napi::CallbackInfo& info) {
   std::string dir = info[0].ToString();
   std::string root;
   bool recursive = true;
+  ScanOptions scan;
+  auto to_strings = [](Napi::Value value, std::vector<std::string>& out) {
+    if (value.IsArray()) {
+      auto arr = value.As<Napi::Array>();
+      for (uint32_t i = 0; i < arr.Length(); ++i) {
+        out.push_back(arr.Get(i).ToString());
+      }
+    } else if (value.IsString()) {
+      out.push_back(value.ToString());
+    }
+  };
   if (info.Length() > 1 && info[1].IsString()) {
     root = info[1].ToString();
   }
-  if (info.Length() > 2) {
+  if (info.Length() > 2 && !info[2].IsObject()) {
     recursive = info[2].ToBoolean();
   }
-  return MakePromise(env, [&, dir = std::move(dir), root = std::move(root)]() {
-        auto ok = writer_->addDir(dir, root, recursive);
-    return ok;
-      });
+  // The options come last: addDir(dir, [root], [recursive], [options]).
+  size_t last = info.Length() - 1;
+  if (info.Length() > 1 && info[last].IsObject()) {
+    auto options = info[last].ToObject();
+    if (options.Has("include")) {
+      to_strings(options.Get("include"), scan.include);
+    }
+    if (options.Has("exclude")) {
+      to_strings(options.Get("exclude"), scan.exclude);
+    }
+    if (options.Has("symlinks") && !options.Get("symlinks").IsUndefined()) {
+      std::string symlinks = options.Get("symlinks").ToString();
+      if (symlinks == "skip") {
+        scan.symlinks = SymlinkPolicy::kSkip;
+      } else if (symlinks == "store") {
+        scan.symlinks = SymlinkPolicy::kStore;
+      } else if (symlinks != "follow") {
+        Napi::TypeError::New(env, "symlinks must be 'follow', 'skip' or 'store'")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+    if (options.Has("order") && !options.Get("order").IsUndefined()) {
+      std::string order = options.Get("order").ToString();
+      if (order == "name") {
+        scan.order = ScanOrder::kName;
+      } else if (order != "directory") {
+        Napi::TypeError::New(env, "order must be 'directory' or 'name'")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+      }
+    }
+  }
+  uint64_t ticket = state_->enter();
+  auto op = [state = state_, ticket, dir = std::move(dir), root = std::move(root), recursive,
+             scan = std::move(scan)]() {
+    return AddInOrder(
+        *state, ticket, stats::Op::kAddDir,
+        [](const ZipWriter&) { return std::unique_ptr<PreparedEntry>(); },
+        [&](ZipWriter& writer) { return writer.addDir(dir, root, recursive, scan); });
+  };
+  return MakePromise(env, stats::Op::kAddDir, op,
+                     [state = state_, ticket]() { state->delivered(ticket); });
 }
 
 Napi::Value ZipWriterAPI::addFile(const Napi::CallbackInfo& info) {
@@ -151,10 +467,16 @@ Napi::Value ZipWriterAPI::addFile(const Napi::CallbackInfo& info) {
     name_in_zip = info[1].ToString();
   }
 
-  return MakePromise(env, [&, name = std::move(name), name_in_zip = std::move(name_in_zip)]() {
-        auto ok = writer_->addFile(name, name_in_zip);
-    return ok;
-      });
+  uint64_t ticket = state_->enter();
+  auto op = [state = state_, ticket, name = std::move(name),
+             name_in_zip = std::move(name_in_zip)]() {
+    return AddInOrder(
+        *state, ticket, stats::Op::kAddFile,
+        [&](const ZipWriter& writer) { return writer.prepareFile(name, name_in_zip); },
+        [&](ZipWriter& writer) { return writer.addFile(name, name_in_zip); });
+  };
+  return MakePromise(env, stats::Op::kAddFile, op,
+                     [state = state_, ticket]() { state->delivered(ticket); });
 }
 
 class AddBufferAsync : public Napi::AsyncWorker {
@@ -172,7 +494,17 @@ class AddBufferAsync : public Napi::AsyncWorker {
     b.data = dataPtr;
     b.len = dataLength;
     b.comment = comment;
-    writer->addBuffer(name, b);
+    trace_.start();
+    try {
+      AddInOrder(
+          *writer, ticket, stats::Op::kAddBuffer,
+          [&](const ZipWriter& w) { return w.prepareBuffer(name, b); },
+          [&](ZipWriter& w) { return w.addBuffer(name, b); });
+    } catch (...) {
+      trace_.finish(false);
+      throw;
+    }
+    trace_.finish(true);
   }
 
   // Executed when the async work is complete
@@ -184,10 +516,12 @@ class AddBufferAsync : public Napi::AsyncWorker {
   }
 
   void OnError(Napi::Error const& error) override {
+    writer->delivered(ticket);
     deferred.Reject(error.Value());
   }
 
-  ZipWriter* writer;
+  std::shared_ptr<Shared<ZipWriter>> writer;
+  uint64_t ticket = 0;
   Napi::Promise::Deferred deferred;
   std::string name, comment;
 
@@ -195,6 +529,7 @@ class AddBufferAsync : public Napi::AsyncWorker {
   Napi::ObjectReference ref_;
   uint8_t* dataPtr;
   size_t dataLength;
+  stats::OpTrace trace_{stats::Op::kAddBuffer};
 };
 
 Napi::Value ZipWriterAPI::addBuffer(const Napi::CallbackInfo& info) {
@@ -215,7 +550,8 @@ Napi::Value ZipWriterAPI::addBuffer(const Napi::CallbackInfo& info) {
   auto buf = info[1].As<Napi::Buffer<uint8_t>>();
 
   auto wk = new AddBufferAsync(env, buf);
-  wk->writer = this->writer_.get();
+  wk->writer = state_;
+  wk->ticket = state_->enter();
   wk->name = info[0].ToString();
   if (info.Length() > 2) {
     wk->comment = info[2].ToString();
@@ -224,10 +560,87 @@ Napi::Value ZipWriterAPI::addBuffer(const Napi::CallbackInfo& info) {
   return wk->deferred.Promise();
 }
 
-Napi::Value ZipWriterAPI::close(const Napi::CallbackInfo& info) {
+Napi::Value ZipWriterAPI::flush(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
-  writer_->close();
-  return Napi::Boolean::New(env, true);
+  auto op = [state = state_, ticket = state_->enterFlush()]() {
+    Shared<ZipWriter>::Lock lock(*state, ticket, stats::Op::kFlush, true);
+    std::string error = state->takeError(ticket);
+    if (!error.empty()) {
+      throw std::runtime_error(error);
+    }
+    return true;
+  };
+  return MakePromise(env, stats::Op::kFlush, op);
+}
+
+// Writing the central directory of a large archive takes long enough to
+// stall the event loop, so close runs on the pool like every other operation.
+class CloseWriterAsync : public Napi::AsyncWorker {
+ public:
+  CloseWriterAsync(Napi::Env env, std::shared_ptr<Shared<ZipWriter>> writer)
+      : Napi::AsyncWorker(env),
+        deferred(Napi::Promise::Deferred::New(env)),
+        writer_(std::move(writer)),
+        ticket_(writer_->enterClose()) {}
+
+  void Execute() override {
+    trace_.start();
+    try {
+      Shared<ZipWriter>::Lock lock(*writer_, ticket_, stats::Op::kClose, true);
+      lock.get().close();
+      stats_ = lock.get().stats();
+      std::string error = writer_->takeError(ticket_);
+      if (!error.empty()) {
+        throw std::runtime_error(error);
+      }
+    } catch (...) {
+      trace_.finish(false);
+      throw;
+    }
+    trace_.finish(true);
+  }
+
+  void OnOK() override {
+    Napi::HandleScope scope(Env());
+    auto obj = Napi::Object::New(Env());
+    obj.Set("entries", (double)stats_.entries);
+    obj.Set("duplicates", (double)stats_.duplicates);
+    obj.Set("bytes_saved", (double)stats_.bytes_saved);
+    obj.Set("cpu_saved_ms", stats_.cpu_saved_ms);
+    obj.Set("reused", (double)stats_.reused);
+    if (!stats_.levels.empty()) {
+      auto levels = Napi::Object::New(Env());
+      for (const auto& r : stats_.levels) {
+        auto level = Napi::Object::New(Env());
+        level.Set("level", r.level);
+        level.Set("entries", (double)r.entries);
+        level.Set("bytes", (double)r.bytes);
+        level.Set("compressed_bytes", (double)r.compressed_bytes);
+        level.Set("mb_per_s", r.mb_per_s);
+        levels.Set(class_name(r.entry_class), level);
+      }
+      obj.Set("levels", levels);
+    }
+    deferred.Resolve(obj);
+  }
+
+  void OnError(Napi::Error const& error) override {
+    deferred.Reject(error.Value());
+  }
+
+  Napi::Promise::Deferred deferred;
+
+ private:
+  std::shared_ptr<Shared<ZipWriter>> writer_;
+  uint64_t ticket_;
+  WriterStats stats_;
+  stats::OpTrace trace_{stats::Op::kClose};
+};
+
+Napi::Value ZipWriterAPI::close(const Napi::CallbackInfo& info) {
+  auto* wk = new CloseWriterAsync(info.Env(), state_);
+  wk->Queue();
+  return wk->deferred.Promise();
 }
 
 }  // namespace api
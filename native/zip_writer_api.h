@@ -5,8 +5,11 @@
 
 #include <napi.h>
 
+#include <memory>
+
 #include "zip_writer.h"
 #include "addon.h"
+#include "disposer.h"
 
 namespace api {
 
@@ -16,13 +19,15 @@ class ZipWriterAPI : public Napi::ObjectWrap<ZipWriterAPI> {
   static Napi::Object NewInstance(Napi::Env env, Napi::Value arg, AddonData* addon_data);
 
   ZipWriterAPI(const Napi::CallbackInfo& info);
+  ~ZipWriterAPI();
 
  private:
   Napi::Value addDir(const Napi::CallbackInfo& info);
   Napi::Value addFile(const Napi::CallbackInfo& info);
   Napi::Value addBuffer(const Napi::CallbackInfo& info);
+  Napi::Value flush(const Napi::CallbackInfo& info);
   Napi::Value close(const Napi::CallbackInfo& info);
-  std::unique_ptr<ziputil::ZipWriter> writer_;
+  std::shared_ptr<Shared<ziputil::ZipWriter>> state_;
 };
 
 }  // namespace api
@@ -0,0 +1,274 @@
+#include "zstd_dict.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <fmt/core.h>
+#include <zdict.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "fs_util.h"
+
+namespace ziputil {
+
+const char kDictionaryEntry[] = ".mzip/zstd.dict";
+
+namespace {
+
+// ZSTD_FRAMEHEADERSIZE_MAX, which zstd.h only has for static linking.
+const size_t kFrameHeaderMax = 18;
+
+struct SampleFile {
+  std::string path;
+  int64_t size;
+};
+
+void findSamples(const std::string& path, size_t max_size, std::vector<SampleFile>& out) {
+  if (mz_os_is_symlink(path.c_str()) == MZ_OK) {
+    return;
+  }
+  if (mz_os_is_dir(path.c_str()) != MZ_OK) {
+    int64_t size = mz_os_get_file_size(path.c_str());
+    if (size > 0 && size <= (int64_t)max_size) {
+      out.push_back(SampleFile{path, size});
+    }
+    return;
+  }
+  DIR* d = mz_os_open_dir(path.c_str());
+  if (d == NULL) {
+    return;
+  }
+  struct dirent* entry = NULL;
+  while ((entry = mz_os_read_dir(d)) != NULL) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      findSamples(fs_util::join(path, entry->d_name), max_size, out);
+    }
+  }
+  mz_os_close_dir(d);
+}
+
+bool readSample(const std::string& path, int64_t size, std::string& out) {
+  MzOsStream stream;
+  if (mz_stream_open(stream, path.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    return false;
+  }
+  out.resize((size_t)size);
+  int64_t total = 0;
+  int32_t n = 0;
+  while (total < size &&
+         (n = mz_stream_read(stream, &out[(size_t)total], (int32_t)(size - total))) > 0) {
+    total += n;
+  }
+  out.resize((size_t)total);
+  return n >= 0 && total > 0;
+}
+
+// One compression and one decompression context per thread, reused across
+// entries; creating them costs more than compressing a small file.
+ZSTD_CCtx* threadCCtx() {
+  thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> ctx(ZSTD_createCCtx(),
+                                                                     ZSTD_freeCCtx);
+  return ctx.get();
+}
+
+ZSTD_DCtx* threadDCtx() {
+  thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> ctx(ZSTD_createDCtx(),
+                                                                     ZSTD_freeDCtx);
+  return ctx.get();
+}
+
+}  // namespace
+
+std::vector<std::string> collect_samples(const std::vector<std::string>& paths,
+                                         const TrainOptions& options) {
+  std::vector<SampleFile> files;
+  for (auto& path : paths) {
+    findSamples(path, options.max_sample_size, files);
+  }
+  int64_t total = 0;
+  for (auto& f : files) {
+    total += f.size;
+  }
+  // Every stride-th file, so that samples come from all over the input and
+  // not only from the first directories.
+  size_t stride = std::max<size_t>(1, (size_t)((total + options.sample_bytes - 1) /
+                                               std::max<size_t>(1, options.sample_bytes)));
+  std::vector<std::string> samples;
+  size_t budget = options.sample_bytes;
+  for (size_t i = 0; i < files.size(); i += stride) {
+    if ((size_t)files[i].size > budget) {
+      break;
+    }
+    std::string content;
+    if (readSample(files[i].path, files[i].size, content)) {
+      budget -= content.size();
+      samples.push_back(std::move(content));
+    }
+  }
+  return samples;
+}
+
+std::string train_dictionary(const std::vector<std::string>& samples,
+                             const TrainOptions& options) {
+  std::string joined;
+  std::vector<size_t> sizes;
+  for (auto& s : samples) {
+    joined.append(s);
+    sizes.push_back(s.size());
+  }
+  std::string dictionary(options.dictionary_size, '\0');
+  size_t n = ZDICT_trainFromBuffer(&dictionary[0], dictionary.size(), joined.data(),
+                                   sizes.data(), (unsigned)sizes.size());
+  if (ZDICT_isError(n)) {
+    throw ZipException(MZ_PARAM_ERROR,
+                       fmt::format("training a dictionary on {} samples failed: {}",
+                                   samples.size(), ZDICT_getErrorName(n)));
+  }
+  dictionary.resize(n);
+  return dictionary;
+}
+
+ZstdDictionary::ZstdDictionary(std::string content) : content_(std::move(content)) {
+  id_ = ZDICT_getDictID(content_.data(), content_.size());
+  if (id_ == 0) {
+    throw ZipException(MZ_FORMAT_ERROR, "not a zstd dictionary");
+  }
+  ddict_ = ZSTD_createDDict(content_.data(), content_.size());
+  if (ddict_ == nullptr) {
+    throw ZipException(MZ_MEM_ERROR, "loading the dictionary failed");
+  }
+}
+
+ZstdDictionary::~ZstdDictionary() {
+  ZSTD_freeDDict(static_cast<ZSTD_DDict*>(ddict_));
+  for (auto& it : cdicts_) {
+    ZSTD_freeCDict(static_cast<ZSTD_CDict*>(it.second));
+  }
+}
+
+const void* ZstdDictionary::cdict(int level) const {
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = cdicts_.find(level);
+  if (it != cdicts_.end()) {
+    return it->second;
+  }
+  ZSTD_CDict* cdict = ZSTD_createCDict(content_.data(), content_.size(), level);
+  if (cdict == nullptr) {
+    throw ZipException(MZ_MEM_ERROR, "loading the dictionary failed");
+  }
+  cdicts_.emplace(level, cdict);
+  return cdict;
+}
+
+void ZstdDictionary::compress(const uint8_t* data, size_t len, int level,
+                              std::vector<uint8_t>& out) const {
+  if (level < 0) {
+    level = ZSTD_CLEVEL_DEFAULT;
+  }
+  level = std::min(level, ZSTD_maxCLevel());
+  out.resize(ZSTD_compressBound(len));
+  size_t n = ZSTD_compress_usingCDict(threadCCtx(), out.data(), out.size(), data, len,
+                                      static_cast<const ZSTD_CDict*>(cdict(level)));
+  if (ZSTD_isError(n)) {
+    throw ZipException(MZ_INTERNAL_ERROR,
+                       std::string("zstd compression failed: ") + ZSTD_getErrorName(n));
+  }
+  out.resize(n);
+}
+
+bool ZstdDictionary::encoded(const uint8_t* head, size_t len) const {
+  return ZSTD_getDictID_fromFrame(head, len) == id_;
+}
+
+bool ZstdDictionary::decompress(
+    const std::function<size_t(uint8_t* buf, size_t len)>& source,
+    const std::function<bool(const char* data, int32_t len)>& sink) const {
+  ZSTD_DCtx* dctx = threadDCtx();
+  ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+  ZSTD_DCtx_refDDict(dctx, static_cast<const ZSTD_DDict*>(ddict_));
+
+  std::vector<uint8_t> in(ZSTD_DStreamInSize());
+  std::vector<uint8_t> out(ZSTD_DStreamOutSize());
+  ZSTD_inBuffer input = {in.data(), 0, 0};
+  for (;;) {
+    if (input.pos == input.size) {
+      input.size = source(in.data(), in.size());
+      input.pos = 0;
+    }
+    ZSTD_outBuffer output = {out.data(), out.size(), 0};
+    size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+    if (ZSTD_isError(ret)) {
+      throw ZipException(MZ_DATA_ERROR,
+                         std::string("corrupt zstd frame: ") + ZSTD_getErrorName(ret));
+    }
+    if (output.pos > 0 && !sink(reinterpret_cast<const char*>(out.data()), (int32_t)output.pos)) {
+      return false;
+    }
+    if (ret == 0) {
+      return true;
+    }
+    // Out of input with room left for output: nothing more will come.
+    if (input.size == 0 && output.pos < output.size) {
+      throw ZipException(MZ_DATA_ERROR, "truncated zstd frame");
+    }
+  }
+}
+
+bool ZstdDictReader::read(const mz_zip_file& info,
+                          const std::function<bool(const char* data, int32_t len)>& sink) {
+  if (info.compression_method != MZ_COMPRESS_METHOD_ZSTD ||
+      (info.flag & MZ_ZIP_FLAG_ENCRYPTED) || info.compressed_size <= 0) {
+    return false;
+  }
+  int64_t payload = local_data_offset(stream(), info.disk_offset);
+  if (payload < 0) {
+    return false;
+  }
+  uint8_t head[kFrameHeaderMax];
+  int32_t head_size = (int32_t)std::min<int64_t>(info.compressed_size, sizeof(head));
+  read_at(stream(), payload, head, head_size);
+  if (!dictionary_->encoded(head, (size_t)head_size)) {
+    return false;
+  }
+
+  int64_t pos = payload;
+  int64_t end = payload + info.compressed_size;
+  uLong crc = crc32(0, Z_NULL, 0);
+  int64_t total = 0;
+  bool finished = dictionary_->decompress(
+      [&](uint8_t* buf, size_t len) {
+        int32_t n = (int32_t)std::min<int64_t>((int64_t)len, end - pos);
+        if (n > 0) {
+          read_at(stream(), pos, buf, n);
+          pos += n;
+        }
+        return (size_t)n;
+      },
+      [&](const char* data, int32_t len) {
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(data), (uInt)len);
+        total += len;
+        return sink(data, len);
+      });
+  if (!finished) {
+    return true;
+  }
+  if (total != info.uncompressed_size) {
+    throw ZipException(MZ_DATA_ERROR, "entry size mismatch");
+  }
+  if ((uint32_t)crc != info.crc) {
+    throw ZipException(MZ_CRC_ERROR, "CRC mismatch");
+  }
+  return true;
+}
+
+void* ZstdDictReader::stream() {
+  if (mz_stream_is_open(file_) != MZ_OK &&
+      mz_stream_open(file_, archive_.c_str(), MZ_OPEN_MODE_READ) != MZ_OK) {
+    throw ZipException(MZ_OPEN_ERROR, "opening archive failed");
+  }
+  return file_;
+}
+
+}  // namespace ziputil
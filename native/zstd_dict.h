@@ -0,0 +1,95 @@
+#ifndef ZSTD_DICT_H
+#define ZSTD_DICT_H
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "zip_common.h"
+
+namespace ziputil {
+
+// Stored entry that carries the dictionary of an archive written with one.
+extern const char kDictionaryEntry[];
+
+struct TrainOptions {
+  size_t dictionary_size = 112 * 1024;    /* zstd's default capacity */
+  size_t sample_bytes = 16 * 1024 * 1024; /* input read for training, at most */
+  size_t max_sample_size = 128 * 1024;    /* larger files gain little and are skipped */
+};
+
+// Files under `paths` (files or directories, walked recursively) up to
+// the sampling budget; with more input than that, an even spread of it.
+std::vector<std::string> collect_samples(const std::vector<std::string>& paths,
+                                         const TrainOptions& options);
+// Trains a dictionary with ZDICT_trainFromBuffer. Throws ZipException
+// when the samples are too few or too alike to train on.
+std::string train_dictionary(const std::vector<std::string>& samples,
+                             const TrainOptions& options);
+
+// A trained zstd dictionary, prepared for compressing at any level and for
+// decompressing. Safe to use from several threads.
+class ZstdDictionary {
+ public:
+  // Throws ZipException unless `content` is a zstd dictionary with an ID;
+  // frames record the ID, which is how readers tell them apart.
+  explicit ZstdDictionary(std::string content);
+  ~ZstdDictionary();
+
+  ZstdDictionary(const ZstdDictionary&) = delete;
+  ZstdDictionary& operator=(const ZstdDictionary&) = delete;
+
+  const std::string& content() const { return content_; }
+  uint32_t id() const { return id_; }
+
+  // `data` as one zstd frame; MZ_COMPRESS_LEVEL_DEFAULT is zstd's default.
+  void compress(const uint8_t* data, size_t len, int level, std::vector<uint8_t>& out) const;
+  // True when the frame starting with `head` was compressed with this
+  // dictionary.
+  bool encoded(const uint8_t* head, size_t len) const;
+  // Streams the frame read through `source` (bytes read, 0 at the end)
+  // into `sink`, which returns false to stop. False when it stopped.
+  bool decompress(const std::function<size_t(uint8_t* buf, size_t len)>& source,
+                  const std::function<bool(const char* data, int32_t len)>& sink) const;
+
+ private:
+  const void* cdict(int level) const;
+
+  std::string content_;
+  uint32_t id_ = 0;
+  void* ddict_ = nullptr;
+  mutable std::mutex mu_;
+  mutable std::map<int, void*> cdicts_;
+};
+
+// Zstd entries of an archive whose frames use its dictionary, decoded from
+// the raw archive bytes; minizip's zstd stream has no dictionary support.
+class ZstdDictReader {
+ public:
+  ZstdDictReader(const std::string& archive, std::shared_ptr<const ZstdDictionary> dictionary)
+      : archive_(archive), dictionary_(std::move(dictionary)) {}
+
+  // Streams the content of `info` through `sink` like
+  // ZipReader::readEntry. False, with nothing read, when the entry is not
+  // one that needs the dictionary. Throws ZipException for corrupt data, a
+  // size or CRC mismatch, and read errors.
+  bool read(const mz_zip_file& info,
+            const std::function<bool(const char* data, int32_t len)>& sink);
+
+ private:
+  void* stream();
+
+  std::string archive_;
+  std::shared_ptr<const ZstdDictionary> dictionary_;
+  MzOsStream file_;
+};
+
+}  // namespace ziputil
+#endif  // ZSTD_DICT_H
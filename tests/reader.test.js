@@ -5,20 +5,20 @@ const rimraf = require("rimraf");
 test("open zip", async () => {
     let z = await zip.open('./tests/test.zip');
     expect(z.count).toBeGreaterThan(1);
-    z.close();
+    await z.close();
 });
 
 test("open zip with standard encryption", async () => {
     let z = await zip.open('./tests/test-encrypted.zip', '123');
     expect(z.count).toBeGreaterThan(1);
-    z.close();
+    await z.close();
 });
 
 
 test("open zip with aes256", async () => {
     let z = await zip.open('./tests/test-aes256.zip', '123');
     expect(z.count).toBeGreaterThan(1);
-    z.close();
+    await z.close();
 });
 
 
@@ -35,7 +35,7 @@ test("test exists", async () => {
     expect(z.exists('yargs/index.js')).toBe(true);
     expect(z.exists('yargs/index.js')).toBe(true);
     expect(z.exists('xxx.json')).toBe(false);
-    z.close();
+    await z.close();
 });
 
 test("test item", async () => {
@@ -44,7 +44,7 @@ test("test item", async () => {
         // console.log(z.item(i));
         expect(z.item(i).name.length).toBeGreaterThan(0);
     }
-    z.close();
+    await z.close();
 });
 
 test("test extract", async () => {
@@ -59,7 +59,7 @@ test("test extract", async () => {
     expect(n).toBeGreaterThan(10);
     expect(fs.existsSync('./tests/temp/partial/yargs/locales/en.json')).toBe(true);
 
-    z.close();
+    await z.close();
 });
 
 
@@ -90,3 +90,396 @@ test("test read simultaneously", async () => {
         expect(data[i]).toBe(f1);
     });
 });
+
+test("test zlib version", () => {
+    expect(typeof zip.zlib_version).toBe("string");
+    expect(zip.zlib_version.length).toBeGreaterThan(0);
+    // Built with zlib-ng, the calls must reach it and not Node's own zlib.
+    expect(/zlib-ng/.test(zip.zlib_version)).toBe(zip.zlib_ng);
+});
+
+test("test stats and tracing", async () => {
+    zip.set_stats(true);
+    zip.set_tracing(true);
+    zip.stats_reset();
+
+    var z = await zip.open('./tests/test-aes256.zip', '123');
+    await z.read("yargs/index.js");
+    await z.close();
+
+    const s = zip.stats();
+    expect(s.enabled).toBe(true);
+    expect(s.ops.open.ops).toBe(1);
+    expect(s.ops.read.ops).toBe(1);
+    expect(s.ops.read.bytes_out).toBeGreaterThan(0);
+    expect(s.ops.read.exec.count).toBe(1);
+
+    const trace = JSON.parse(zip.trace_events());
+    expect(trace.traceEvents.map(e => e.name)).toContain("read");
+
+    zip.set_tracing(false);
+    zip.set_stats(false);
+});
+
+test("test extract nested directories", async () => {
+    var z = await zip.open('./tests/test.zip');
+    const dest = './tests/temp/dirs';
+    rimraf.sync(dest);
+
+    const n = await z.extract_all(dest);
+    if (process.platform !== 'win32') {
+        // Created like minizip does, readable by everyone the umask allows.
+        expect(fs.statSync(dest).mode & 0o777).toBe(0o755 & ~process.umask());
+    }
+    for (let i = 0; i < z.count; ++i) {
+        const item = z.item(i);
+        const p = `${dest}/${item.name}`;
+        expect(fs.existsSync(p)).toBe(true);
+        if (item.is_directory) {
+            expect(fs.statSync(p).isDirectory()).toBe(true);
+            expect(Math.floor(fs.statSync(p).mtimeMs / 1000)).toBe(item.modified_date);
+        }
+    }
+    expect(n).toBe(z.count);
+    await z.close();
+});
+
+test("test extract all content", async () => {
+    var z = await zip.open('./tests/test.zip');
+    const dest = './tests/temp/content';
+    rimraf.sync(dest);
+
+    await z.extract_all(dest);
+    for (let i = 0; i < z.count; ++i) {
+        const item = z.item(i);
+        if (item.is_directory || item.is_symlink) {
+            continue;
+        }
+        const p = `${dest}/${item.name}`;
+        expect(fs.statSync(p).size).toBe(item.uncompressed_size);
+        expect(fs.readFileSync(p, 'utf8')).toBe(await z.read(item.name));
+    }
+    await z.close();
+});
+
+test("test extract empty deflated entry", async () => {
+    // One 0-byte file stored as a deflate stream (a single empty final block).
+    const name = Buffer.from("empty.txt");
+    const payload = Buffer.from([0x03, 0x00]);
+    const local = Buffer.alloc(30);
+    local.writeUInt32LE(0x04034b50, 0);
+    local.writeUInt16LE(20, 4);
+    local.writeUInt16LE(8, 8);
+    local.writeUInt16LE(0x21, 12);
+    local.writeUInt32LE(payload.length, 18);
+    local.writeUInt16LE(name.length, 26);
+    const central = Buffer.alloc(46);
+    central.writeUInt32LE(0x02014b50, 0);
+    central.writeUInt16LE(20, 4);
+    central.writeUInt16LE(20, 6);
+    central.writeUInt16LE(8, 10);
+    central.writeUInt16LE(0x21, 14);
+    central.writeUInt32LE(payload.length, 20);
+    central.writeUInt16LE(name.length, 28);
+    const cdOffset = local.length + name.length + payload.length;
+    const end = Buffer.alloc(22);
+    end.writeUInt32LE(0x06054b50, 0);
+    end.writeUInt16LE(1, 8);
+    end.writeUInt16LE(1, 10);
+    end.writeUInt32LE(central.length + name.length, 12);
+    end.writeUInt32LE(cdOffset, 16);
+    const zipfile = './tests/temp/empty-deflated.zip';
+    fs.mkdirSync('./tests/temp', { recursive: true });
+    fs.writeFileSync(zipfile, Buffer.concat([local, name, payload, central, name, end]));
+
+    const dest = './tests/temp/empty-deflated';
+    rimraf.sync(dest);
+    var z = await zip.open(zipfile);
+    expect(await z.extract_all(dest)).toBe(1);
+    expect(fs.statSync(`${dest}/empty.txt`).size).toBe(0);
+    await z.close();
+});
+
+test("test extract sparse", async () => {
+    var z = await zip.open('./tests/test.zip');
+    const dest = './tests/temp/sparse';
+    rimraf.sync(dest);
+
+    await z.extract_all(dest, { sparse: true });
+    for (let i = 0; i < z.count; ++i) {
+        const item = z.item(i);
+        if (item.is_directory || item.is_symlink) {
+            continue;
+        }
+        const p = `${dest}/${item.name}`;
+        expect(fs.statSync(p).size).toBe(item.uncompressed_size);
+        expect(fs.readFileSync(p, 'utf8')).toBe(await z.read(item.name));
+    }
+    await z.close();
+});
+
+test("test extract include and exclude", async () => {
+    var z = await zip.open('./tests/test.zip');
+    const dest = './tests/temp/globs';
+    rimraf.sync(dest);
+
+    let n = await z.extract_all(dest, ['yargs/lib/*', 'YARGS/*.md'], { exclude: ['yargs/lib/usage*'] });
+    expect(n).toBe(7);
+    expect(fs.existsSync(`${dest}/yargs/lib/parser.js`)).toBe(true);
+    expect(fs.existsSync(`${dest}/yargs/lib/usage.js`)).toBe(false);
+    expect(fs.existsSync(`${dest}/yargs/README.md`)).toBe(true);
+    expect(fs.existsSync(`${dest}/yargs/index.js`)).toBe(false);
+
+    rimraf.sync(dest);
+    n = await z.extract_all(dest, { exclude: ['yargs/locales/*'] });
+    expect(n).toBe(z.count - 15);
+    expect(fs.existsSync(`${dest}/yargs/locales`)).toBe(false);
+    await z.close();
+});
+
+test("test directory tree", async () => {
+    var z = await zip.open('./tests/test.zip');
+    expect(z.readdir('')).toEqual(['yargs']);
+    expect(z.readdir('yargs/lib')).toEqual(['completion.js', 'parser.js', 'tokenize-arg-string.js', 'usage.js', 'validation.js']);
+    expect(z.readdir('yargs/index.js')).toBeNull();
+    expect(z.readdir('nope')).toBeNull();
+
+    expect(z.stat('yargs/index.js').is_directory).toBe(false);
+    expect(z.stat('/yargs/locales/').is_directory).toBe(true);
+    expect(z.stat('').implicit).toBe(true);
+    expect(z.stat('nope')).toBeNull();
+
+    const all = z.walk();
+    expect(all.length).toBe(z.count);
+    expect(all[0]).toBe('yargs/');
+    expect(z.walk('yargs/locales').length).toBe(14);
+
+    // Case is ignored by every lookup, as by exists.
+    expect(z.exists('YARGS/index.js')).toBe(true);
+    expect(z.readdir('YARGS/Lib')).toEqual(z.readdir('yargs/lib'));
+    expect(z.stat('Yargs/Index.js').name).toBe('yargs/index.js');
+    expect(z.walk('YARGS/locales').length).toBe(14);
+    expect(await z.read('YARGS/index.js')).toBe(await z.read('yargs/index.js'));
+    expect((await z.readRange('YARGS/index.js', 0, 10)).toString()).toBe((await z.read('yargs/index.js')).slice(0, 10));
+    expect(await z.extract('YARGS/index.js', './tests/temp/case-index.js')).toBeTruthy();
+    expect(fs.readFileSync('./tests/temp/case-index.js', 'utf8')).toBe(await z.read('yargs/index.js'));
+    await z.close();
+});
+
+test("test sidecar index", async () => {
+    const idx = './tests/temp/test.zip.mzidx';
+    fs.mkdirSync('./tests/temp', { recursive: true });
+    rimraf.sync(idx);
+
+    var a = await zip.open('./tests/test.zip', undefined, { index: idx });
+    expect(fs.existsSync(idx)).toBe(true);
+    var b = await zip.open('./tests/test.zip', undefined, { index: idx });
+    expect(b.count).toBe(a.count);
+    for (let i = 0; i < a.count; ++i) {
+        expect(b.item(i)).toEqual(a.item(i));
+    }
+    expect(b.exists('YARGS/index.js')).toBe(true);
+    expect(b.exists('yargs/nope.js')).toBe(false);
+    expect(b.readdir('yargs/lib')).toEqual(a.readdir('yargs/lib'));
+    expect(await b.read('yargs/package.json')).toBe(await a.read('yargs/package.json'));
+    await a.close();
+    await b.close();
+
+    // A doctored index is believed as long as its archive stamp matches,
+    // which shows the entries come from the index rather than the archive.
+    const copy = './tests/temp/test_index.zip';
+    const copyIdx = copy + '.mzidx';
+    fs.copyFileSync('./tests/test.zip', copy);
+    rimraf.sync(copyIdx);
+    var c = await zip.open(copy, undefined, { index: copyIdx });
+    await c.close();
+    const doctored = Buffer.from(fs.readFileSync(copyIdx).toString('latin1')
+        .split('yargs/package.json').join('yargs/package.jsoX'), 'latin1');
+    fs.writeFileSync(copyIdx, doctored);
+    var d = await zip.open(copy, undefined, { index: copyIdx });
+    const names = (z) => Array.from({ length: z.count }, (_, i) => z.item(i).name);
+    expect(names(d)).toContain('yargs/package.jsoX');
+    expect(names(d)).not.toContain('yargs/package.json');
+    await d.close();
+
+    // Once the archive changes the index is stale, ignored and rewritten.
+    const later = new Date(Date.now() + 60000);
+    fs.utimesSync(copy, later, later);
+    var e = await zip.open(copy, undefined, { index: copyIdx });
+    expect(names(e)).toContain('yargs/package.json');
+    expect(names(e)).not.toContain('yargs/package.jsoX');
+    await e.close();
+    expect(fs.readFileSync(copyIdx).includes('yargs/package.jsoX')).toBe(false);
+});
+
+test("test parse stream", async () => {
+    const names = [];
+    const contents = {};
+    await new Promise((resolve, reject) => {
+        const parser = zip.parse();
+        parser.on('entry', (entry, stream) => {
+            names.push(entry.name);
+            const chunks = [];
+            stream.on('data', (c) => chunks.push(c));
+            stream.on('end', () => {
+                contents[entry.name] = Buffer.concat(chunks).toString('utf8');
+            });
+        });
+        parser.on('finish', resolve);
+        parser.on('error', reject);
+        fs.createReadStream('./tests/test.zip', { highWaterMark: 4096 }).pipe(parser);
+    });
+
+    var z = await zip.open('./tests/test.zip');
+    expect(names.length).toBe(z.count);
+    expect(contents['yargs/index.js']).toBe(await z.read('yargs/index.js'));
+    await z.close();
+});
+
+test("test parse stream with a slow entry consumer", async () => {
+    const zipfile = "./tests/temp/parse-slow.zip";
+    const a = require("crypto").randomBytes(64 * 1024);
+    const b = Buffer.from("b".repeat(4000));
+    const w = await zip.create(zipfile);
+    await w.addBuffer("a.bin", a);
+    await w.addBuffer("b.txt", b);
+    await w.close();
+
+    // The first chunk ends inside b.txt: a.bin is backed up, has ended, and
+    // b.txt has started, all in one batch of events.
+    const data = fs.readFileSync(zipfile);
+    const cut = data.indexOf("b.txt") + 2000;
+    const contents = {};
+    const ended = [];
+    await new Promise((resolve, reject) => {
+        const parser = zip.parse();
+        parser.on('entry', (entry, stream) => {
+            const chunks = [];
+            ended.push(new Promise((done) => {
+                stream.on('end', () => {
+                    contents[entry.name] = Buffer.concat(chunks);
+                    done();
+                });
+            }));
+            const consume = () => stream.on('data', (c) => chunks.push(c));
+            if (entry.name === "a.bin") {
+                setTimeout(consume, 100);
+            } else {
+                consume();
+            }
+        });
+        parser.on('finish', resolve);
+        parser.on('error', reject);
+        parser.write(data.subarray(0, cut));
+        parser.end(data.subarray(cut));
+    });
+    await Promise.all(ended);
+    expect(contents["a.bin"]).toEqual(a);
+    expect(contents["b.txt"]).toEqual(b);
+});
+
+test("test parse stream spanned archive marker", async () => {
+    const data = fs.readFileSync('./tests/test.zip');
+    const marker = Buffer.from([0x50, 0x4b, 0x07, 0x08]);
+    const parse = (chunks) => new Promise((resolve, reject) => {
+        let count = 0;
+        const parser = zip.parse();
+        parser.on('entry', (entry, stream) => {
+            ++count;
+            stream.resume();
+        });
+        parser.on('finish', () => resolve(count));
+        parser.on('error', reject);
+        chunks.forEach((c) => parser.write(c));
+        parser.end();
+    });
+
+    var z = await zip.open('./tests/test.zip');
+    const count = z.count;
+    await z.close();
+    // Leading the stream it marks a spanned archive and is skipped.
+    expect(await parse([marker, data])).toBe(count);
+    // Anywhere else it is corrupt, even where a chunk starts.
+    const second = data.indexOf(Buffer.from([0x50, 0x4b, 0x03, 0x04]), 4);
+    await expect(parse([data.subarray(0, second), Buffer.concat([marker, data.subarray(second)])]))
+        .rejects.toThrow(/invalid local header signature/);
+});
+
+test("test read size limit", async () => {
+    var z = await zip.open('./tests/test.zip', undefined, { maxReadSize: 16 });
+    await expect(z.read('yargs/package.json')).rejects.toThrow(/read limit/);
+    expect(await z.extract('yargs/package.json', './tests/temp/limit/package.json')).toBe(true);
+    await z.close();
+});
+
+test("test verify", async () => {
+    var z = await zip.open('./tests/test.zip');
+    var result = await z.verify({ threads: 3 });
+    expect(result.ok).toBe(true);
+    expect(result.failures).toEqual([]);
+    expect(result.entries).toBeGreaterThan(1);
+    expect(result.bytes).toBeGreaterThan(result.compressed_bytes);
+    await z.close();
+
+    z = await zip.open('./tests/test-aes256.zip', '123');
+    expect((await z.verify()).ok).toBe(true);
+    await z.close();
+
+    const corrupt = './tests/temp/corrupt.zip';
+    const data = fs.readFileSync('./tests/test.zip');
+    data[Math.floor(data.length / 3)] ^= 0xff;
+    fs.writeFileSync(corrupt, data);
+    z = await zip.open(corrupt);
+    result = await z.verify();
+    expect(result.ok).toBe(false);
+    expect(result.failures.length).toBeGreaterThan(0);
+    expect(typeof result.failures[0].error).toBe('string');
+    await z.close();
+});
+
+test("test read range", async () => {
+    const file = './tests/temp/range.zip';
+    const lines = [];
+    for (let i = 0; i < 100000; ++i) {
+        lines.push(`line ${i} ${(i * 7919) % 1000}\n`);
+    }
+    const content = Buffer.from(lines.join(''));
+    const w = await zip.create(file);
+    await w.addBuffer('lines.txt', content);
+    await w.close();
+
+    const z = await zip.open(file, undefined, { checkpointSpan: 64 * 1024 });
+    for (const [offset, length] of [[0, 16], [123457, 5000], [content.length - 10, 100], [1, content.length]]) {
+        const part = await z.readRange('lines.txt', offset, length);
+        expect(Buffer.isBuffer(part)).toBe(true);
+        expect(part.equals(content.subarray(offset, offset + length))).toBe(true);
+    }
+    expect((await z.readRange('lines.txt', content.length + 1, 10)).length).toBe(0);
+    expect(await z.readRange('missing.txt', 0, 10)).toBe(null);
+    await z.close();
+    await expect(z.readRange('lines.txt', 0, 10)).rejects.toThrow(/closed/);
+
+    // Encrypted entries fall back to inflating from the start.
+    const aes = await zip.open('./tests/test-aes256.zip', '123');
+    const whole = Buffer.from(await aes.read('yargs/LICENSE'));
+    const part = await aes.readRange('yargs/LICENSE', 2, 8);
+    expect(part.equals(whole.subarray(2, 10))).toBe(true);
+    await aes.close();
+});
+
+test("test read aes entries", async () => {
+    const plain = await zip.open('./tests/test.zip');
+    const z = await zip.open('./tests/test-aes256.zip', '123');
+    for (const name of ['yargs/README.md', 'yargs/LICENSE', 'yargs/locales/de.json']) {
+        const expected = await plain.read(name);
+        expect(await z.read(name)).toEqual(expected);
+        // Second read with the cached key.
+        expect(await z.read(name)).toEqual(expected);
+    }
+    await z.close();
+    await plain.close();
+
+    const wrong = await zip.open('./tests/test-aes256.zip', 'wrong');
+    await expect(wrong.read('yargs/LICENSE')).rejects.toThrow();
+    await wrong.close();
+});
@@ -3,7 +3,7 @@ const fs = require('fs');
 
 test("test create", async () => {
     const z = await zip.create("./tests/temp/new.zip", "123");
-    z.close();
+    await z.close();
     expect(fs.existsSync("./tests/temp/new.zip")).toBe(true);
 });
 
@@ -13,22 +13,22 @@ test("test addDir", async () => {
     const z = await zip.create(zipf, "123");
     let ok = await z.addDir("native/third_party/minizip");
     expect(ok).toBe(true);
-    z.close();
+    await z.close();
 
     const r = await zip.open(zipf, "123");
     expect(r.exists('native/third_party/minizip/README.md')).toBe(true);
-    r.close();
+    await r.close();
 }, 10000);
 
 test("test addDir with root", async () => {
     const z = await zip.create("./tests/temp/new2.zip", "123");
     let ok = await z.addDir("native/third_party/minizip", "native/third_party");
     expect(ok).toBe(true);
-    z.close();
+    await z.close();
 
     const r = await zip.open("./tests/temp/new2.zip", "123");
     expect(r.exists('minizip/README.md')).toBe(true);
-    r.close();
+    await r.close();
 });
 
 test("test addDir with wildchar", async () => {
@@ -36,12 +36,12 @@ test("test addDir with wildchar", async () => {
     const z = await zip.create(zipfile, "123");
     let ok = await z.addDir("native/third_party/minizip/*.md");
     expect(ok).toBe(true);
-    z.close();
+    await z.close();
 
     const r = await zip.open(zipfile, "123");
     expect(r.exists('native/third_party/minizip/README.md')).toBe(true);
     expect(r.exists('native/third_party/minizip/mz_os.h')).toBe(false);
-    r.close();
+    await r.close();
 });
 
 test("test addDir with no recursive", async () => {
@@ -49,13 +49,13 @@ test("test addDir with no recursive", async () => {
     const z = await zip.create(zipfile, "123");
     let ok = await z.addDir("native/third_party/minizip/*.*", "", false);
     expect(ok).toBe(true);
-    z.close();
+    await z.close();
 
     const r = await zip.open(zipfile, "123");
     expect(r.exists('native/third_party/minizip/README.md')).toBe(true);
     expect(r.exists('native/third_party/minizip/mz_os.h')).toBe(true);
     expect(r.exists('native/third_party/minizip/doc')).toBe(false);
-    r.close();
+    await r.close();
 });
 
 test("test addFile", async () => {
@@ -64,7 +64,7 @@ test("test addFile", async () => {
     expect(ok).toBe(true);
     ok = await z.addFile("./index.js", "new-index.js");
     expect(ok).toBe(true);
-    z.close();
+    await z.close();
 
     const r = await zip.open("./tests/temp/new-file.zip", "123");
 
@@ -83,7 +83,7 @@ test("test addFile", async () => {
         });
         expect(d).toBe(index);
     }
-    r.close();
+    await r.close();
 });
 
 
@@ -93,7 +93,7 @@ test("test addBuffer", async () => {
     const z = await zip.create("./tests/temp/new-file2.zip", "123");
     ok = await z.addBuffer("hello.txt", Buffer.from(data));
     expect(ok).toBe(true);
-    z.close();
+    await z.close();
 
     const r = await zip.open("./tests/temp/new-file2.zip", "123");
 
@@ -102,5 +102,404 @@ test("test addBuffer", async () => {
         expect(d).toBe(data);
     }
 
-    r.close();
+    await r.close();
+});
+
+test("test dedup", async () => {
+    const zipfile = "./tests/temp/new-dedup.zip";
+    const data = "hello, dedup!";
+    const z = await zip.create(zipfile, "123", { dedup: true });
+    expect(await z.addBuffer("a.txt", Buffer.from(data))).toBe(true);
+    expect(await z.addBuffer("b.txt", Buffer.from(data))).toBe(true);
+    expect(await z.addFile("./package.json", "pkg1.json")).toBe(true);
+    expect(await z.addFile("./package.json", "pkg2.json")).toBe(true);
+    const result = await z.close();
+    expect(result.entries).toBe(4);
+    expect(result.duplicates).toBe(2);
+    expect(result.bytes_saved).toBeGreaterThan(data.length);
+
+    const r = await zip.open(zipfile, "123");
+    expect(await r.read("b.txt")).toBe(data);
+    const pkg = fs.readFileSync("./package.json", { encoding: "utf8" });
+    expect(await r.read("pkg1.json")).toBe(pkg);
+    expect(await r.read("pkg2.json")).toBe(pkg);
+    await r.close();
+});
+
+test("test close waits for pending operations", async () => {
+    const zipfile = "./tests/temp/new-pending.zip";
+    const z = await zip.create(zipfile);
+    const pending = [];
+    for (let i = 0; i < 20; ++i) {
+        pending.push(z.addBuffer(`f${i}.txt`, Buffer.from(`file ${i}`)));
+    }
+    const result = await z.close();
+    expect(await Promise.all(pending)).toEqual(pending.map(() => true));
+    expect(result.entries).toBe(20);
+
+    const r = await zip.open(zipfile);
+    expect(r.count).toBe(20);
+    expect(await r.read("f19.txt")).toBe("file 19");
+    await r.close();
+});
+
+test("test queued adds keep call order", async () => {
+    const zipfile = "./tests/temp/new-queued.zip";
+    const z = await zip.create(zipfile);
+    const names = [];
+    for (let i = 0; i < 200; ++i) {
+        names.push(`b${i}.txt`);
+        z.addBuffer(`b${i}.txt`, Buffer.from(`buffer ${i} `.repeat(i)));
+        if (i % 50 == 0) {
+            names.push(`pkg${i}.json`);
+            z.addFile("./package.json", `pkg${i}.json`);
+        }
+    }
+    expect(await z.flush()).toBe(true);
+    z.addFile("./tests/temp/does-not-exist").catch(() => {});
+    await expect(z.flush()).rejects.toThrow();
+    expect((await z.close()).entries).toBe(names.length);
+
+    const r = await zip.open(zipfile);
+    expect(r.count).toBe(names.length);
+    for (let i = 0; i < names.length; ++i) {
+        expect(r.item(i).name).toBe(names[i]);
+    }
+    expect(await r.read("b199.txt")).toBe("buffer 199 ".repeat(199));
+    await r.close();
+});
+
+test("test close after a caught add failure", async () => {
+    const zipfile = "./tests/temp/new-caught.zip";
+    const z = await zip.create(zipfile);
+    await z.addBuffer("a.txt", Buffer.from("a"));
+    let failed = false;
+    try {
+        await z.addFile("./tests/temp/does-not-exist");
+    } catch (e) {
+        failed = true;
+    }
+    expect(failed).toBe(true);
+    expect(await z.flush()).toBe(true);
+    try {
+        await z.addFile("./tests/temp/does-not-exist");
+    } catch (e) {
+    }
+    expect((await z.close()).entries).toBe(1);
+
+    const r = await zip.open(zipfile);
+    expect(await r.read("a.txt")).toBe("a");
+    await r.close();
+});
+
+test("test queued adds with a password", async () => {
+    const zipfile = "./tests/temp/new-queued-aes.zip";
+    const z = await zip.create(zipfile, "secret");
+    const big = Buffer.alloc(3 * 1024 * 1024 + 5);
+    for (let i = 0; i < big.length; ++i) {
+        big[i] = (i * 2654435761) >>> 24;
+    }
+    z.addBuffer("big.bin", big);
+    for (let i = 0; i < 50; ++i) {
+        z.addBuffer(`b${i}.txt`, Buffer.from(`secret ${i} `.repeat(i)));
+    }
+    z.addFile("./package.json", "package.json");
+    expect((await z.close()).entries).toBe(52);
+
+    const r = await zip.open(zipfile, "secret");
+    expect(r.stat("b7.txt").is_encrypted).toBe(true);
+    expect(await r.read("b49.txt")).toBe("secret 49 ".repeat(49));
+    expect(await r.read("package.json")).toBe(fs.readFileSync("./package.json", "utf8"));
+    expect((await r.readRange("big.bin", 0, big.length)).equals(big)).toBe(true);
+    // Checked through minizip's own decryption.
+    expect((await r.verify()).ok).toBe(true);
+    await r.close();
+});
+
+test("test compression levels", async () => {
+    const text = Buffer.from("the quick brown fox jumps over the lazy dog\n".repeat(20000));
+    const sizes = {};
+    for (const level of [0, 1, 9]) {
+        const zipfile = `./tests/temp/new-level-${level}.zip`;
+        const z = await zip.create(zipfile, undefined, { level });
+        await z.addBuffer("a.txt", text);
+        expect((await z.close()).levels).toBeUndefined();
+        sizes[level] = fs.statSync(zipfile).size;
+    }
+    expect(sizes[0]).toBeGreaterThan(text.length);
+    expect(sizes[9]).toBeLessThanOrEqual(sizes[1]);
+    expect(() => zip.create("./tests/temp/new-level-bad.zip", undefined, { level: 12 })).toThrow();
+
+    // A ratio target alone does not depend on timing: text far below it
+    // gives levels back, incompressible binaries ask for more.
+    const binary = require("crypto").randomBytes(1024 * 1024);
+    const zipfile = "./tests/temp/new-level-auto.zip";
+    const z = await zip.create(zipfile, undefined, { level: "auto", targetRatio: 0.5 });
+    for (let i = 0; i < 20; ++i) {
+        z.addBuffer(`t${i}.txt`, text);
+        z.addBuffer(`b${i}.bin`, binary);
+        z.addBuffer(`i${i}.png`, text);
+    }
+    const result = await z.close();
+    const { text: t, binary: b, compressed: c } = result.levels;
+    expect(result.entries).toBe(60);
+    expect([t.entries, b.entries, c.entries]).toEqual([20, 20, 20]);
+    expect([t.bytes, b.bytes, c.bytes]).toEqual([20 * text.length, 20 * binary.length, 20 * text.length]);
+    expect(t.level).toBeLessThan(6);
+    expect(b.level).toBeGreaterThan(6);
+    expect(t.compressed_bytes).toBeLessThan(t.bytes / 100);
+    expect(c.level).toBe(0);
+    expect(c.compressed_bytes).toBe(20 * text.length);
+
+    const r = await zip.open(zipfile);
+    expect(await r.read("t19.txt")).toBe(text.toString());
+    await r.close();
+});
+
+test("test zstd dictionary", async () => {
+    const words = ["missing", "argument", "required", "option", "unknown", "command", "choices"];
+    const samples = [];
+    for (let i = 0; i < 400; ++i) {
+        const locale = {};
+        for (let j = 0; j < 12; ++j) {
+            locale[`${words[(i + j) % words.length]}_${j}`] = `${words[j % words.length]} ${words[i % words.length]} %s`;
+        }
+        samples.push(Buffer.from(JSON.stringify(locale, null, 2)));
+    }
+    const dictionary = await zip.trainDictionary(samples, { size: 16 * 1024 });
+    expect(dictionary.length).toBeGreaterThan(0);
+    expect(dictionary.length).toBeLessThanOrEqual(16 * 1024);
+    await expect(zip.trainDictionary([Buffer.from("x")])).rejects.toThrow();
+    expect(() => zip.create("./tests/temp/bad.zip", "pw", { dictionary })).toThrow();
+
+    const zipfile = "./tests/temp/new-dictionary.zip";
+    const z = await zip.create(zipfile, undefined, { dictionary });
+    samples.forEach((buf, i) => z.addBuffer(`locales/${i}.json`, buf));
+    expect((await z.close()).entries).toBe(samples.length);
+
+    const r = await zip.open(zipfile);
+    // The dictionary entry is the reader's own business.
+    expect(r.exists(".mzip/zstd.dict")).toBeFalsy();
+    expect(r.count).toBe(samples.length);
+    expect(await r.read("locales/7.json")).toBe(samples[7].toString());
+    const verified = await r.verify();
+    expect(verified.failures).toEqual([]);
+    expect(verified.ok).toBeTruthy();
+    expect(await r.extract("locales/399.json", "./tests/temp/dictionary-399.json")).toBeTruthy();
+    expect(fs.readFileSync("./tests/temp/dictionary-399.json")).toEqual(samples[399]);
+    const out = "./tests/temp/dictionary-out";
+    fs.rmSync(out, { recursive: true, force: true });
+    expect(await r.extract_all(out)).toBe(samples.length);
+    expect(fs.existsSync(`${out}/.mzip`)).toBeFalsy();
+    await r.close();
+});
+
+test("test solid blocks", async () => {
+    const zipfile = "./tests/temp/new-solid.zip";
+    const files = [];
+    for (let i = 0; i < 300; ++i) {
+        files.push(Buffer.from(`{"id": ${i}, "name": "file ${i}", "tags": ["small", "solid"]}\n`.repeat(i % 40 + 1)));
+    }
+    const big = Buffer.alloc(100 * 1024, 7);
+    const z = await zip.create(zipfile, undefined, { solid: { blockSize: 16 * 1024 } });
+    files.forEach((buf, i) => z.addBuffer(`data/${i}.json`, buf));
+    z.addBuffer("big.bin", big);
+    expect((await z.close()).entries).toBe(files.length + 1);
+    expect(() => zip.create("./tests/temp/bad.zip", undefined, { solid: { blockSize: 10 } })).toThrow();
+
+    const r = await zip.open(zipfile);
+    expect(r.exists("data/5.json")).toBeTruthy();
+    expect(r.exists("data/300.json")).toBeFalsy();
+    expect(r.exists(".mzip/solid.idx")).toBeFalsy();
+    expect(r.count).toBeLessThan(files.length);
+    expect(await r.read("data/123.json")).toBe(files[123].toString());
+    expect(await r.readRange("data/299.json", 2, 4)).toEqual(files[299].subarray(2, 6));
+    expect((await r.read("big.bin")).length).toBe(big.length);
+    const verified = await r.verify();
+    expect(verified.failures).toEqual([]);
+    expect(verified.ok).toBeTruthy();
+
+    const out = "./tests/temp/solid-out";
+    fs.rmSync(out, { recursive: true, force: true });
+    await r.extract_all(out, ["data/1*"]);
+    expect(fs.readFileSync(`${out}/data/17.json`)).toEqual(files[17]);
+    expect(fs.existsSync(`${out}/data/2.json`)).toBeFalsy();
+    expect(fs.existsSync(`${out}/.mzip`)).toBeFalsy();
+    await r.close();
+
+    // The password can come after open, as for plain entries.
+    const secret = "./tests/temp/new-solid-aes.zip";
+    const w = await zip.create(secret, "pw", { solid: true });
+    files.slice(0, 20).forEach((buf, i) => w.addBuffer(`data/${i}.json`, buf));
+    await w.close();
+    const s = await zip.open(secret);
+    expect(s.exists("data/3.json")).toBeTruthy();
+    s.setPassword("pw");
+    expect(await s.read("data/3.json")).toBe(files[3].toString());
+    await s.close();
+});
+
+test("test addDir prefetch", async () => {
+    const names = {};
+    for (const prefetch of [0, 3]) {
+        const zipfile = `./tests/temp/new-prefetch-${prefetch}.zip`;
+        const z = await zip.create(zipfile, undefined, { prefetch });
+        await z.addDir("native/third_party/minizip", "native/third_party");
+        await z.addFile("./package.json");
+        await z.close();
+
+        const r = await zip.open(zipfile);
+        names[prefetch] = r.walk();
+        expect(await r.read("minizip/README.md"))
+            .toBe(fs.readFileSync("native/third_party/minizip/README.md", "utf8"));
+        expect((await r.verify()).ok).toBeTruthy();
+        await r.close();
+    }
+    expect(names[3]).toEqual(names[0]);
+    expect(() => zip.create("./tests/temp/bad.zip", undefined, { prefetch: -1 })).toThrow();
+});
+
+test("test addDir filters and order", async () => {
+    const src = "./tests/temp/scan-src";
+    fs.rmSync(src, { recursive: true, force: true });
+    for (const dir of ["b/.git/objects", "a/node_modules/x", "a/lib"]) {
+        fs.mkdirSync(`${src}/${dir}`, { recursive: true });
+    }
+    fs.writeFileSync(`${src}/b/.git/objects/o1`, "object");
+    fs.writeFileSync(`${src}/a/node_modules/x/index.js`, "module");
+    fs.writeFileSync(`${src}/a/lib/z.js`, "z");
+    fs.writeFileSync(`${src}/a/lib/y.js`, "y");
+    fs.writeFileSync(`${src}/a/notes.txt`, "notes");
+    fs.symlinkSync("lib", `${src}/a/link`);
+
+    const zipfile = "./tests/temp/new-scan.zip";
+    const z = await zip.create(zipfile, undefined, { prefetch: 0 });
+    await z.addDir(src, src, true, {
+        exclude: ["*/.git/*", "*/node_modules/*", "*.txt"],
+        symlinks: "skip",
+        order: "name",
+    });
+    await z.close();
+
+    const r = await zip.open(zipfile);
+    expect(r.walk()).toEqual(["a/", "a/lib/", "a/lib/y.js", "a/lib/z.js", "b/"]);
+    await r.close();
+    expect(() => z.addDir(src, src, true, { symlinks: "maybe" })).toThrow();
+});
+
+test("test addDir symlink policies", async () => {
+    const src = "./tests/temp/links-src";
+    fs.rmSync(src, { recursive: true, force: true });
+    fs.mkdirSync(`${src}/a/lib`, { recursive: true });
+    fs.writeFileSync(`${src}/a/lib/x.js`, "x");
+    fs.symlinkSync("lib", `${src}/a/alias`);
+    // Back into an ancestor: followed, it would never end.
+    fs.symlinkSync("..", `${src}/a/lib/up`);
+
+    const followed = "./tests/temp/new-links-follow.zip";
+    let z = await zip.create(followed);
+    await z.addDir(src, src, true, { symlinks: "follow", order: "name" });
+    await z.close();
+    let r = await zip.open(followed);
+    expect(r.walk()).toEqual(["a/", "a/alias/", "a/alias/x.js", "a/lib/", "a/lib/x.js"]);
+    expect(await r.read("a/alias/x.js")).toBe("x");
+    await r.close();
+
+    const stored = "./tests/temp/new-links-store.zip";
+    z = await zip.create(stored);
+    await z.addDir(src, src, true, { symlinks: "store", order: "name" });
+    await z.close();
+    r = await zip.open(stored);
+    expect(r.walk()).toEqual(["a/", "a/alias", "a/lib/", "a/lib/up", "a/lib/x.js"]);
+    const alias = r.stat("a/alias");
+    expect(alias.is_symlink).toBe(true);
+    expect(alias.linkname).toBe("lib");
+    expect(r.stat("a/lib/up").linkname).toBe("..");
+    await r.close();
+});
+
+test("test deterministic archives", async () => {
+    const src = "./tests/temp/deterministic-src";
+    fs.rmSync(src, { recursive: true, force: true });
+    fs.mkdirSync(`${src}/sub`, { recursive: true });
+    fs.writeFileSync(`${src}/b.txt`, "b".repeat(1000));
+    fs.writeFileSync(`${src}/a.json`, JSON.stringify({ a: [1, 2, 3] }));
+    fs.writeFileSync(`${src}/sub/c.txt`, "c");
+
+    const build = async (zipfile, options) => {
+        const z = await zip.create(zipfile, undefined, { deterministic: true, ...options });
+        await z.addDir(src, src);
+        await z.addBuffer("generated.txt", Buffer.from("generated ".repeat(100)));
+        return await z.close();
+    };
+    await build("./tests/temp/deterministic-1.zip");
+    // DOS times have a 2 second resolution.
+    await new Promise((resolve) => setTimeout(resolve, 2100));
+    fs.utimesSync(`${src}/b.txt`, new Date(), new Date());
+    await build("./tests/temp/deterministic-2.zip");
+    expect(fs.readFileSync("./tests/temp/deterministic-2.zip"))
+        .toEqual(fs.readFileSync("./tests/temp/deterministic-1.zip"));
+
+    fs.writeFileSync(`${src}/sub/c.txt`, "changed");
+    const result = await build("./tests/temp/deterministic-3.zip",
+                               { previous: "./tests/temp/deterministic-1.zip" });
+    // b.txt and generated.txt; a.json is too small to deflate, and a stored
+    // payload is only reused where this writer would store it too.
+    expect(result.reused).toBe(2);
+    const r = await zip.open("./tests/temp/deterministic-3.zip");
+    expect(await r.read("sub/c.txt")).toBe("changed");
+    expect(await r.read("b.txt")).toBe("b".repeat(1000));
+    expect((await r.verify()).ok).toBe(true);
+    await r.close();
+    // Reusing entries does not change the bytes of the archive.
+    await build("./tests/temp/deterministic-4.zip");
+    expect(fs.readFileSync("./tests/temp/deterministic-3.zip"))
+        .toEqual(fs.readFileSync("./tests/temp/deterministic-4.zip"));
+
+    expect(() => zip.create("./tests/temp/bad.zip", "123", { deterministic: true })).toThrow();
+    expect(() => zip.create("./tests/temp/bad.zip", undefined, { deterministic: { mtime: 0 } }))
+        .toThrow();
+});
+
+test("test previous archive checks", async () => {
+    const samples = [];
+    for (let i = 0; i < 200; ++i) {
+        samples.push(Buffer.from(JSON.stringify({ id: i, name: `item ${i}`, tags: ["a", "b", `${i % 7}`] })));
+    }
+    const dictionary = await zip.trainDictionary(samples, { size: 4 * 1024 });
+    const withDictionary = "./tests/temp/previous-dictionary.zip";
+    let z = await zip.create(withDictionary, undefined, { dictionary });
+    samples.forEach((buf, i) => z.addBuffer(`items/${i}.json`, buf));
+    await z.close();
+
+    // Payloads that need the previous archive's dictionary are not copied.
+    const zipfile = "./tests/temp/previous-plain.zip";
+    z = await zip.create(zipfile, undefined, { method: "zstd", previous: withDictionary });
+    samples.forEach((buf, i) => z.addBuffer(`items/${i}.json`, buf));
+    expect((await z.close()).reused).toBe(0);
+    const r = await zip.open(zipfile);
+    expect(await r.read("items/9.json")).toBe(samples[9].toString());
+    expect((await r.verify()).ok).toBe(true);
+    await r.close();
+
+    // The archive being written, under another spelling of its path.
+    await expect(zip.create("./tests/temp/previous-plain.zip", undefined,
+                            { previous: "tests/temp/../temp/previous-plain.zip" })).rejects.toThrow();
+});
+
+test("test zip64 modes", async () => {
+    for (const mode of ["auto", "force", "off"]) {
+        const zipfile = `./tests/temp/new-zip64-${mode}.zip`;
+        const z = await zip.create(zipfile, undefined, { zip64: mode });
+        await z.addFile("./package.json");
+        await z.addBuffer("hello.txt", Buffer.from("hello, zip64"));
+        await z.addDir("native/third_party/minizip/*.md");
+        await z.close();
+
+        const r = await zip.open(zipfile);
+        expect(await r.read("hello.txt")).toBe("hello, zip64");
+        expect(await r.read("package.json")).toBe(fs.readFileSync("./package.json", "utf8"));
+        await r.close();
+    }
+    expect(() => zip.create("./tests/temp/new-zip64-bad.zip", undefined, { zip64: "yes" })).toThrow();
 });